@@ -22,6 +22,7 @@
 
 #include <Urho3D/Core/CoreEvents.h>
 #include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
 #include <Urho3D/Engine/Engine.h>
 #include <Urho3D/Engine/Application.h>
 #include <Urho3D/Graphics/Camera.h>
@@ -39,6 +40,7 @@
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/UI/Font.h>
@@ -46,6 +48,7 @@
 #include <Urho3D/UI/UI.h>
 
 #include "AIBattleGroundApp.hpp"
+#include "Source/Base/StartupTimeline.hpp"
 #include "Source/Intro/Intro.hpp"
 #include <Urho3D/DebugNew.h>
 using namespace Urho3D;
@@ -61,6 +64,21 @@ void AIBattleGroundApp::Start() {
     // Execute base class startup
     AIBattleGround::Start();
 
+    // Load the episode's resources in the background first, the episode is built once they are all in the cache
+    GetSubsystem<StartupTimeline>()->BeginPhase("ResourcePreload");
+    ResourceManifest manifest;
+    currentEpisode_->GetResourceManifest(manifest);
+    preloader_ = new ResourcePreloader(context_);
+    SubscribeToEvent(preloader_, E_PRELOADFINISHED, URHO3D_HANDLER(AIBattleGroundApp, HandlePreloadFinished));
+    preloader_->Start(manifest);
+}
+
+void AIBattleGroundApp::HandlePreloadFinished(StringHash eventType, VariantMap &eventData) {
+    UnsubscribeFromEvent(preloader_, E_PRELOADFINISHED);
+    HiresTimer timer;
+    auto *startupTimeline = GetSubsystem<StartupTimeline>();
+    startupTimeline->EndPhase();
+
     // Create the scene content
     CreateScene();
 
@@ -74,22 +92,39 @@ void AIBattleGroundApp::Start() {
     SubscribeToEvents();
 
     // Set the mouse mode to use in the AIBattleGround
-    AIBattleGround::InitMouseMode(MM_RELATIVE);
+    if (!IsHeadless())
+        AIBattleGround::InitMouseMode(MM_RELATIVE);
+
+    URHO3D_LOGINFOF("Episode built in %.1f ms", (float) timer.GetUSec(false)/1000.0f);
+    startupTimeline->Finish();
 }
 
 void AIBattleGroundApp::CreateScene() {
+    auto *startupTimeline = GetSubsystem<StartupTimeline>();
 
+    startupTimeline->BeginPhase("InitCamera");
     cameraNode_ = currentEpisode_->InitCamera();
+    startupTimeline->EndPhase();
+    startupTimeline->BeginPhase("InitScene");
     scene_ = currentEpisode_->InitScene();
+    startupTimeline->EndPhase();
+    startupTimeline->BeginPhase("InitObjects");
     currentEpisode_->InitObjects();
+    startupTimeline->EndPhase();
 }
 
 void AIBattleGroundApp::CreateInstructions() {
+  auto *startupTimeline = GetSubsystem<StartupTimeline>();
+  startupTimeline->BeginPhase("CreateInstructions");
   currentEpisode_->CreateInstructions();
+  startupTimeline->EndPhase();
 }
 
 void AIBattleGroundApp::SetupViewport() {
+    auto *startupTimeline = GetSubsystem<StartupTimeline>();
+    startupTimeline->BeginPhase("InitViewPort");
     currentEpisode_->InitViewPort();
+    startupTimeline->EndPhase();
 }
 
 void AIBattleGroundApp::SubscribeToEvents() {
@@ -27,6 +27,7 @@
 
 #include "Source/Base/AIBattleGround.hpp"
 #include "Source/Base/Episode.hpp"
+#include "Source/Base/ResourcePreloader.hpp"
 #include <memory>
 
 namespace Urho3D {
@@ -51,6 +52,8 @@ class AIBattleGroundApp : public AIBattleGround {
     void Start() override;
 
  private:
+    /// Handle the episode resources finishing loading and build the episode.
+    void HandlePreloadFinished(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
     /// Construct the scene content.
     void CreateScene();
     /// Construct an instruction text to the UI.
@@ -65,5 +68,7 @@ class AIBattleGroundApp : public AIBattleGround {
     void HandleUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
     /// Current Episode
     std::shared_ptr<Episode> currentEpisode_;
+    /// Background loader of the episode resources.
+    Urho3D::SharedPtr<ResourcePreloader> preloader_;
 };
 #endif //AIBATTLEGROUND_APP_HPP
@@ -0,0 +1,160 @@
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Engine/EngineDefs.h>
+#include <Urho3D/IO/Log.h>
+
+#include "../Source/Base/AIBattleGround.hpp"
+#include "../Source/Base/FrameTimings.hpp"
+#include "../Source/Base/ResourcePreloader.hpp"
+#include "../Source/Base/SpawnScheduler.hpp"
+#include "../Source/Base/StartupTimeline.hpp"
+#include "../Source/Intro/Intro.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Frames recorded unless given with -ticks.
+const unsigned DEFAULT_TICKS = 3600;
+/// Frames run after the population is complete before recording, unless given with -warmup.
+const unsigned DEFAULT_WARMUP = 120;
+/// Report file unless given with -report.
+const char *DEFAULT_REPORT = "AIBattleGroundBench.json";
+
+}
+
+/// Runs the Intro episode headless with the scenario given on the command line and writes a JSON report of the frame
+/// time breakdown. The population is built first, then the warmup frames run, then the measured frames are recorded.
+/// Besides the Intro options (-agents, -props, -drones, -nophysics) and the lockstep ones (-seed), it takes
+/// -ticks <n>, -warmup <n> and -report <file>.
+class AIBattleGroundBench : public AIBattleGround {
+    URHO3D_OBJECT(AIBattleGroundBench, AIBattleGround);
+
+ public:
+    /// Construct.
+    explicit AIBattleGroundBench(Context *context) :
+      AIBattleGround(context),
+      ticks_(DEFAULT_TICKS),
+      warmup_(DEFAULT_WARMUP),
+      reportPath_(DEFAULT_REPORT),
+      warmupLeft_(M_MAX_UNSIGNED) {
+        episode_ = std::make_shared<Intro>(context);
+    }
+
+    /// Force headless mode and read the benchmark options.
+    void Setup() override {
+        engineParameters_[EP_HEADLESS] = true;
+        AIBattleGround::Setup();
+
+        const Vector<String> &arguments = GetArguments();
+        for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+            const String argument = arguments[i].ToLower();
+            if (argument == "-ticks")
+                ticks_ = Max(ToUInt(arguments[++i]), 1u);
+            else if (argument == "-warmup")
+                warmup_ = ToUInt(arguments[++i]);
+            else if (argument == "-report")
+                reportPath_ = arguments[++i];
+        }
+    }
+
+    /// Load the episode resources, then build the scene.
+    void Start() override {
+        AIBattleGround::Start();
+
+        GetSubsystem<StartupTimeline>()->BeginPhase("ResourcePreload");
+        ResourceManifest manifest;
+        episode_->GetResourceManifest(manifest);
+        preloader_ = new ResourcePreloader(context_);
+        SubscribeToEvent(preloader_, E_PRELOADFINISHED, URHO3D_HANDLER(AIBattleGroundBench, HandlePreloadFinished));
+        preloader_->Start(manifest);
+    }
+
+ private:
+    /// Build the episode once its resources are loaded.
+    void HandlePreloadFinished(StringHash eventType, VariantMap &eventData) {
+        UnsubscribeFromEvent(preloader_, E_PRELOADFINISHED);
+        auto *startupTimeline = GetSubsystem<StartupTimeline>();
+        startupTimeline->EndPhase();
+
+        startupTimeline->BeginPhase("InitCamera");
+        cameraNode_ = episode_->InitCamera();
+        startupTimeline->EndPhase();
+        startupTimeline->BeginPhase("InitScene");
+        scene_ = episode_->InitScene();
+        startupTimeline->EndPhase();
+        startupTimeline->BeginPhase("InitObjects");
+        episode_->InitObjects();
+        startupTimeline->EndPhase();
+        startupTimeline->Finish();
+        GetSubsystem<FrameTimings>()->SetCullCamera(cameraNode_->GetComponent<Camera>(),
+                                                    scene_->GetComponent<Octree>());
+
+        SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(AIBattleGroundBench, HandleUpdate));
+        // An empty scenario queues nothing, so no finish event would come
+        auto *spawnScheduler = scene_->GetComponent<SpawnScheduler>();
+        if (spawnScheduler->GetNumQueued())
+            SubscribeToEvent(spawnScheduler, E_SPAWNSFINISHED,
+                             URHO3D_HANDLER(AIBattleGroundBench, HandleSpawnsFinished));
+        else
+            warmupLeft_ = warmup_;
+    }
+
+    /// Start the warmup once the population is complete.
+    void HandleSpawnsFinished(StringHash eventType, VariantMap &eventData) {
+        warmupLeft_ = warmup_;
+    }
+
+    /// Step the episode and count the warmup and recorded frames.
+    void HandleUpdate(StringHash eventType, VariantMap &eventData) {
+        episode_->HandleUpdate(eventType, eventData);
+
+        auto *timings = GetSubsystem<FrameTimings>();
+        if (timings->IsRecording()) {
+            if (timings->GetNumFrames() >= ticks_)
+                Finish();
+        } else if (warmupLeft_ != M_MAX_UNSIGNED && warmupLeft_-- == 0) {
+            timings->SetRecording(true);
+        }
+    }
+
+    /// Write the report and exit.
+    void Finish() {
+        auto *timings = GetSubsystem<FrameTimings>();
+        timings->SetRecording(false);
+
+        const IntroOptions &options = std::static_pointer_cast<Intro>(episode_)->GetOptions();
+        JSONValue scenario;
+        scenario.Set("agents", JSONValue(options.numAgents_));
+        scenario.Set("props", JSONValue(options.numProps_));
+        scenario.Set("drones", JSONValue(options.numDrones_));
+        scenario.Set("physics", JSONValue(options.physics_));
+        scenario.Set("warmup", JSONValue(warmup_));
+        scenario.Set("platform", JSONValue(GetPlatform()));
+        scenario.Set("cpuThreads", JSONValue(GetNumLogicalCPUs()));
+
+        if (timings->SaveReport(reportPath_, scenario))
+            URHO3D_LOGINFOF("Wrote %u frames to %s", timings->GetNumFrames(), reportPath_.CString());
+        else {
+            URHO3D_LOGERROR("Could not write benchmark report " + reportPath_);
+            exitCode_ = EXIT_FAILURE;
+        }
+        engine_->Exit();
+    }
+
+    /// Episode measured.
+    std::shared_ptr<Episode> episode_;
+    /// Background loader of the episode resources.
+    SharedPtr<ResourcePreloader> preloader_;
+    /// Frames recorded.
+    unsigned ticks_;
+    /// Frames run before recording.
+    unsigned warmup_;
+    /// Report file.
+    String reportPath_;
+    /// Warmup frames left, M_MAX_UNSIGNED until the population is complete.
+    unsigned warmupLeft_;
+};
+
+URHO3D_DEFINE_APPLICATION_MAIN(AIBattleGroundBench)
@@ -0,0 +1,330 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Animation.h>
+#include <Urho3D/Graphics/AnimationState.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/Scene.h>
+#include <functional>
+#include <vector>
+
+#include "../Source/Base/EntityPool.hpp"
+#include "../Source/Base/PhysicsLod.hpp"
+#include "../Source/Base/PropInstancer.hpp"
+#include "../Source/Intro/DroneMover.h"
+#include "../Source/Intro/Intro.hpp"
+#include "../Source/Intro/Mover.h"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Frame time step passed to the updates.
+const float TIME_STEP = 1.0f/60.0f;
+/// Minimum measured time of a benchmark in microseconds, unless given with -mintime <ms>.
+const long long DEFAULT_MIN_TIME_US = 200000;
+/// Upper limit of iterations of a benchmark.
+const unsigned MAX_ITERATIONS = 100000;
+/// Entity counts every benchmark runs at.
+const unsigned ENTITY_COUNTS[] = {100, 1000, 5000};
+/// Half extent of the area the entities are placed in, matching the Intro episode.
+const float WORLD_BOUND = 500.0f;
+
+/// Iteration state of one benchmark run, in the manner of Google Benchmark: the body loops while KeepRunning()
+/// returns true and excludes its per-iteration setup with PauseTiming() and ResumeTiming().
+class BenchState {
+ public:
+    /// Construct for an entity count.
+    BenchState(unsigned count, long long minTimeUs) :
+      count_(count),
+      minTimeUs_(minTimeUs),
+      iterations_(0),
+      pausedUs_(0),
+      pauseStartUs_(0),
+      elapsedUs_(0) {
+    }
+
+    /// Start or continue the next iteration. Return false once the minimum time has been measured.
+    bool KeepRunning() {
+        if (!iterations_) {
+            timer_.Reset();
+        } else {
+            elapsedUs_ = timer_.GetUSec(false) - pausedUs_;
+            if (elapsedUs_ >= minTimeUs_ || iterations_ >= MAX_ITERATIONS)
+                return false;
+        }
+        ++iterations_;
+        return true;
+    }
+    /// Stop counting time, for setup inside the loop.
+    void PauseTiming() { pauseStartUs_ = timer_.GetUSec(false); }
+    /// Count time again.
+    void ResumeTiming() { pausedUs_ += timer_.GetUSec(false) - pauseStartUs_; }
+
+    /// Return number of entities processed per iteration.
+    unsigned GetCount() const { return count_; }
+    /// Return number of iterations run.
+    unsigned GetIterations() const { return iterations_; }
+    /// Return nanoseconds per entity per iteration.
+    float GetNsPerEntity() const {
+        return iterations_ ? (float) elapsedUs_*1000.0f/((float) iterations_*(float) count_) : 0.0f;
+    }
+
+ private:
+    /// Entities processed per iteration.
+    unsigned count_;
+    /// Minimum measured time.
+    long long minTimeUs_;
+    /// Iterations started.
+    unsigned iterations_;
+    /// Time spent paused.
+    long long pausedUs_;
+    /// Timer value at the last pause.
+    long long pauseStartUs_;
+    /// Measured time without the pauses.
+    long long elapsedUs_;
+    /// Time since the first iteration.
+    HiresTimer timer_;
+};
+
+/// Benchmark body, builds its fixture for the state's entity count and then loops.
+using BenchFunction = std::function<void(Context *, BenchState &)>;
+
+/// Named benchmark.
+struct Benchmark {
+    String name_;
+    BenchFunction function_;
+};
+
+/// Create the minimal headless context: resources, scene, graphics components without a Graphics subsystem,
+/// physics, and the components the Intro builders create.
+SharedPtr<Context> CreateContext() {
+    SharedPtr<Context> context(new Context());
+    context->RegisterSubsystem(new FileSystem(context));
+    context->RegisterSubsystem(new ResourceCache(context));
+    context->RegisterSubsystem(new WorkQueue(context));
+    RegisterResourceLibrary(context);
+    RegisterSceneLibrary(context);
+    RegisterGraphicsLibrary(context);
+    RegisterPhysicsLibrary(context);
+    context->RegisterFactory<Mover>();
+    context->RegisterFactory<DroneMover>();
+    context->RegisterFactory<PropInstancer>();
+    context->RegisterFactory<PhysicsLod>();
+    context->RegisterFactory<EntityPool>();
+
+    auto *cache = context->GetSubsystem<ResourceCache>();
+    const String programDir = context->GetSubsystem<FileSystem>()->GetProgramDir();
+    cache->AddResourceDir(programDir + "Data");
+    cache->AddResourceDir(programDir + "CoreData");
+    return context;
+}
+
+/// Return a random ground position inside the world bounds.
+Vector3 RandomPosition() {
+    return Vector3(Random(-WORLD_BOUND, WORLD_BOUND), 0.0f, Random(-WORLD_BOUND, WORLD_BOUND));
+}
+
+/// Create an Intro agent without its body: the animated model of an agent kind and a Mover outside any crowd.
+Mover *CreateAgent(Scene *scene, unsigned kind) {
+    auto *cache = scene->GetSubsystem<ResourceCache>();
+    const auto &resources = Intro::GetAgentKind(kind);
+
+    Node *node = scene->CreateChild("Jack");
+    node->SetPosition(RandomPosition());
+    node->SetRotation(Quaternion(0.0f, Random(360.0f), 0.0f));
+    Node *adjustNode = node->CreateChild("AdjNode");
+    adjustNode->SetRotation(Quaternion(180, Vector3(0, 1, 0)));
+
+    auto *model = adjustNode->CreateComponent<AnimatedModel>();
+    model->SetModel(cache->GetResource<Model>(std::get<0>(resources)));
+    model->SetMaterial(cache->GetResource<Material>(std::get<2>(resources)));
+    if (AnimationState *state = model->AddAnimationState(cache->GetResource<Animation>(std::get<1>(resources)))) {
+        state->SetWeight(1.0f);
+        state->SetLooped(true);
+    }
+
+    auto *mover = node->CreateComponent<Mover>();
+    mover->SetParameters(20.0f, 100.0f, BoundingBox(Vector3(-WORLD_BOUND, 0.0f, -WORLD_BOUND),
+                                                    Vector3(WORLD_BOUND, 0.0f, WORLD_BOUND)));
+    return mover;
+}
+
+/// Mover::Update of walking agents.
+void MoverUpdate(Context *context, BenchState &state) {
+    SharedPtr<Scene> scene(new Scene(context));
+    std::vector<Mover *> movers;
+    for (unsigned i = 0; i < state.GetCount(); ++i)
+        movers.push_back(CreateAgent(scene, i));
+
+    while (state.KeepRunning()) {
+        for (Mover *mover : movers)
+            mover->Update(TIME_STEP);
+    }
+}
+
+/// DroneMover::Update of drones built like the Intro drone pool.
+void DroneMoverUpdate(Context *context, BenchState &state) {
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+    Node *camera = scene->CreateChild("DroneCamera");
+
+    std::vector<DroneMover *> movers;
+    for (unsigned i = 0; i < state.GetCount(); ++i) {
+        Node *node = scene->CreateChild("Drone");
+        node->SetPosition(RandomPosition() + Vector3(0.0f, 50.0f, 0.0f));
+        node->SetRotation(Quaternion(0.0f, Random(360.0f), 0.0f));
+        Intro::BuildDrone(node, camera);
+        movers.push_back(node->GetComponent<DroneMover>());
+    }
+
+    while (state.KeepRunning()) {
+        for (DroneMover *mover : movers)
+            mover->Update(TIME_STEP);
+    }
+}
+
+/// Create a scene with the components the Intro props register with.
+SharedPtr<Scene> CreatePropScene(Context *context) {
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+    scene->CreateComponent<PropInstancer>();
+    scene->CreateComponent<PhysicsLod>();
+    return scene;
+}
+
+/// Intro::CreateProp of the CreateObjects props: node, instance, body and shape, registered with the instancer and
+/// the physics level of detail. Every iteration starts on a new scene, made outside the timing, so that the instancer
+/// and the physics level of detail do not keep the removed props.
+void PropConstruction(Context *context, BenchState &state) {
+    auto *cache = context->GetSubsystem<ResourceCache>();
+    auto *model = cache->GetResource<Model>("Models/Box.mdl");
+    auto *material = cache->GetResource<Material>("Materials/Particle.xml");
+
+    std::vector<Vector3> positions;
+    for (unsigned i = 0; i < state.GetCount(); ++i)
+        positions.push_back(RandomPosition() + Vector3(0.0f, 100.0f, 0.0f));
+
+    SharedPtr<Scene> scene = CreatePropScene(context);
+    while (state.KeepRunning()) {
+        for (const Vector3 &position : positions)
+            Intro::CreateProp(scene, "Box", position, Quaternion::IDENTITY, 5.5f, model, material, 30.0f);
+        state.PauseTiming();
+        scene = CreatePropScene(context);
+        state.ResumeTiming();
+    }
+}
+
+/// Intro::ThrowSphere, the body of SpawnObject: a sphere taken from its pool, scaled, weighted and thrown. The pool
+/// is emptied outside the timing so that every spawn takes a free entity.
+void SphereSpawn(Context *context, BenchState &state) {
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+    auto *pool = scene->CreateComponent<EntityPool>();
+    const unsigned spheres = pool->CreatePool("Spheres", state.GetCount(), [](Node *node) { Intro::BuildSphere(node); });
+
+    std::vector<Node *> spawned;
+    while (state.KeepRunning()) {
+        for (unsigned i = 0; i < state.GetCount(); ++i) {
+            spawned.push_back(Intro::ThrowSphere(pool, spheres, Vector3((float) i, 10.0f, 0.0f),
+                                                 Quaternion(0.0f, (float) i, 0.0f), 2.5f));
+        }
+        state.PauseTiming();
+        for (Node *node : spawned)
+            pool->Despawn(node);
+        spawned.clear();
+        state.ResumeTiming();
+    }
+}
+
+/// Intro::LaunchDrone, the body of SpawnDrone: a drone taken from its pool, with the drone camera aimed at it.
+void DroneSpawn(Context *context, BenchState &state) {
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+    Node *camera = scene->CreateChild("DroneCamera");
+    auto *pool = scene->CreateComponent<EntityPool>();
+    const unsigned drones = pool->CreatePool("Drones", state.GetCount(),
+                                             [camera](Node *node) { Intro::BuildDrone(node, camera); });
+
+    std::vector<Node *> spawned;
+    while (state.KeepRunning()) {
+        for (unsigned i = 0; i < state.GetCount(); ++i) {
+            spawned.push_back(Intro::LaunchDrone(pool, drones, Vector3((float) i, 50.0f, 0.0f),
+                                                 Quaternion(0.0f, (float) i, 0.0f), camera));
+        }
+        state.PauseTiming();
+        for (Node *node : spawned)
+            pool->Despawn(node);
+        spawned.clear();
+        state.ResumeTiming();
+    }
+}
+
+/// Return a benchmark of AnimationState::AddTime for the run animation of an agent kind.
+BenchFunction AnimationAddTime(unsigned kind) {
+    return [kind](Context *context, BenchState &state) {
+        SharedPtr<Scene> scene(new Scene(context));
+        std::vector<AnimationState *> states;
+        for (unsigned i = 0; i < state.GetCount(); ++i) {
+            Mover *mover = CreateAgent(scene, kind);
+            auto *model = mover->GetNode()->GetComponent<AnimatedModel>(true);
+            if (model->GetNumAnimationStates())
+                states.push_back(model->GetAnimationStates()[0]);
+        }
+        if (states.empty())
+            return;
+
+        while (state.KeepRunning()) {
+            for (AnimationState *animationState : states)
+                animationState->AddTime(TIME_STEP);
+        }
+    };
+}
+
+}
+
+int main(int argc, char **argv) {
+    ParseArguments(argc, argv);
+    String filter;
+    long long minTimeUs = DEFAULT_MIN_TIME_US;
+    const Vector<String> &arguments = GetArguments();
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+        const String argument = arguments[i].ToLower();
+        if (argument == "-filter")
+            filter = arguments[++i];
+        else if (argument == "-mintime")
+            minTimeUs = Max(ToUInt(arguments[++i]), 1u)*1000LL;
+    }
+
+    SharedPtr<Context> context = CreateContext();
+    std::vector<Benchmark> benchmarks = {{"MoverUpdate", MoverUpdate},
+                                         {"DroneMoverUpdate", DroneMoverUpdate},
+                                         {"PropConstruction", PropConstruction},
+                                         {"SphereSpawn", SphereSpawn},
+                                         {"DroneSpawn", DroneSpawn}};
+    for (unsigned kind = 0; kind < Intro::GetNumAgentKinds(); ++kind) {
+        const String clip = GetFileName(std::get<1>(Intro::GetAgentKind(kind)));
+        benchmarks.push_back({"AnimationAddTime/" + clip, AnimationAddTime(kind)});
+    }
+
+    PrintLine(ToString("%-34s %8s %14s %12s", "Benchmark", "Entities", "Time", "Iterations"));
+    for (const Benchmark &benchmark : benchmarks) {
+        if (!filter.Empty() && !benchmark.name_.Contains(filter, false))
+            continue;
+        for (unsigned count : ENTITY_COUNTS) {
+            SetRandomSeed(count);
+            BenchState state(count, minTimeUs);
+            benchmark.function_(context, state);
+            PrintLine(ToString("%-34s %8u %8.1f ns/e %12u", benchmark.name_.CString(), count, state.GetNsPerEntity(),
+                               state.GetIterations()));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+#include <vector>
+
+#include "../Source/Base/PhysicsThreading.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Physics frame time step.
+const float TIME_STEP = 1.0f/60.0f;
+/// Frames simulated before measuring, long enough for the dropped bodies to land.
+const unsigned WARMUP_FRAMES = 300;
+/// Frames measured.
+const unsigned MEASURED_FRAMES = 600;
+/// Extent of the area the props are dropped on, from the origin along +X and +Z like in the Intro episode.
+const float PROP_BOUND = 700.0f;
+/// Extent of the area the agents are dropped on, from the origin along +X and +Z like in the Intro episode.
+const float AGENT_BOUND = 500.0f;
+/// Number of agents.
+const unsigned NUM_AGENTS = 700;
+/// Agent walking speed.
+const float AGENT_SPEED = 15.0f;
+
+/// Prop kind of the Intro episode.
+struct PropKind {
+    unsigned count_;
+    float massScalar_;
+    bool sphere_;
+};
+const PropKind PROP_KINDS[] = {{100, 100.0f, false}, {100, 300.0f, false}, {100, 150.0f, false},
+                               {100, 1000.0f, false}, {300, 30.0f, false}, {300, 10.0f, true}};
+
+/// Build the Intro body population: props and capsule agents dropped from above a flat ground.
+void BuildScene(Scene *scene, std::vector<RigidBody *> &agents) {
+    SetRandomSeed(1);
+
+    // A flat box stands in for the heightmap terrain, which needs the resource directory
+    Node *groundNode = scene->CreateChild("Ground");
+    groundNode->SetPosition(Vector3(0.0f, -5.0f, 0.0f));
+    groundNode->SetScale(Vector3(2048.0f, 10.0f, 2048.0f));
+    groundNode->CreateComponent<RigidBody>()->SetCollisionLayer(2);
+    groundNode->CreateComponent<CollisionShape>()->SetBox(Vector3::ONE);
+
+    for (const PropKind &kind : PROP_KINDS) {
+        for (unsigned i = 0; i < kind.count_; ++i) {
+            const float scale = Random(1, 10) + 0.5f;
+            Node *node = scene->CreateChild("Prop");
+            node->SetPosition(Vector3(Random(PROP_BOUND), 100.0f, Random(PROP_BOUND)));
+            node->SetRotation(Quaternion(Random(360.0f), Random(360.0f), Random(360.0f)));
+            node->SetScale(scale);
+            auto *body = node->CreateComponent<RigidBody>();
+            body->SetMass(scale*kind.massScalar_);
+            auto *shape = node->CreateComponent<CollisionShape>();
+            if (kind.sphere_) {
+                body->SetRollingFriction(1.0f);
+                shape->SetSphere(1.0f);
+            } else {
+                shape->SetBox(Vector3::ONE);
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < NUM_AGENTS; ++i) {
+        const float scaleWeight = Random(1, 10);
+        Node *node = scene->CreateChild("Jack");
+        node->SetPosition(Vector3(Random(AGENT_BOUND), 100.0f, Random(AGENT_BOUND)));
+        node->SetRotation(Quaternion(0.0f, Random(360.0f), 0.0f));
+        node->SetScale(scaleWeight);
+        auto *body = node->CreateComponent<RigidBody>();
+        body->SetCollisionLayer(1);
+        body->SetMass(scaleWeight*100);
+        body->SetAngularFactor(Vector3::ZERO);
+        node->CreateComponent<CollisionShape>()->SetCapsule(0.7f, 1.8f, Vector3(0.0f, 0.9f, 0.0f));
+        agents.push_back(body);
+    }
+}
+
+/// Simulate the population with a number of threads. Return milliseconds per frame.
+float RunCase(unsigned numThreads, float baseline) {
+    SharedPtr<Context> context(new Context());
+    RegisterSceneLibrary(context);
+    RegisterPhysicsLibrary(context);
+    context->RegisterFactory<PhysicsThreading>();
+    context->RegisterSubsystem(new WorkQueue(context));
+    context->GetSubsystem<WorkQueue>()->CreateThreads(numThreads - 1);
+
+    SharedPtr<Scene> scene(new Scene(context));
+    auto *physicsWorld = scene->CreateComponent<PhysicsWorld>();
+    scene->CreateComponent<PhysicsThreading>()->SetNumThreads(numThreads);
+    std::vector<RigidBody *> agents;
+    BuildScene(scene, agents);
+
+    HiresTimer timer;
+    long long measuredUs = 0;
+    long long worstUs = 0;
+    for (unsigned frame = 0; frame < WARMUP_FRAMES + MEASURED_FRAMES; ++frame) {
+        // The agents keep walking like under the crowd, so they stay awake
+        for (RigidBody *body : agents) {
+            const Vector3 velocity = body->GetNode()->GetRotation()*Vector3::FORWARD*AGENT_SPEED;
+            body->SetLinearVelocity(Vector3(velocity.x_, body->GetLinearVelocity().y_, velocity.z_));
+        }
+
+        timer.Reset();
+        physicsWorld->Update(TIME_STEP);
+        const long long frameUs = timer.GetUSec(false);
+        if (frame >= WARMUP_FRAMES) {
+            measuredUs += frameUs;
+            worstUs = Max(worstUs, frameUs);
+        }
+    }
+
+    unsigned numActive = 0;
+    for (Node *node : scene->GetChildrenWithComponent(RigidBody::GetTypeStatic())) {
+        if (node->GetComponent<RigidBody>()->IsActive())
+            ++numActive;
+    }
+
+    const float frameMs = (float) measuredUs/(float) MEASURED_FRAMES/1000.0f;
+    PrintLine(ToString("%2u threads | step %7.3f ms | worst %7.3f ms | speedup %5.2fx | %u active bodies",
+                       numThreads, frameMs, (float) worstUs/1000.0f, baseline > 0.0f ? baseline/frameMs : 1.0f,
+                       numActive));
+    return frameMs;
+}
+
+}
+
+int main() {
+    const unsigned maxThreads = Max(GetNumLogicalCPUs(), 1u);
+    PrintLine(ToString("Intro body population, %u measured frames per thread count", MEASURED_FRAMES));
+    if (!PhysicsThreading::IsAvailable())
+        PrintLine("Built without AIBATTLEGROUND_BULLET_MT, only the single-threaded world is measured");
+
+    const float baseline = RunCase(1, 0.0f);
+    if (PhysicsThreading::IsAvailable()) {
+        for (unsigned numThreads = 2; numThreads < maxThreads; numThreads *= 2)
+            RunCase(numThreads, baseline);
+        if (maxThreads > 1)
+            RunCase(maxThreads, baseline);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "../Source/Base/SpatialGrid.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// World half extent, matching the Intro episode.
+const float WORLD_BOUND = 1000.0f;
+/// Grid cell size, matching CrowdSystem.
+const float CELL_SIZE = 20.0f;
+/// Neighbourhood query radius.
+const float QUERY_RADIUS = 25.0f;
+/// Number of queries per measurement.
+const unsigned NUM_QUERIES = 1000;
+/// Neighbours requested by the k-nearest query.
+const unsigned NUM_NEAREST = 8;
+
+/// Return microseconds per operation.
+float PerOp(long long usec, unsigned count) {
+    return (float) usec/(float) count;
+}
+
+/// Compare grid queries with a linear scan over the scene children for one agent count.
+void RunCase(Context *context, unsigned numAgents) {
+    SharedPtr<Scene> scene(new Scene(context));
+    SpatialGrid grid(BoundingBox(-WORLD_BOUND, WORLD_BOUND), CELL_SIZE);
+
+    SetRandomSeed(numAgents);
+    for (unsigned i = 0; i < numAgents; ++i) {
+        const Vector3 position(Random(-WORLD_BOUND, WORLD_BOUND), 0.0f, Random(-WORLD_BOUND, WORLD_BOUND));
+        scene->CreateChild("Jack")->SetPosition(position);
+        grid.Update(i, position.x_, position.z_);
+    }
+
+    PODVector<Vector3> centers;
+    for (unsigned i = 0; i < NUM_QUERIES; ++i)
+        centers.Push(Vector3(Random(-WORLD_BOUND, WORLD_BOUND), 0.0f, Random(-WORLD_BOUND, WORLD_BOUND)));
+
+    HiresTimer timer;
+    const float radiusSquared = QUERY_RADIUS*QUERY_RADIUS;
+    const Vector<SharedPtr<Node>> &children = scene->GetChildren();
+    unsigned linearHits = 0;
+    for (const Vector3 &center : centers) {
+        for (const SharedPtr<Node> &child : children) {
+            const Vector3 delta = child->GetPosition() - center;
+            if (delta.x_*delta.x_ + delta.z_*delta.z_ <= radiusSquared)
+                ++linearHits;
+        }
+    }
+    const long long linearUs = timer.GetUSec(true);
+
+    PODVector<unsigned> result;
+    unsigned gridHits = 0;
+    for (const Vector3 &center : centers) {
+        result.Clear();
+        grid.QueryRadius(center.x_, center.z_, QUERY_RADIUS, result);
+        gridHits += result.Size();
+    }
+    const long long gridUs = timer.GetUSec(true);
+
+    PODVector<unsigned> offsets;
+    result.Clear();
+    grid.QueryRadiusBatch(centers, QUERY_RADIUS, result, offsets);
+    const long long batchUs = timer.GetUSec(true);
+
+    for (const Vector3 &center : centers) {
+        result.Clear();
+        grid.QueryNearest(center.x_, center.z_, NUM_NEAREST, result);
+    }
+    const long long nearestUs = timer.GetUSec(true);
+
+    const Vector3 halfBox(QUERY_RADIUS, 0.0f, QUERY_RADIUS);
+    for (const Vector3 &center : centers) {
+        result.Clear();
+        grid.QueryBox(BoundingBox(center - halfBox, center + halfBox), result);
+    }
+    const long long boxUs = timer.GetUSec(true);
+
+    // One frame of agent movement, most agents stay inside their cell
+    for (unsigned i = 0; i < numAgents; ++i) {
+        const Vector3 position = children[i]->GetPosition() + Vector3(0.25f, 0.0f, 0.25f);
+        grid.Update(i, position.x_, position.z_);
+    }
+    const long long updateUs = timer.GetUSec(true);
+
+    PrintLine(ToString("%6u agents | linear %9.2f us | grid %7.2f us | batch %7.2f us | knn%u %7.2f us | box %7.2f us"
+                       " | update %6.2f ns/agent | hits %u/%u",
+                       numAgents, PerOp(linearUs, NUM_QUERIES), PerOp(gridUs, NUM_QUERIES),
+                       PerOp(batchUs, NUM_QUERIES), NUM_NEAREST, PerOp(nearestUs, NUM_QUERIES),
+                       PerOp(boxUs, NUM_QUERIES), PerOp(updateUs, numAgents)*1000.0f, gridHits, linearHits));
+}
+
+}
+
+int main(int argc, char **argv) {
+    SharedPtr<Context> context(new Context());
+
+    PrintLine(ToString("Radius %.1f queries per agent count, times per query", QUERY_RADIUS));
+    for (unsigned numAgents : {1000u, 10000u, 50000u})
+        RunCase(context, numAgents);
+    return 0;
+}
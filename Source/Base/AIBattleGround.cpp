@@ -18,6 +18,8 @@
 // THE SOFTWARE.
 //
 
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/Engine/Application.h>
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Engine/Console.h>
@@ -40,7 +42,19 @@
 #include <Urho3D/Resource/XMLFile.h>
 #include <Urho3D/IO/Log.h>
 #include "AIBattleGround.hpp"
+#include "AsyncLog.hpp"
+#include "FrameTimings.hpp"
+#include "Lockstep.hpp"
+#include "StartupTimeline.hpp"
+#include "TraceRecorder.hpp"
+#include "UpdateCosts.hpp"
 using namespace Urho3D;
+
+/// Wall-clock seconds between simulation rate reports.
+static const float SIMULATION_REPORT_INTERVAL = 10.0f;
+/// Fixed timestep of headless runs unless set on the command line.
+static const float HEADLESS_TIME_STEP = 1.0f / 60.0f;
+
 AIBattleGround::AIBattleGround(Context* context) :
   Application(context),
   yaw_(0.0f),
@@ -49,58 +63,162 @@ AIBattleGround::AIBattleGround(Context* context) :
   useMouseMode_(MM_ABSOLUTE),
   screenJoystickIndex_(M_MAX_UNSIGNED),
   screenJoystickSettingsIndex_(M_MAX_UNSIGNED),
-  paused_(false)
+  paused_(false),
+  fixedTimeStep_(0.0f),
+  uncapped_(false),
+  maxFrames_(0),
+  numFrames_(0),
+  simulatedTime_(0.0),
+  reportedSimulatedTime_(0.0)
 {
 }
 
 void AIBattleGround::Setup()
 {
+    // Startup is timed from here to the end of the first frame with the episode built
+    StartupTimeline* startupTimeline = new StartupTimeline(context_);
+    context_->RegisterSubsystem(startupTimeline);
+    startupTimeline->SetColdStart(StartupTimeline::ColdStartFromArguments(GetArguments()));
+    startupTimeline->BeginPhase("Setup");
+
+    // The log file is written by a background thread, the engine log only prints
+    AsyncLog* asyncLog = new AsyncLog(context_);
+    context_->RegisterSubsystem(asyncLog);
+    asyncLog->Open(GetSubsystem<FileSystem>()->GetAppPreferencesDir("AIBattleGround", "logs") + GetTypeName() + ".log");
+
     // Modify engine startup parameters
     engineParameters_[EP_WINDOW_TITLE] = GetTypeName();
-    engineParameters_[EP_LOG_NAME]     = GetSubsystem<FileSystem>()->GetAppPreferencesDir("AIBattleGround", "logs") + GetTypeName() + ".log";
+    engineParameters_[EP_LOG_NAME]     = String::EMPTY;
     engineParameters_[EP_FULL_SCREEN]  = false;
-    engineParameters_[EP_HEADLESS]     = false;
     engineParameters_[EP_SOUND]        = false;
     engineParameters_[EP_WINDOW_RESIZABLE] = true;
+    // The parameters are already parsed from the command line, keep -headless when given
+    if (!engineParameters_.Contains(EP_HEADLESS))
+        engineParameters_[EP_HEADLESS] = false;
+
+    // Simulation options: -fixedstep <fps> steps at a fixed rate, -frames <count> exits after that many frames
+    const Vector<String>& arguments = GetArguments();
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i)
+    {
+        const String argument = arguments[i].ToLower();
+        if (argument == "-fixedstep")
+        {
+            const float fps = ToFloat(arguments[++i]);
+            fixedTimeStep_ = fps > 0.0f ? 1.0f / fps : 0.0f;
+        }
+        else if (argument == "-frames")
+            maxFrames_ = ToUInt(arguments[++i]);
+    }
+    // Reproducible runs need the fixed timestep as well, replays also run as fast as possible
+    const LockstepOptions lockstep = LockstepOptions::FromArguments(arguments);
+    if ((engineParameters_[EP_HEADLESS].GetBool() || lockstep.IsDeterministic()) && fixedTimeStep_ == 0.0f)
+        fixedTimeStep_ = HEADLESS_TIME_STEP;
+    uncapped_ = !lockstep.replayPath_.Empty();
 
     // Construct a search path to find the resource prefix with two entries:
     // The first entry is an empty path which will be substituted with program/bin directory -- this entry is for binary when it is still in build tree
     // The second and third entries are possible relative paths from the installed program/bin directory to the asset directory -- these entries are for binary when it is in the Urho3D SDK installation location
     if (!engineParameters_.Contains(EP_RESOURCE_PREFIX_PATHS))
         engineParameters_[EP_RESOURCE_PREFIX_PATHS] = ";../share/Resources;../share/Urho3D/Resources";
+
+    startupTimeline->EndPhase();
+    startupTimeline->BeginPhase("EngineInit");
 }
 
 void AIBattleGround::Start()
 {
-    if (GetPlatform() == "Android" || GetPlatform() == "iOS")
-        // On mobile platform, enable touch by adding a screen joystick
-        InitTouchInput();
-    else if (GetSubsystem<Input>()->GetNumJoysticks() == 0)
-        // On desktop platform, do not detect touch when we already got a joystick
-        SubscribeToEvent(E_TOUCHBEGIN, URHO3D_HANDLER(AIBattleGround, HandleTouchBegin));
-
-    // Create logo
-    //CreateLogo();
-
-    // Set custom window Title & Icon
-    SetWindowTitleAndIcon();
-
-    // Create console and debug HUD
-    CreateConsoleAndDebugHud();
-
-    // Subscribe key down event
-    SubscribeToEvent(E_KEYDOWN, URHO3D_HANDLER(AIBattleGround, HandleKeyDown));
-    // Subscribe key up event
-    SubscribeToEvent(E_KEYUP, URHO3D_HANDLER(AIBattleGround, HandleKeyUp));
+    StartupTimeline* startupTimeline = GetSubsystem<StartupTimeline>();
+    startupTimeline->EndPhase();
+    startupTimeline->BeginPhase("Start");
+
+    // Nothing is shown and no input arrives when headless, so run the simulation as fast as the CPU allows
+    if (IsHeadless() || uncapped_)
+    {
+        engine_->SetMaxFps(0);
+        engine_->SetMaxInactiveFps(0);
+    }
+
+    if (!IsHeadless())
+    {
+        if (GetPlatform() == "Android" || GetPlatform() == "iOS")
+            // On mobile platform, enable touch by adding a screen joystick
+            InitTouchInput();
+        else if (GetSubsystem<Input>()->GetNumJoysticks() == 0)
+            // On desktop platform, do not detect touch when we already got a joystick
+            SubscribeToEvent(E_TOUCHBEGIN, URHO3D_HANDLER(AIBattleGround, HandleTouchBegin));
+
+        // Create logo
+        //CreateLogo();
+
+        // Set custom window Title & Icon
+        startupTimeline->BeginPhase("SetWindowTitleAndIcon");
+        SetWindowTitleAndIcon();
+        startupTimeline->EndPhase();
+
+        // Create console and debug HUD
+        startupTimeline->BeginPhase("CreateConsoleAndDebugHud");
+        CreateConsoleAndDebugHud();
+        startupTimeline->EndPhase();
+
+        // Subscribe key down event
+        SubscribeToEvent(E_KEYDOWN, URHO3D_HANDLER(AIBattleGround, HandleKeyDown));
+        // Subscribe key up event
+        SubscribeToEvent(E_KEYUP, URHO3D_HANDLER(AIBattleGround, HandleKeyUp));
+    }
+
+    // Section times of every frame, read by the crowd and the flight recorder
+    context_->RegisterSubsystem(new FrameTimings(context_));
+
+    // Trace recording from the console, F3 or a frame range given with -trace <first>-<last>
+    auto* traceRecorder = new TraceRecorder(context_);
+    context_->RegisterSubsystem(traceRecorder);
+    unsigned traceFirst, traceLast;
+    if (TraceRecorder::FrameRangeFromArguments(GetArguments(), traceFirst, traceLast))
+        traceRecorder->SetFrameRange(traceFirst, traceLast);
+
+    // Update cost attribution from the console, F4 or -updatecosts
+    auto* updateCosts = new UpdateCosts(context_);
+    context_->RegisterSubsystem(updateCosts);
+    if (UpdateCosts::EnabledFromArguments(GetArguments()))
+        updateCosts->SetEnabled(true);
+
     // Subscribe scene update event
     SubscribeToEvent(E_SCENEUPDATE, URHO3D_HANDLER(AIBattleGround, HandleSceneUpdate));
+
+    // Subscribe end of frame event to step at a fixed rate and report the simulation speed
+    if (fixedTimeStep_ > 0.0f || maxFrames_ || IsHeadless())
+    {
+        if (fixedTimeStep_ > 0.0f)
+            engine_->SetNextTimeStep(fixedTimeStep_);
+        wallTimer_.Reset();
+        reportTimer_.Reset();
+        SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(AIBattleGround, HandleEndFrame));
+    }
+
+    // Subscribe replay end event to finish headless replays
+    SubscribeToEvent(E_REPLAYFINISHED, URHO3D_HANDLER(AIBattleGround, HandleReplayFinished));
+
+    startupTimeline->EndPhase();
 }
 
 void AIBattleGround::Stop()
 {
+    // Write a trace still being recorded
+    if (TraceRecorder* traceRecorder = GetSubsystem<TraceRecorder>())
+        traceRecorder->Stop();
+    // Export the update costs still being attributed
+    if (UpdateCosts* updateCosts = GetSubsystem<UpdateCosts>())
+        updateCosts->SetEnabled(false);
+    if (numFrames_)
+        ReportSimulationRate(simulatedTime_, wallTimer_.GetUSec(false) / 1000000.0f);
     engine_->DumpResources(true);
 }
 
+bool AIBattleGround::IsHeadless() const
+{
+    return !GetSubsystem<Graphics>();
+}
+
 void AIBattleGround::InitTouchInput()
 {
     touchEnabled_ = true;
@@ -256,6 +374,31 @@ void AIBattleGround::HandleKeyDown(StringHash /*eventType*/, VariantMap& eventDa
     else if (key == KEY_F2)
         GetSubsystem<DebugHud>()->ToggleAll();
 
+        // Start or stop trace recording with F3
+    else if (key == KEY_F3)
+    {
+        TraceRecorder* traceRecorder = GetSubsystem<TraceRecorder>();
+        if (traceRecorder->IsRecording())
+            traceRecorder->Stop();
+        else
+            traceRecorder->Start();
+    }
+
+        // Toggle update cost attribution with F4
+    else if (key == KEY_F4)
+    {
+        UpdateCosts* updateCosts = GetSubsystem<UpdateCosts>();
+        updateCosts->SetEnabled(!updateCosts->IsEnabled());
+    }
+
+        // Cycle the update cost order with F8
+    else if (key == KEY_F8)
+    {
+        UpdateCosts* updateCosts = GetSubsystem<UpdateCosts>();
+        if (updateCosts->IsEnabled())
+            updateCosts->SetSort((UpdateCostSort) ((updateCosts->GetSort() + 1) % MAX_UPDATE_COST_SORTS));
+    }
+
         // Common rendering quality controls, only when UI has no focused element
     else if (!GetSubsystem<UI>()->GetFocusElement())
     {
@@ -411,3 +554,43 @@ void AIBattleGround::HandleMouseModeChange(StringHash /*eventType*/, VariantMap&
     bool mouseLocked = eventData[MouseModeChanged::P_MOUSELOCKED].GetBool();
     input->SetMouseVisible(!mouseLocked);
 }
+
+void AIBattleGround::HandleEndFrame(StringHash /*eventType*/, VariantMap& eventData)
+{
+    ++numFrames_;
+    simulatedTime_ += GetSubsystem<Time>()->GetTimeStep();
+
+    // The engine measures the next timestep at the end of the frame, so it is overridden only after that
+    if (fixedTimeStep_ > 0.0f)
+        engine_->SetNextTimeStep(fixedTimeStep_);
+
+    const float reportWallTime = reportTimer_.GetUSec(false) / 1000000.0f;
+    if (reportWallTime >= SIMULATION_REPORT_INTERVAL)
+    {
+        ReportSimulationRate(simulatedTime_ - reportedSimulatedTime_, reportWallTime);
+        reportedSimulatedTime_ = simulatedTime_;
+        reportTimer_.Reset();
+    }
+
+    if (maxFrames_ && numFrames_ >= maxFrames_)
+        engine_->Exit();
+}
+
+void AIBattleGround::HandleReplayFinished(StringHash /*eventType*/, VariantMap& eventData)
+{
+    using namespace ReplayFinished;
+
+    // A windowed replay hands over to live input, a headless one has nothing left to do
+    if (IsHeadless())
+    {
+        if (eventData[P_MISMATCHES].GetUInt())
+            exitCode_ = EXIT_FAILURE;
+        engine_->Exit();
+    }
+}
+
+void AIBattleGround::ReportSimulationRate(double simulatedTime, float wallTime)
+{
+    URHO3D_LOGINFOF("Simulated %.1f s in %.1f s wall clock, %.2f simulated seconds per second (%u frames total)",
+        simulatedTime, wallTime, wallTime > 0.0f ? simulatedTime / wallTime : 0.0, numFrames_);
+}
@@ -23,6 +23,7 @@
 #ifndef AIBATTLEGROUND_HPP
 #define AIBATTLEGROUND_HPP
 
+#include <Urho3D/Core/Timer.h>
 #include <Urho3D/Engine/Application.h>
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/UI/Sprite.h>
@@ -35,10 +36,14 @@ const float TOUCH_SENSITIVITY = 2.0f;
 ///    - Create Urho3D logo at screen
 ///    - Set custom window title and icon
 ///    - Create Console and Debug HUD, and use F1 and F2 key to toggle them
+///    - Record a Chrome trace with F3, the console or a frame range given with -trace
+///    - Time the startup phases up to the first frame into a report in the log directory
 ///    - Toggle rendering options from the keys 1-8
 ///    - Take screenshot with key 9
 ///    - Handle Esc key down to hide Console or exit application
 ///    - Init touch input on mobile platform using screen joysticks (patched for each individual sample)
+///    - Run without window and rendering with -headless, stepping at a fixed timestep as fast as possible
+///    - Step at a fixed timestep for reproducible runs recorded with -record and replayed with -replay
 class AIBattleGround : public Urho3D::Application
 {
     // Enable type information.
@@ -56,6 +61,8 @@ public:
     void Stop() override;
 
 protected:
+    /// Return whether running without graphics. Valid after engine initialization.
+    bool IsHeadless() const;
     /// Return XML patch instructions for screen joystick layout for a specific sample app, if any.
     virtual Urho3D::String GetScreenJoystickPatchString() const { return Urho3D::String::EMPTY; }
     /// Initialize touch input on mobile platform.
@@ -99,6 +106,12 @@ private:
     void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     /// Handle touch begin event to initialize touch input on desktop platform.
     void HandleTouchBegin(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    /// Handle end of frame event to fix the next timestep and report the simulation rate.
+    void HandleEndFrame(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    /// Handle replay end event to exit headless replays.
+    void HandleReplayFinished(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    /// Log simulated time against elapsed wall-clock time.
+    void ReportSimulationRate(double simulatedTime, float wallTime);
 
     /// Screen joystick index for navigational controls (mobile platforms only).
     unsigned screenJoystickIndex_;
@@ -106,6 +119,22 @@ private:
     unsigned screenJoystickSettingsIndex_;
     /// Pause flag.
     bool paused_;
+    /// Fixed timestep in seconds, 0 for the engine's variable timestep.
+    float fixedTimeStep_;
+    /// Whether to run without frame limit also with graphics.
+    bool uncapped_;
+    /// Number of frames to run before exiting, 0 for no limit.
+    unsigned maxFrames_;
+    /// Number of frames run.
+    unsigned numFrames_;
+    /// Total simulated time in seconds.
+    double simulatedTime_;
+    /// Simulated time at the last rate report.
+    double reportedSimulatedTime_;
+    /// Wall-clock time since the first frame.
+    Urho3D::HiresTimer wallTimer_;
+    /// Wall-clock time since the last rate report.
+    Urho3D::HiresTimer reportTimer_;
 };
 
 #endif //AIBATTLEGROUND_HPP
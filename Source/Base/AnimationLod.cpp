@@ -0,0 +1,45 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Engine/DebugHud.h>
+
+#include "AnimationLod.hpp"
+
+using namespace Urho3D;
+
+AnimationLod::AnimationLod(Context *context) :
+  Component(context),
+  bucketDistances_{50.0f, 150.0f, 400.0f},
+  bucketIntervals_{2, 4, 8},
+  minScreenSize_(0.01f),
+  numUpdated_(0),
+  numSkipped_(0) {
+}
+
+void AnimationLod::SetBuckets(const std::vector<float> &distances, const std::vector<unsigned> &intervals) {
+    bucketDistances_ = distances;
+    bucketIntervals_ = intervals;
+    bucketIntervals_.resize(bucketDistances_.size(), 1);
+    for (unsigned &interval : bucketIntervals_)
+        interval = Max(interval, 1u);
+}
+
+unsigned AnimationLod::GetInterval(float distance, float screenSize) const {
+    if (!IsEnabledEffective() || bucketIntervals_.empty())
+        return 1;
+    if (screenSize < minScreenSize_)
+        return bucketIntervals_.back();
+
+    unsigned interval = 1;
+    for (unsigned i = 0; i < bucketDistances_.size() && distance >= bucketDistances_[i]; ++i)
+        interval = bucketIntervals_[i];
+    return interval;
+}
+
+void AnimationLod::ReportFrame(unsigned updated, unsigned skipped) {
+    numUpdated_ = updated;
+    numSkipped_ = skipped;
+
+    if (auto *debugHud = GetSubsystem<DebugHud>()) {
+        debugHud->SetAppStats("Skeletons updated", numUpdated_);
+        debugHud->SetAppStats("Skeletons skipped", numSkipped_);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef AIBATTLEGROUND_ANIMATIONLOD_HPP
+#define AIBATTLEGROUND_ANIMATIONLOD_HPP
+
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
+#include <vector>
+
+/// Animation level of detail for crowd agents. Chooses how many frames an agent's animation may go without an update
+/// from its distance to the camera and its projected screen size, using a small set of distance buckets. Updates
+/// inside a bucket are staggered by the crowd so that the skeleton work is spread evenly across frames.
+class AnimationLod : public Urho3D::Component {
+    URHO3D_OBJECT(AnimationLod, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit AnimationLod(Urho3D::Context *context);
+
+    /// Set camera the distances are measured from.
+    void SetCamera(Urho3D::Node *camera) { camera_ = camera; }
+    /// Set distance buckets: agents at or beyond distances[i] update every intervals[i] frames. Distances must be
+    /// increasing; agents closer than the first distance update every frame.
+    void SetBuckets(const std::vector<float> &distances, const std::vector<unsigned> &intervals);
+    /// Set projected size as a fraction of the screen height below which the largest interval is used.
+    void SetMinScreenSize(float size) { minScreenSize_ = size; }
+
+    /// Return camera node.
+    Urho3D::Node *GetCamera() const { return camera_; }
+    /// Return update interval in frames for an agent. Safe to call from worker threads.
+    unsigned GetInterval(float distance, float screenSize) const;
+    /// Return projected size below which the largest interval is used.
+    float GetMinScreenSize() const { return minScreenSize_; }
+
+    /// Record the animation updates of the last frame.
+    void ReportFrame(unsigned updated, unsigned skipped);
+    /// Return number of skeletons updated in the last frame.
+    unsigned GetNumUpdated() const { return numUpdated_; }
+    /// Return number of skeleton updates skipped in the last frame.
+    unsigned GetNumSkipped() const { return numSkipped_; }
+
+ private:
+    /// Camera node.
+    Urho3D::WeakPtr<Urho3D::Node> camera_;
+    /// Bucket start distances.
+    std::vector<float> bucketDistances_;
+    /// Bucket update intervals in frames.
+    std::vector<unsigned> bucketIntervals_;
+    /// Minimum projected screen size.
+    float minScreenSize_;
+    /// Skeletons updated in the last frame.
+    unsigned numUpdated_;
+    /// Skeleton updates skipped in the last frame.
+    unsigned numSkipped_;
+};
+
+#endif //AIBATTLEGROUND_ANIMATIONLOD_HPP
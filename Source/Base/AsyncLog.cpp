@@ -0,0 +1,356 @@
+#include <ctime>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/IO/IOEvents.h>
+
+#include "AsyncLog.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Records queued unless set, about 3 MB.
+const unsigned DEFAULT_CAPACITY = 8192;
+/// File size after which it is renamed, unless set.
+const unsigned DEFAULT_MAX_FILE_SIZE = 16*1024*1024;
+/// Files kept unless set.
+const unsigned DEFAULT_NUM_FILES = 4;
+/// Records of the longest text message, longer text is cut.
+const unsigned MAX_TEXT_RECORDS = 64;
+/// Writer sleep in microseconds while the queue is empty.
+const unsigned IDLE_USEC = 1000;
+
+/// Return the prefix of a log level like the engine log has.
+const char *GetLevelName(int level) {
+    switch (level) {
+    case LOG_DEBUG:
+        return "DEBUG";
+    case LOG_INFO:
+        return "INFO";
+    case LOG_WARNING:
+        return "WARNING";
+    default:
+        return "ERROR";
+    }
+}
+
+/// Append a time stamp like the engine log has.
+void AppendTimeStamp(String &line, long long nsec) {
+    const std::time_t seconds = (std::time_t) (nsec/1000000000);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    char stamp[64];
+    std::strftime(stamp, sizeof(stamp), "[%a %b %d %H:%M:%S %Y] ", &local);
+    line += stamp;
+}
+
+/// Return wall clock time in nanoseconds.
+long long GetWallTime() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+std::atomic<AsyncLog *> AsyncLog::instance_(nullptr);
+std::atomic<unsigned> AsyncLog::numProducers_(0);
+
+unsigned AsyncLog::Record::AddText(const char *text, unsigned length) {
+    const unsigned offset = Min(textLength_, RECORD_TEXT - 1);
+    length = Min(length, RECORD_TEXT - 1 - offset);
+    memcpy(text_ + offset, text, length);
+    text_[offset + length] = '\0';
+    textLength_ = Min(offset + length + 1, RECORD_TEXT - 1);
+    return offset;
+}
+
+AsyncLog::AsyncLog(Context *context) :
+  Object(context),
+  mask_(0),
+  enqueuePosition_(0),
+  dequeuePosition_(0),
+  level_(LOG_DEBUG),
+  numWritten_(0),
+  numDropped_(0),
+  running_(false),
+  file_(nullptr),
+  fileSize_(0),
+  maxFileSize_(DEFAULT_MAX_FILE_SIZE),
+  numFiles_(DEFAULT_NUM_FILES) {
+    SetCapacity(DEFAULT_CAPACITY);
+}
+
+AsyncLog::~AsyncLog() {
+    Close();
+}
+
+bool AsyncLog::Open(const String &fileName) {
+    if (IsOpen())
+        Close();
+
+    file_ = fopen(fileName.CString(), "wb");
+    if (!file_) {
+        URHO3D_LOGERROR("Could not open log " + fileName);
+        return false;
+    }
+    fileName_ = fileName;
+    fileSize_ = 0;
+    if (auto *log = GetSubsystem<Log>())
+        level_.store(log->GetLevel(), std::memory_order_relaxed);
+
+    running_.store(true, std::memory_order_relaxed);
+    writer_ = std::thread(&AsyncLog::WriterLoop, this);
+    instance_.store(this, std::memory_order_release);
+    SubscribeToEvent(E_LOGMESSAGE, URHO3D_HANDLER(AsyncLog, HandleLogMessage));
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(AsyncLog, HandleBeginFrame));
+    return true;
+}
+
+void AsyncLog::Close() {
+    if (!IsOpen())
+        return;
+
+    UnsubscribeFromEvent(E_LOGMESSAGE);
+    UnsubscribeFromEvent(E_BEGINFRAME);
+    AsyncLog *open = this;
+    instance_.compare_exchange_strong(open, nullptr);
+    // Writes that saw the log before it was cleared may still be filling claimed records
+    while (numProducers_.load())
+        std::this_thread::yield();
+
+    // The writer empties the queue before it returns
+    running_.store(false, std::memory_order_release);
+    writer_.join();
+    if (file_)
+        fclose(file_);
+    file_ = nullptr;
+}
+
+void AsyncLog::SetCapacity(unsigned records) {
+    if (IsOpen())
+        return;
+
+    const unsigned capacity = NextPowerOfTwo(Max(records, MAX_TEXT_RECORDS*2));
+    records_.reset(new Record[capacity]);
+    for (unsigned i = 0; i < capacity; ++i)
+        records_[i].sequence_.store(i, std::memory_order_relaxed);
+    mask_ = capacity - 1;
+    enqueuePosition_.store(0, std::memory_order_relaxed);
+    dequeuePosition_ = 0;
+}
+
+AsyncLog::Record *AsyncLog::Claim(unsigned count, unsigned long long &position) {
+    // The writer frees records in order, so the last of a run being free means the whole run is
+    position = enqueuePosition_.load(std::memory_order_relaxed);
+    for (;;) {
+        const unsigned long long last = position + count - 1;
+        const auto difference = (long long) (records_[last & mask_].sequence_.load(std::memory_order_acquire) - last);
+        if (difference == 0) {
+            if (enqueuePosition_.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+                return &records_[position & mask_];
+        } else if (difference < 0) {
+            numDropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else
+            position = enqueuePosition_.load(std::memory_order_relaxed);
+    }
+}
+
+void AsyncLog::Publish(unsigned long long position, unsigned count) {
+    // The first record goes last, the writer then sees the whole message once it sees the first
+    for (unsigned i = count; i-- > 0;)
+        records_[(position + i) & mask_].sequence_.store(position + i + 1, std::memory_order_release);
+}
+
+void AsyncLog::WriteText(int level, const String &text) {
+    const unsigned count = Min((text.Length() + RECORD_TEXT - 1)/RECORD_TEXT, MAX_TEXT_RECORDS);
+    unsigned long long position;
+    Record *record = Claim(Max(count, 1u), position);
+    if (!record)
+        return;
+
+    record->time_ = GetWallTime();
+    record->format_ = nullptr;
+    record->level_ = level;
+    record->numRecords_ = Max(count, 1u);
+    record->numArguments_ = 0;
+    record->textLength_ = Min(text.Length(), count*RECORD_TEXT);
+    for (unsigned i = 0; i < count; ++i) {
+        const unsigned offset = i*RECORD_TEXT;
+        memcpy(records_[(position + i) & mask_].text_, text.CString() + offset,
+               Min(text.Length() - offset, RECORD_TEXT));
+    }
+    Publish(position, record->numRecords_);
+}
+
+void AsyncLog::HandleLogMessage(StringHash eventType, VariantMap &eventData) {
+    using namespace LogMessage;
+
+    // The engine log has already put the time stamp and level in front
+    WriteText(eventData[P_LEVEL].GetInt(), eventData[P_MESSAGE].GetString());
+}
+
+void AsyncLog::HandleBeginFrame(StringHash eventType, VariantMap &eventData) {
+    // The engine applies the configured level after the log is opened
+    if (auto *log = GetSubsystem<Log>())
+        level_.store(log->GetLevel(), std::memory_order_relaxed);
+}
+
+void AsyncLog::WriterLoop() {
+    const unsigned long long capacity = mask_ + 1;
+    unsigned long long reportedDropped = 0;
+    String line;
+
+    for (;;) {
+        // Read before the queue is looked at, so that whatever was published before Close cleared the flag is seen
+        const bool running = running_.load(std::memory_order_acquire);
+        Record &record = records_[dequeuePosition_ & mask_];
+        line.Clear();
+        if (record.sequence_.load(std::memory_order_acquire) != dequeuePosition_ + 1) {
+            // The drops are reported once the queue has room again
+            const unsigned long long numDropped = numDropped_.load(std::memory_order_relaxed);
+            if (numDropped != reportedDropped) {
+                AppendTimeStamp(line, GetWallTime());
+                line += "WARNING: " + String(numDropped - reportedDropped) + " log messages dropped on a full queue\n";
+                reportedDropped = numDropped;
+            }
+        } else {
+            Format(dequeuePosition_, line);
+            const unsigned count = record.numRecords_;
+            for (unsigned i = 0; i < count; ++i) {
+                const unsigned long long position = dequeuePosition_ + i;
+                records_[position & mask_].sequence_.store(position + capacity, std::memory_order_release);
+            }
+            dequeuePosition_ += count;
+            numWritten_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (!line.Empty() && file_) {
+            fileSize_ += fwrite(line.CString(), 1, line.Length(), file_);
+            if (fileSize_ >= maxFileSize_)
+                Rotate();
+            continue;
+        }
+        if (file_)
+            fflush(file_);
+        // The queue was empty after closing began, and the log is no longer open to producers
+        if (!running)
+            break;
+        std::this_thread::sleep_for(std::chrono::microseconds(IDLE_USEC));
+    }
+}
+
+void AsyncLog::Format(unsigned long long position, String &line) const {
+    const Record &record = records_[position & mask_];
+    if (!record.format_) {
+        for (unsigned offset = 0, i = 0; offset < record.textLength_; offset += RECORD_TEXT, ++i)
+            line.Append(records_[(position + i) & mask_].text_, Min(record.textLength_ - offset, RECORD_TEXT));
+        line += '\n';
+        return;
+    }
+
+    AppendTimeStamp(line, record.time_);
+    line += GetLevelName(record.level_);
+    line += ": ";
+
+    // Every conversion is formatted on its own, with the length modifier of the stored argument
+    char spec[32];
+    char formatted[512];
+    unsigned argumentIndex = 0;
+    for (const char *c = record.format_; *c;) {
+        if (*c != '%') {
+            line += *c++;
+            continue;
+        }
+        if (c[1] == '%') {
+            line += '%';
+            c += 2;
+            continue;
+        }
+
+        const char *begin = c++;
+        while (*c && strchr("-+ #0123456789.", *c))
+            ++c;
+        const auto flagsLength = Min((unsigned) (c - begin), (unsigned) sizeof(spec) - 4);
+        while (*c && strchr("hlLqjzt", *c))
+            ++c;
+        const char conversion = *c;
+        if (conversion)
+            ++c;
+        if (argumentIndex >= record.numArguments_) {
+            line.Append(begin, (unsigned) (c - begin));
+            continue;
+        }
+
+        memcpy(spec, begin, flagsLength);
+        char *end = spec + flagsLength;
+        const Argument &argument = record.arguments_[argumentIndex++];
+        switch (argument.type_) {
+        case LA_INT:
+        case LA_UINT:
+            if (conversion && strchr("eEfFgGaA", conversion)) {
+                *end++ = conversion;
+                *end = '\0';
+                snprintf(formatted, sizeof(formatted), spec, (double) argument.int_);
+            } else if (conversion == 'c') {
+                *end++ = 'c';
+                *end = '\0';
+                snprintf(formatted, sizeof(formatted), spec, (int) argument.int_);
+            } else {
+                const bool isSigned = conversion == 'd' || conversion == 'i'
+                                      || (!strchr("ouxX", conversion) && argument.type_ == LA_INT);
+                *end++ = 'l';
+                *end++ = 'l';
+                *end++ = isSigned ? 'd' : (conversion && strchr("ouxX", conversion) ? conversion : 'u');
+                *end = '\0';
+                auto value = (unsigned long long) argument.int_;
+                if (!isSigned && argument.size_ < sizeof(value))
+                    value &= (1ull << argument.size_*8) - 1;
+                if (isSigned)
+                    snprintf(formatted, sizeof(formatted), spec, (long long) value);
+                else
+                    snprintf(formatted, sizeof(formatted), spec, value);
+            }
+            break;
+        case LA_FLOAT:
+            *end++ = conversion && strchr("eEfFgGaA", conversion) ? conversion : 'g';
+            *end = '\0';
+            snprintf(formatted, sizeof(formatted), spec, argument.float_);
+            break;
+        case LA_POINTER:
+            *end++ = 'p';
+            *end = '\0';
+            snprintf(formatted, sizeof(formatted), spec, argument.pointer_);
+            break;
+        case LA_TEXT:
+            *end++ = 's';
+            *end = '\0';
+            snprintf(formatted, sizeof(formatted), spec, record.text_ + argument.text_);
+            break;
+        }
+        line += formatted;
+    }
+    line += '\n';
+}
+
+void AsyncLog::Rotate() {
+    fclose(file_);
+
+    // <name>.log becomes <name>.1.log, the oldest is removed
+    const String base = fileName_.EndsWith(".log") ? fileName_.Substring(0, fileName_.Length() - 4) : fileName_;
+    for (unsigned i = numFiles_ - 1; i > 0; --i) {
+        const String from = i > 1 ? base + "." + String(i - 1) + ".log" : fileName_;
+        const String to = base + "." + String(i) + ".log";
+        remove(to.CString());
+        rename(from.CString(), to.CString());
+    }
+    if (numFiles_ == 1)
+        remove(fileName_.CString());
+
+    file_ = fopen(fileName_.CString(), "wb");
+    fileSize_ = 0;
+}
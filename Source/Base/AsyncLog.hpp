@@ -0,0 +1,224 @@
+#ifndef AIBATTLEGROUND_ASYNCLOG_HPP
+#define AIBATTLEGROUND_ASYNCLOG_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/IO/Log.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+/// Log from any thread into the AsyncLog file, formatted later by its writer thread. The format must be a string
+/// literal and takes up to 8 arguments: integers, floating point numbers, pointers, C strings and Strings.
+#define AIBG_LOGDEBUGF(...) AsyncLog::Write(Urho3D::LOG_DEBUG, __VA_ARGS__)
+#define AIBG_LOGINFOF(...) AsyncLog::Write(Urho3D::LOG_INFO, __VA_ARGS__)
+#define AIBG_LOGWARNINGF(...) AsyncLog::Write(Urho3D::LOG_WARNING, __VA_ARGS__)
+#define AIBG_LOGERRORF(...) AsyncLog::Write(Urho3D::LOG_ERROR, __VA_ARGS__)
+
+/// Log file written by a background thread, so that no frame waits on the disk. Messages go into a fixed-size ring of
+/// records that any number of threads fill without locks; a message that does not fit is dropped and counted, and the
+/// count is written to the file once there is room again. The engine log messages arrive as text through the log
+/// message event, while AIBG_LOG*F messages keep their format and arguments and are only formatted by the writer, which
+/// makes them cheap enough for hot paths on any thread. The file is renamed to <name>.1.log and so on once it grows over
+/// the size limit. Register as a subsystem, open the file and leave EP_LOG_NAME empty so that the engine log does not
+/// write the file as well.
+class AsyncLog : public Urho3D::Object {
+    URHO3D_OBJECT(AsyncLog, Urho3D::Object);
+
+ public:
+    /// Construct.
+    explicit AsyncLog(Urho3D::Context *context);
+    /// Destruct. Writes the queued messages and closes the file.
+    ~AsyncLog() override;
+
+    /// Open the file and start the writer thread. Return true on success.
+    bool Open(const Urho3D::String &fileName);
+    /// Wait for the messages being queued, write the queued messages, stop the writer thread and close the file.
+    void Close();
+    /// Set number of queued records. Rounded up to a power of two, only before opening.
+    void SetCapacity(unsigned records);
+    /// Set size in bytes after which the file is renamed and a new one begun.
+    void SetMaxFileSize(unsigned bytes) { maxFileSize_ = bytes; }
+    /// Set number of files kept, the current one included.
+    void SetNumFiles(unsigned files) { numFiles_ = Urho3D::Max(files, 1u); }
+
+    /// Return whether open.
+    bool IsOpen() const { return writer_.joinable(); }
+    /// Return file name.
+    const Urho3D::String &GetFileName() const { return fileName_; }
+    /// Return number of messages written.
+    unsigned long long GetNumWritten() const { return numWritten_.load(std::memory_order_relaxed); }
+    /// Return number of messages dropped on a full queue.
+    unsigned long long GetNumDropped() const { return numDropped_.load(std::memory_order_relaxed); }
+
+    /// Queue a message with deferred formatting, from any thread. Dropped when no log is open or below the log level.
+    template <class... Args> static void Write(int level, const char *format, const Args &... args);
+
+ private:
+    /// Type of a deferred argument.
+    enum ArgumentType : unsigned char {
+        LA_INT = 0,
+        LA_UINT,
+        LA_FLOAT,
+        LA_POINTER,
+        LA_TEXT
+    };
+
+    /// Deferred argument. Text is copied into the record.
+    struct Argument {
+        union {
+            long long int_;
+            double float_;
+            const void *pointer_;
+            unsigned text_;
+        };
+        ArgumentType type_;
+        /// Size of an integer in bytes.
+        unsigned char size_;
+    };
+
+    /// Maximum deferred arguments.
+    static const unsigned MAX_ARGUMENTS = 8;
+    /// Text bytes in a record.
+    static const unsigned RECORD_TEXT = 192;
+
+    /// Queued message. Longer text continues in the records that follow.
+    struct Record {
+        /// Queue position this record is free for, or one past the position it was written at.
+        std::atomic<unsigned long long> sequence_;
+        /// Wall clock time in nanoseconds.
+        long long time_;
+        /// Format of a deferred message, null for text.
+        const char *format_;
+        int level_;
+        /// Records of the message, this one included.
+        unsigned numRecords_;
+        unsigned numArguments_;
+        /// Text bytes used.
+        unsigned textLength_;
+        Argument arguments_[MAX_ARGUMENTS];
+        char text_[RECORD_TEXT];
+
+        /// Add an argument.
+        template <class T> void Add(const T &value);
+        /// Copy text, truncated to the room left. Return its offset.
+        unsigned AddText(const char *text, unsigned length);
+    };
+
+    /// Counts a Write call from before it looks up the open log until it has published.
+    struct ProducerScope {
+        ProducerScope() { numProducers_.fetch_add(1); }
+        ~ProducerScope() { numProducers_.fetch_sub(1, std::memory_order_release); }
+    };
+
+    /// Claim consecutive records of the queue. Return the first, or null when full.
+    Record *Claim(unsigned count, unsigned long long &position);
+    /// Hand claimed records to the writer.
+    void Publish(unsigned long long position, unsigned count);
+    /// Queue text of the engine log.
+    void WriteText(int level, const Urho3D::String &text);
+    /// Handle a message of the engine log.
+    void HandleLogMessage(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the frame begin event.
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Write the queue to the file until closed. Runs on the writer thread.
+    void WriterLoop();
+    /// Append the text of a message starting at a queue position. Runs on the writer thread.
+    void Format(unsigned long long position, Urho3D::String &line) const;
+    /// Rename the files and begin a new one. Runs on the writer thread.
+    void Rotate();
+
+    /// Open log, null when none.
+    static std::atomic<AsyncLog *> instance_;
+    /// Write calls in flight. Close waits for them after clearing the open log, they may have seen it still set.
+    static std::atomic<unsigned> numProducers_;
+
+    /// Ring of records.
+    std::unique_ptr<Record[]> records_;
+    /// Position mask of the ring.
+    unsigned long long mask_;
+    /// Next position to claim.
+    alignas(64) std::atomic<unsigned long long> enqueuePosition_;
+    /// Next position to write, writer thread only.
+    alignas(64) unsigned long long dequeuePosition_;
+    /// Lowest level queued, follows the engine log.
+    std::atomic<int> level_;
+    /// Messages written.
+    std::atomic<unsigned long long> numWritten_;
+    /// Messages dropped on a full queue.
+    std::atomic<unsigned long long> numDropped_;
+    /// Whether the writer thread keeps running.
+    std::atomic<bool> running_;
+    /// Writer thread.
+    std::thread writer_;
+    /// File, writer thread only.
+    FILE *file_;
+    /// Bytes in the file.
+    unsigned long long fileSize_;
+    /// File name.
+    Urho3D::String fileName_;
+    /// Size after which the file is renamed.
+    unsigned maxFileSize_;
+    /// Files kept.
+    unsigned numFiles_;
+};
+
+template <class T> void AsyncLog::Record::Add(const T &value) {
+    Argument &argument = arguments_[numArguments_++];
+    if constexpr (std::is_same<T, bool>::value) {
+        argument.type_ = LA_INT;
+        argument.int_ = value ? 1 : 0;
+        argument.size_ = sizeof(int);
+    } else if constexpr (std::is_enum<T>::value) {
+        argument.type_ = LA_INT;
+        argument.int_ = (long long) value;
+        argument.size_ = sizeof(T);
+    } else if constexpr (std::is_integral<T>::value) {
+        argument.type_ = std::is_signed<T>::value ? LA_INT : LA_UINT;
+        argument.int_ = (long long) value;
+        argument.size_ = sizeof(T);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        argument.type_ = LA_FLOAT;
+        argument.float_ = value;
+    } else if constexpr (std::is_same<T, Urho3D::String>::value) {
+        argument.type_ = LA_TEXT;
+        argument.text_ = AddText(value.CString(), value.Length());
+    } else if constexpr (std::is_convertible<T, const char *>::value) {
+        const char *text = value;
+        argument.type_ = LA_TEXT;
+        argument.text_ = text ? AddText(text, (unsigned) std::strlen(text)) : AddText("(null)", 6);
+    } else {
+        static_assert(std::is_pointer<T>::value, "Unsupported log argument");
+        argument.type_ = LA_POINTER;
+        argument.pointer_ = value;
+    }
+}
+
+template <class... Args> void AsyncLog::Write(int level, const char *format, const Args &... args) {
+    static_assert(sizeof...(Args) <= MAX_ARGUMENTS, "Too many log arguments");
+
+    // Sequentially consistent with Close, which clears the log before it reads the count
+    ProducerScope producer;
+    AsyncLog *log = instance_.load();
+    if (!log || level < log->level_.load(std::memory_order_relaxed))
+        return;
+    unsigned long long position;
+    Record *record = log->Claim(1, position);
+    if (!record)
+        return;
+
+    record->time_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record->format_ = format;
+    record->level_ = level;
+    record->numRecords_ = 1;
+    record->numArguments_ = 0;
+    record->textLength_ = 0;
+    (record->Add(args), ...);
+    log->Publish(position, 1);
+}
+
+#endif //AIBATTLEGROUND_ASYNCLOG_HPP
@@ -0,0 +1,119 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "ContactBuffer.hpp"
+
+using namespace Urho3D;
+
+ContactBuffer::ContactBuffer(Context *context) :
+  Component(context),
+  collisionMask_(M_MAX_UNSIGNED),
+  dirty_(true) {
+}
+
+ContactBuffer::~ContactBuffer() = default;
+
+void ContactBuffer::SetCollisionMask(unsigned mask) {
+    collisionMask_ = mask;
+    dirty_ = true;
+}
+
+const std::vector<ContactRecord> &ContactBuffer::GetContacts() {
+    Gather();
+    return contacts_;
+}
+
+unsigned ContactBuffer::GetContacts(RigidBody *body, std::vector<ContactRecord> &dest) {
+    Gather();
+    unsigned count = 0;
+    for (const ContactRecord &contact : contacts_) {
+        if (contact.bodyA_ == body || contact.bodyB_ == body) {
+            dest.push_back(contact);
+            ++count;
+        }
+    }
+    return count;
+}
+
+unsigned ContactBuffer::GetContacts(unsigned layerMask, std::vector<ContactRecord> &dest) {
+    Gather();
+    unsigned count = 0;
+    for (const ContactRecord &contact : contacts_) {
+        if ((contact.bodyA_->GetCollisionLayer() | contact.bodyB_->GetCollisionLayer()) & layerMask) {
+            dest.push_back(contact);
+            ++count;
+        }
+    }
+    return count;
+}
+
+void ContactBuffer::OnSceneSet(Scene *scene) {
+    contacts_.clear();
+    dirty_ = true;
+    if (scene)
+        SubscribeToEvent(E_PHYSICSPOSTSTEP, URHO3D_HANDLER(ContactBuffer, HandlePhysicsPostStep));
+    else
+        UnsubscribeFromEvent(E_PHYSICSPOSTSTEP);
+}
+
+void ContactBuffer::HandlePhysicsPostStep(StringHash eventType, VariantMap &eventData) {
+    using namespace PhysicsPostStep;
+
+    // Only marks the buffer, the manifolds are read when someone asks
+    auto *world = static_cast<PhysicsWorld *>(eventData[P_WORLD].GetPtr());
+    if (world && world->GetScene() == GetScene())
+        dirty_ = true;
+}
+
+void ContactBuffer::Gather() {
+    if (!dirty_)
+        return;
+    dirty_ = false;
+    contacts_.clear();
+
+    auto *physicsWorld = GetScene() ? GetScene()->GetComponent<PhysicsWorld>() : nullptr;
+    if (!physicsWorld || !IsEnabledEffective())
+        return;
+
+    btDispatcher *dispatcher = physicsWorld->GetWorld()->getDispatcher();
+    const int numManifolds = dispatcher->getNumManifolds();
+    for (int i = 0; i < numManifolds; ++i) {
+        btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(i);
+        const int numPoints = manifold->getNumContacts();
+        if (!numPoints)
+            continue;
+
+        // The layers are read from the broadphase proxies, so pairs outside the mask never touch the components
+        const btCollisionObject *objectA = manifold->getBody0();
+        const btCollisionObject *objectB = manifold->getBody1();
+        const btBroadphaseProxy *proxyA = objectA->getBroadphaseHandle();
+        const btBroadphaseProxy *proxyB = objectB->getBroadphaseHandle();
+        if (!proxyA || !proxyB)
+            continue;
+        if (!(((unsigned) proxyA->m_collisionFilterGroup | (unsigned) proxyB->m_collisionFilterGroup) & collisionMask_))
+            continue;
+
+        auto *bodyA = static_cast<RigidBody *>(objectA->getUserPointer());
+        auto *bodyB = static_cast<RigidBody *>(objectB->getUserPointer());
+        if (!bodyA || !bodyB)
+            continue;
+
+        ContactRecord contact{bodyA, bodyB, Vector3::ZERO, Vector3::UP, 0.0f};
+        float largestImpulse = -1.0f;
+        for (int j = 0; j < numPoints; ++j) {
+            const btManifoldPoint &point = manifold->getContactPoint(j);
+            const float impulse = point.getAppliedImpulse();
+            contact.impulse_ += impulse;
+            if (impulse > largestImpulse) {
+                largestImpulse = impulse;
+                contact.position_ = ToVector3(point.m_positionWorldOnB);
+                contact.normal_ = ToVector3(point.m_normalWorldOnB);
+            }
+        }
+        contacts_.push_back(contact);
+    }
+}
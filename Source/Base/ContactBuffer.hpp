@@ -0,0 +1,67 @@
+#ifndef AIBATTLEGROUND_CONTACTBUFFER_HPP
+#define AIBATTLEGROUND_CONTACTBUFFER_HPP
+
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Component.h>
+#include <vector>
+
+/// Contact between two bodies in the last physics step.
+struct ContactRecord {
+    /// First body.
+    Urho3D::RigidBody *bodyA_;
+    /// Second body.
+    Urho3D::RigidBody *bodyB_;
+    /// World position of the contact point with the largest impulse, on the second body.
+    Urho3D::Vector3 position_;
+    /// World normal of that point, pointing from the second body to the first.
+    Urho3D::Vector3 normal_;
+    /// Impulse applied over all the contact points of the pair.
+    float impulse_;
+};
+
+/// Contacts of the last physics step in a flat, reused buffer, as a replacement for the per-pair node collision events,
+/// which build VariantMaps for every touching pair on every step whether anyone listens or not. Bodies should use
+/// COLLISION_NEVER so that the physics world skips those events. The buffer is filled from the persistent contact
+/// manifolds of the physics world on the first query after a step, keeping only pairs where at least one body's
+/// collision layer is in the mask, so a step without queries costs nothing. The records are valid until the next step.
+class ContactBuffer : public Urho3D::Component {
+    URHO3D_OBJECT(ContactBuffer, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit ContactBuffer(Urho3D::Context *context);
+    /// Destruct.
+    ~ContactBuffer() override;
+
+    /// Set collision layer mask of the pairs recorded.
+    void SetCollisionMask(unsigned mask);
+
+    /// Return collision layer mask of the pairs recorded.
+    unsigned GetCollisionMask() const { return collisionMask_; }
+    /// Return contacts of the last physics step.
+    const std::vector<ContactRecord> &GetContacts();
+    /// Collect contacts of the last physics step that involve a body. Return number of contacts added.
+    unsigned GetContacts(Urho3D::RigidBody *body, std::vector<ContactRecord> &dest);
+    /// Collect contacts of the last physics step where either body's collision layer is in a mask. Return number of
+    /// contacts added.
+    unsigned GetContacts(unsigned layerMask, std::vector<ContactRecord> &dest);
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// Handle the physics post-step event.
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Fill the buffer from the contact manifolds if it is older than the last step.
+    void Gather();
+
+    /// Contacts of the last step.
+    std::vector<ContactRecord> contacts_;
+    /// Collision layer mask of the pairs recorded.
+    unsigned collisionMask_;
+    /// Whether a step has run since the buffer was filled.
+    bool dirty_;
+};
+
+#endif //AIBATTLEGROUND_CONTACTBUFFER_HPP
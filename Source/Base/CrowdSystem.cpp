@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <cmath>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "AnimationLod.hpp"
+#include "CrowdSystem.hpp"
+#include "FlowField.hpp"
+#include "FrameTimings.hpp"
+#include "PoseCache.hpp"
+#include "TraceRecorder.hpp"
+#include "UpdateCosts.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+template <class T> void SwapRemove(std::vector<T> &values, unsigned index) {
+    if (index + 1 < values.size())
+        values[index] = values.back();
+    values.pop_back();
+}
+
+}
+
+CrowdSystem::CrowdSystem(Context *context) :
+  Component(context),
+  grid_(BoundingBox(-1000.0f, 1000.0f), 20.0f),
+  chunkSize_(256),
+  arrivalRadius_(20.0f),
+  flow_(nullptr),
+  lod_(nullptr),
+  lodTanHalfFov_(1.0f),
+  frameNumber_(0) {
+}
+
+CrowdSystem::~CrowdSystem() = default;
+
+unsigned CrowdSystem::AddAgent(Node *node, float moveSpeed, float rotationSpeed, const BoundingBox &bounds) {
+    unsigned handle;
+    if (!freeHandles_.empty()) {
+        handle = freeHandles_.back();
+        freeHandles_.pop_back();
+    } else {
+        handle = (unsigned) denseIndices_.size();
+        denseIndices_.push_back(M_MAX_UNSIGNED);
+    }
+
+    const auto index = (unsigned) nodes_.size();
+    const Vector3 &pos = node->GetPosition();
+    posX_.push_back(pos.x_);
+    posY_.push_back(pos.y_);
+    posZ_.push_back(pos.z_);
+    height_.push_back(M_INFINITY);
+    yaw_.push_back(node->GetRotation().YawAngle());
+    dirX_.push_back(0.0f);
+    dirZ_.push_back(1.0f);
+    moveSpeed_.push_back(moveSpeed);
+    rotationSpeed_.push_back(rotationSpeed);
+    minX_.push_back(bounds.min_.x_);
+    maxX_.push_back(bounds.max_.x_);
+    minZ_.push_back(bounds.min_.z_);
+    maxZ_.push_back(bounds.max_.z_);
+    goal_.push_back(M_MAX_UNSIGNED);
+    targetX_.push_back(M_INFINITY);
+    targetZ_.push_back(0.0f);
+    radius_.push_back(node->GetWorldScale().y_);
+    animationTime_.push_back(0.0f);
+    lodInterval_.push_back(1);
+    appliedInterval_.push_back(1);
+    poseClip_.push_back(M_MAX_UNSIGNED);
+    poseBucket_.push_back(0);
+    poseBones_.emplace_back();
+    turned_.push_back(0);
+    nodes_.emplace_back(node);
+
+    // Resolve the animation state once instead of searching the node hierarchy every frame
+    AnimationState *state = nullptr;
+    auto *model = node->GetComponent<AnimatedModel>(true);
+    if (model && model->GetNumAnimationStates())
+        state = model->GetAnimationStates()[0];
+    animationStates_.emplace_back(state);
+
+    handles_.push_back(handle);
+    denseIndices_[handle] = index;
+    UpdateDirection(index);
+    grid_.Update(handle, pos.x_, pos.z_);
+    return handle;
+}
+
+void CrowdSystem::RemoveAgent(unsigned handle) {
+    if (!HasAgent(handle))
+        return;
+
+    const unsigned index = denseIndices_[handle];
+    const unsigned movedHandle = handles_.back();
+
+    SwapRemove(posX_, index);
+    SwapRemove(posY_, index);
+    SwapRemove(posZ_, index);
+    SwapRemove(height_, index);
+    SwapRemove(yaw_, index);
+    SwapRemove(dirX_, index);
+    SwapRemove(dirZ_, index);
+    SwapRemove(moveSpeed_, index);
+    SwapRemove(rotationSpeed_, index);
+    SwapRemove(minX_, index);
+    SwapRemove(maxX_, index);
+    SwapRemove(minZ_, index);
+    SwapRemove(maxZ_, index);
+    SwapRemove(goal_, index);
+    SwapRemove(targetX_, index);
+    SwapRemove(targetZ_, index);
+    SwapRemove(radius_, index);
+    SwapRemove(animationTime_, index);
+    SwapRemove(lodInterval_, index);
+    SwapRemove(appliedInterval_, index);
+    SwapRemove(poseClip_, index);
+    SwapRemove(poseBucket_, index);
+    SwapRemove(poseBones_, index);
+    SwapRemove(turned_, index);
+    SwapRemove(nodes_, index);
+    SwapRemove(animationStates_, index);
+    SwapRemove(handles_, index);
+
+    if (movedHandle != handle)
+        denseIndices_[movedHandle] = index;
+    denseIndices_[handle] = M_MAX_UNSIGNED;
+    freeHandles_.push_back(handle);
+    grid_.Remove(handle);
+}
+
+void CrowdSystem::SetAgentParameters(unsigned handle, float moveSpeed, float rotationSpeed, const BoundingBox &bounds) {
+    if (!HasAgent(handle))
+        return;
+
+    const unsigned index = denseIndices_[handle];
+    moveSpeed_[index] = moveSpeed;
+    rotationSpeed_[index] = rotationSpeed;
+    minX_[index] = bounds.min_.x_;
+    maxX_[index] = bounds.max_.x_;
+    minZ_[index] = bounds.min_.z_;
+    maxZ_[index] = bounds.max_.z_;
+}
+
+void CrowdSystem::SetAgentHeight(unsigned handle, float height) {
+    if (HasAgent(handle))
+        height_[denseIndices_[handle]] = height;
+}
+
+void CrowdSystem::SetAgentGoal(unsigned handle, unsigned goal) {
+    if (HasAgent(handle))
+        goal_[denseIndices_[handle]] = goal;
+}
+
+void CrowdSystem::SetAgentTarget(unsigned handle, const Vector3 &target) {
+    if (!HasAgent(handle))
+        return;
+
+    const unsigned index = denseIndices_[handle];
+    targetX_[index] = target.x_;
+    targetZ_[index] = target.z_;
+}
+
+void CrowdSystem::ClearAgentTarget(unsigned handle) {
+    if (HasAgent(handle))
+        targetX_[denseIndices_[handle]] = M_INFINITY;
+}
+
+bool CrowdSystem::HasAgent(unsigned handle) const {
+    return handle < denseIndices_.size() && denseIndices_[handle] != M_MAX_UNSIGNED;
+}
+
+Node *CrowdSystem::GetAgentNode(unsigned handle) const {
+    return HasAgent(handle) ? nodes_[denseIndices_[handle]].Get() : nullptr;
+}
+
+Vector3 CrowdSystem::GetAgentPosition(unsigned handle) const {
+    if (!HasAgent(handle))
+        return Vector3::ZERO;
+
+    const unsigned index = denseIndices_[handle];
+    return Vector3(posX_[index], posY_[index], posZ_[index]);
+}
+
+void CrowdSystem::OnSceneSet(Scene *scene) {
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(CrowdSystem, HandleSceneUpdate));
+    else
+        UnsubscribeFromEvent(E_SCENEUPDATE);
+}
+
+void CrowdSystem::HandleSceneUpdate(StringHash eventType, VariantMap &eventData) {
+    using namespace SceneUpdate;
+
+    if (nodes_.empty())
+        return;
+    AIBG_PROFILE(CrowdUpdate);
+    AIBG_UPDATE_COST();
+
+    HiresTimer timer;
+    const float timeStep = eventData[P_TIMESTEP].GetFloat();
+    const auto count = (unsigned) nodes_.size();
+    auto *queue = GetSubsystem<WorkQueue>();
+    const unsigned numThreads = queue ? queue->GetNumThreads() + 1 : 1;
+    const unsigned numChunks = Min(numThreads, (count + chunkSize_ - 1)/chunkSize_);
+
+    flow_ = GetScene()->GetComponent<FlowField>();
+    if (flow_ && (!flow_->IsEnabledEffective() || !flow_->GetNumGoals()))
+        flow_ = nullptr;
+
+    lod_ = GetScene()->GetComponent<AnimationLod>();
+    Node *cameraNode = lod_ ? lod_->GetCamera() : nullptr;
+    auto *camera = cameraNode ? cameraNode->GetComponent<Camera>() : nullptr;
+    if (camera) {
+        lodCameraPosition_ = cameraNode->GetWorldPosition();
+        lodTanHalfFov_ = Tan(camera->GetFov()*0.5f);
+    } else
+        lod_ = nullptr;
+
+    if (numChunks <= 1) {
+        Gather(0, count);
+        Integrate(0, count, timeStep);
+        Steer(0, count, timeStep);
+        UpdateAnimationLod(0, count);
+    } else {
+        // Every agent only touches its own slots in the buffers, so the chunks run without synchronization
+        const unsigned agentsPerChunk = (count + numChunks - 1)/numChunks;
+        chunks_.clear();
+        for (unsigned begin = 0; begin < count; begin += agentsPerChunk)
+            chunks_.push_back(Chunk{this, begin, Min(begin + agentsPerChunk, count), timeStep});
+
+        for (Chunk &chunk : chunks_) {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = UpdateChunkWork;
+            item->aux_ = &chunk;
+            queue->AddWorkItem(item);
+        }
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+
+    Commit(timeStep);
+
+    if (auto *timings = GetSubsystem<FrameTimings>())
+        timings->AddTime(FS_AGENTS, timer.GetUSec(false));
+}
+
+void CrowdSystem::UpdateChunkWork(const WorkItem *item, unsigned threadIndex) {
+    const auto *chunk = static_cast<const Chunk *>(item->aux_);
+    chunk->crowd_->Gather(chunk->begin_, chunk->end_);
+    chunk->crowd_->Integrate(chunk->begin_, chunk->end_, chunk->timeStep_);
+    chunk->crowd_->Steer(chunk->begin_, chunk->end_, chunk->timeStep_);
+    chunk->crowd_->UpdateAnimationLod(chunk->begin_, chunk->end_);
+}
+
+void CrowdSystem::Gather(unsigned begin, unsigned end) {
+    // Physics moves the bodies between frames, so positions are read back once before integrating
+    for (unsigned i = begin; i < end; ++i) {
+        if (Node *node = nodes_[i]) {
+            const Vector3 &pos = node->GetPosition();
+            posX_[i] = pos.x_;
+            posY_[i] = pos.y_;
+            posZ_[i] = pos.z_;
+        }
+    }
+}
+
+void CrowdSystem::Integrate(unsigned begin, unsigned end, float timeStep) {
+    float *posX = posX_.data();
+    float *posY = posY_.data();
+    float *posZ = posZ_.data();
+    const float *height = height_.data();
+    const float *dirX = dirX_.data();
+    const float *dirZ = dirZ_.data();
+    const float *moveSpeed = moveSpeed_.data();
+    const float *minX = minX_.data();
+    const float *maxX = maxX_.data();
+    const float *minZ = minZ_.data();
+    const float *maxZ = maxZ_.data();
+    unsigned char *turned = turned_.data();
+
+    // Branch-free pass over all agents so the compiler can vectorize it
+    for (unsigned i = begin; i < end; ++i) {
+        const float step = moveSpeed[i]*timeStep;
+        const float x = posX[i] + dirX[i]*step;
+        const float z = posZ[i] + dirZ[i]*step;
+        const unsigned char outside = (unsigned char) ((x < minX[i]) | (x > maxX[i]) | (z < minZ[i]) | (z > maxZ[i]));
+        posX[i] = x;
+        posZ[i] = z;
+        posY[i] = height[i] < M_INFINITY ? height[i] : posY[i];
+        turned[i] = outside;
+    }
+}
+
+void CrowdSystem::Steer(unsigned begin, unsigned end, float timeStep) {
+    const float arrivalRadiusSquared = arrivalRadius_*arrivalRadius_;
+
+    for (unsigned i = begin; i < end; ++i) {
+        const float maxTurn = rotationSpeed_[i]*timeStep;
+        unsigned goal = goal_[i];
+
+        if (targetX_[i] < M_INFINITY) {
+            const float dx = targetX_[i] - posX_[i];
+            const float dz = targetZ_[i] - posZ_[i];
+            if (dx*dx + dz*dz > M_EPSILON) {
+                turned_[i] = (unsigned char) TurnTowards(i, dx, dz, maxTurn);
+                continue;
+            }
+        }
+
+        if (flow_ && goal != M_MAX_UNSIGNED) {
+            // Move on to the next shared goal once this one is reached
+            const Vector3 &goalPosition = flow_->GetGoalPosition(goal%flow_->GetNumGoals());
+            const float dx = goalPosition.x_ - posX_[i];
+            const float dz = goalPosition.z_ - posZ_[i];
+            if (dx*dx + dz*dz < arrivalRadiusSquared) {
+                goal = (goal + 1)%flow_->GetNumGoals();
+                goal_[i] = goal;
+            }
+
+            float flowX;
+            float flowZ;
+            if (flow_->GetDirection(goal%flow_->GetNumGoals(), posX_[i], posZ_[i], flowX, flowZ)) {
+                turned_[i] = (unsigned char) TurnTowards(i, flowX, flowZ, maxTurn);
+                continue;
+            }
+        }
+
+        // If in risk of going outside the bounds, rotate the agent right
+        if (turned_[i]) {
+            yaw_[i] += maxTurn;
+            UpdateDirection(i);
+        }
+    }
+}
+
+void CrowdSystem::UpdateAnimationLod(unsigned begin, unsigned end) {
+    if (!lod_) {
+        std::fill(lodInterval_.begin() + begin, lodInterval_.begin() + end, 1);
+        return;
+    }
+
+    for (unsigned i = begin; i < end; ++i) {
+        const float dx = posX_[i] - lodCameraPosition_.x_;
+        const float dy = posY_[i] - lodCameraPosition_.y_;
+        const float dz = posZ_[i] - lodCameraPosition_.z_;
+        const float distance = Max(std::sqrt(dx*dx + dy*dy + dz*dz), M_EPSILON);
+        const float screenSize = radius_[i]/(distance*lodTanHalfFov_);
+        lodInterval_[i] = (unsigned char) Min(lod_->GetInterval(distance, screenSize), 255u);
+    }
+}
+
+void CrowdSystem::Commit(float timeStep) {
+    unsigned updated = 0;
+    unsigned skipped = 0;
+    auto *poseCache = GetScene()->GetComponent<PoseCache>();
+    if (poseCache && !poseCache->IsEnabledEffective())
+        poseCache = nullptr;
+    // Advanced here rather than from its own scene update handler, so that the times applied below are never a frame
+    // behind whichever handler happens to run first
+    if (poseCache)
+        poseCache->Update(timeStep);
+
+    for (unsigned i = 0; i < nodes_.size(); ++i) {
+        Node *node = nodes_[i];
+        if (!node)
+            continue;
+
+        const Vector3 position(posX_[i], posY_[i], posZ_[i]);
+        if (turned_[i])
+            node->SetTransform(position, Quaternion(0.0f, yaw_[i], 0.0f));
+        else
+            node->SetPosition(position);
+        grid_.Update(handles_[i], posX_[i], posZ_[i]);
+
+        AnimationState *state = animationStates_[i];
+        if (!state)
+            continue;
+
+        if (poseCache) {
+            // Copy the shared pose of the agent's clip bucket, the bucket is chosen once from the agent's own time
+            bool assigned = false;
+            if (poseClip_[i] == M_MAX_UNSIGNED && state->GetAnimation()) {
+                poseClip_[i] = poseCache->GetClipIndex(state->GetAnimation());
+                poseBucket_[i] = poseCache->GetBucket(poseClip_[i], state->GetTime());
+                poseCache->GetBoneNodes(poseClip_[i], state->GetModel(), poseBones_[i]);
+                assigned = true;
+            }
+            if (poseClip_[i] != M_MAX_UNSIGNED
+                && (assigned || poseCache->IsBucketChanged(poseClip_[i], poseBucket_[i]))) {
+                poseCache->ApplyPose(poseClip_[i], poseBucket_[i], state->GetModel(), poseBones_[i]);
+                ++updated;
+            } else
+                ++skipped;
+            continue;
+        }
+
+        // Lower the model's skinning frequency together with the animation update rate
+        const unsigned interval = lodInterval_[i];
+        if (interval != appliedInterval_[i]) {
+            state->GetModel()->SetAnimationLodBias(1.0f/interval);
+            appliedInterval_[i] = (unsigned char) interval;
+        }
+
+        // Throttled agents catch up with the accumulated time on their turn, the handle staggers the turns
+        animationTime_[i] += timeStep;
+        if ((frameNumber_ + handles_[i])%interval == 0) {
+            state->AddTime(animationTime_[i]);
+            animationTime_[i] = 0.0f;
+            ++updated;
+        } else
+            ++skipped;
+    }
+
+    ++frameNumber_;
+    if (lod_)
+        lod_->ReportFrame(updated, skipped);
+}
+
+bool CrowdSystem::TurnTowards(unsigned index, float dirX, float dirZ, float maxTurn) {
+    // Shortest signed angle to the direction, limited by the rotation speed
+    float delta = Atan2(dirX, dirZ) - yaw_[index];
+    delta -= 360.0f*std::floor((delta + 180.0f)/360.0f);
+    delta = Clamp(delta, -maxTurn, maxTurn);
+    if (delta == 0.0f)
+        return false;
+
+    yaw_[index] += delta;
+    UpdateDirection(index);
+    return true;
+}
+
+void CrowdSystem::UpdateDirection(unsigned index) {
+    yaw_[index] = std::fmod(yaw_[index], 360.0f);
+    dirX_[index] = Sin(yaw_[index]);
+    dirZ_[index] = Cos(yaw_[index]);
+}
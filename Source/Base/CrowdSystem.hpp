@@ -0,0 +1,184 @@
+#ifndef AIBATTLEGROUND_CROWDSYSTEM_HPP
+#define AIBATTLEGROUND_CROWDSYSTEM_HPP
+
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/AnimationState.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
+#include <vector>
+
+#include "SpatialGrid.hpp"
+
+class AnimationLod;
+class FlowField;
+class PoseCache;
+
+/// Data-oriented crowd mover. Agent position, yaw, speed and bounds are kept in contiguous structure-of-arrays
+/// buffers, advanced for all agents in one pass per scene update and written back to the scene nodes once per frame.
+/// Large populations are split into chunks that run on the WorkQueue worker threads; the scene graph is only written
+/// from the main thread in the commit phase. When the scene has an AnimationLod component, animation updates of distant
+/// agents are throttled and staggered according to its buckets. When it has an enabled PoseCache, agents get the
+/// shared pose of their clip bucket instead. Agent positions are mirrored into a uniform grid for neighbourhood
+/// queries, which return agent handles. Agents with a target point steer straight towards it. Agents with a goal
+/// steer along the scene's FlowField and move on to the next shared goal when they arrive; agents without one wander
+/// and turn at their bounds.
+class CrowdSystem : public Urho3D::Component {
+    URHO3D_OBJECT(CrowdSystem, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit CrowdSystem(Urho3D::Context *context);
+    /// Destruct.
+    ~CrowdSystem() override;
+
+    /// Add an agent moving the given node. Return a stable agent handle.
+    unsigned AddAgent(Urho3D::Node *node, float moveSpeed, float rotationSpeed, const Urho3D::BoundingBox &bounds);
+    /// Remove an agent by handle.
+    void RemoveAgent(unsigned handle);
+    /// Set motion parameters of an existing agent.
+    void SetAgentParameters(unsigned handle, float moveSpeed, float rotationSpeed, const Urho3D::BoundingBox &bounds);
+    /// Keep an agent at a fixed height, or M_INFINITY to leave the height to physics.
+    void SetAgentHeight(unsigned handle, float height);
+    /// Set the shared FlowField goal an agent steers towards, or M_MAX_UNSIGNED to wander.
+    void SetAgentGoal(unsigned handle, unsigned goal);
+    /// Steer an agent straight towards a point, ahead of its goal. Used to follow waypoints.
+    void SetAgentTarget(unsigned handle, const Urho3D::Vector3 &target);
+    /// Stop steering an agent towards a point.
+    void ClearAgentTarget(unsigned handle);
+    /// Set distance at which an agent counts as arrived at its goal.
+    void SetArrivalRadius(float radius) { arrivalRadius_ = radius; }
+    /// Set minimum number of agents per worker thread chunk.
+    void SetChunkSize(unsigned size) { chunkSize_ = size ? size : 1; }
+
+    /// Return whether the handle refers to a live agent.
+    bool HasAgent(unsigned handle) const;
+    /// Return number of agents.
+    unsigned GetNumAgents() const { return (unsigned) nodes_.size(); }
+    /// Return minimum number of agents per worker thread chunk.
+    unsigned GetChunkSize() const { return chunkSize_; }
+    /// Return scene node of an agent.
+    Urho3D::Node *GetAgentNode(unsigned handle) const;
+    /// Return position of an agent as of the last update.
+    Urho3D::Vector3 GetAgentPosition(unsigned handle) const;
+
+    /// Append handles of agents within radius of a point on the XZ plane.
+    void QueryRadius(const Urho3D::Vector3 &center, float radius, Urho3D::PODVector<unsigned> &result) const {
+        grid_.QueryRadius(center.x_, center.z_, radius, result);
+    }
+    /// Append handles of the k nearest agents to a point on the XZ plane, nearest first.
+    void QueryNearest(const Urho3D::Vector3 &center, unsigned k, Urho3D::PODVector<unsigned> &result) const {
+        grid_.QueryNearest(center.x_, center.z_, k, result);
+    }
+    /// Append handles of agents inside the XZ extent of a box.
+    void QueryBox(const Urho3D::BoundingBox &box, Urho3D::PODVector<unsigned> &result) const {
+        grid_.QueryBox(box, result);
+    }
+    /// Return the agent spatial index.
+    const SpatialGrid &GetSpatialGrid() const { return grid_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// Handle the scene update event.
+    void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Read back positions that physics may have changed since the last frame. Only reads the scene graph.
+    void Gather(unsigned begin, unsigned end);
+    /// Advance a range of agents in the structure-of-arrays buffers.
+    void Integrate(unsigned begin, unsigned end, float timeStep);
+    /// Turn a range of agents towards their goals or away from their bounds.
+    void Steer(unsigned begin, unsigned end, float timeStep);
+    /// Choose the animation update interval of a range of agents.
+    void UpdateAnimationLod(unsigned begin, unsigned end);
+    /// Write agent transforms to the scene nodes and advance animations.
+    void Commit(float timeStep);
+    /// Turn one agent towards a direction, limited by the turn angle. Return whether the agent turned.
+    bool TurnTowards(unsigned index, float dirX, float dirZ, float maxTurn);
+    /// Recalculate the forward direction of one agent from its yaw.
+    void UpdateDirection(unsigned index);
+
+    /// Work item function advancing one chunk of agents.
+    static void UpdateChunkWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+
+    /// Range of agents processed by one work item.
+    struct Chunk {
+        CrowdSystem *crowd_;
+        unsigned begin_;
+        unsigned end_;
+        float timeStep_;
+    };
+
+    /// Agent world position.
+    std::vector<float> posX_;
+    std::vector<float> posY_;
+    std::vector<float> posZ_;
+    /// Fixed agent height, M_INFINITY when the height follows physics.
+    std::vector<float> height_;
+    /// Agent yaw in degrees.
+    std::vector<float> yaw_;
+    /// Agent forward direction, cached from yaw.
+    std::vector<float> dirX_;
+    std::vector<float> dirZ_;
+    /// Forward movement speed.
+    std::vector<float> moveSpeed_;
+    /// Rotation speed.
+    std::vector<float> rotationSpeed_;
+    /// Movement boundaries on the XZ plane.
+    std::vector<float> minX_;
+    std::vector<float> maxX_;
+    std::vector<float> minZ_;
+    std::vector<float> maxZ_;
+    /// Flow field goal, M_MAX_UNSIGNED when wandering.
+    std::vector<unsigned> goal_;
+    /// Point steered towards ahead of the goal, M_INFINITY in X when none.
+    std::vector<float> targetX_;
+    std::vector<float> targetZ_;
+    /// Approximate agent radius used for the projected screen size.
+    std::vector<float> radius_;
+    /// Animation time accumulated since the agent's last animation update.
+    std::vector<float> animationTime_;
+    /// Animation update interval in frames chosen this frame.
+    std::vector<unsigned char> lodInterval_;
+    /// Animation update interval the model's skinning LOD bias was last set for.
+    std::vector<unsigned char> appliedInterval_;
+    /// Pose cache clip index, M_MAX_UNSIGNED until assigned.
+    std::vector<unsigned> poseClip_;
+    /// Pose cache phase bucket.
+    std::vector<unsigned> poseBucket_;
+    /// Bone nodes of the agent's model in the track order of its pose cache clip.
+    std::vector<std::vector<Urho3D::Node *>> poseBones_;
+    /// Nonzero when the agent turned this frame and its rotation has to be written back.
+    std::vector<unsigned char> turned_;
+    /// Scene node driven by the agent.
+    std::vector<Urho3D::WeakPtr<Urho3D::Node>> nodes_;
+    /// First animation state of the agent's animated model, if any.
+    std::vector<Urho3D::SharedPtr<Urho3D::AnimationState>> animationStates_;
+    /// Dense index to handle.
+    std::vector<unsigned> handles_;
+    /// Handle to dense index, M_MAX_UNSIGNED for free handles.
+    std::vector<unsigned> denseIndices_;
+    /// Released handles available for reuse.
+    std::vector<unsigned> freeHandles_;
+    /// Agent spatial index keyed by handle.
+    SpatialGrid grid_;
+    /// Chunks of the current update, referenced by the work items.
+    std::vector<Chunk> chunks_;
+    /// Minimum number of agents per chunk.
+    unsigned chunkSize_;
+    /// Arrival distance.
+    float arrivalRadius_;
+    /// Flow field of the current update, null when not available.
+    FlowField *flow_;
+    /// Animation LOD of the current update, null when disabled.
+    AnimationLod *lod_;
+    /// Camera position of the current update.
+    Urho3D::Vector3 lodCameraPosition_;
+    /// Tangent of half the vertical field of view of the current update.
+    float lodTanHalfFov_;
+    /// Frame counter used to stagger throttled animation updates.
+    unsigned frameNumber_;
+};
+
+#endif //AIBATTLEGROUND_CROWDSYSTEM_HPP
@@ -0,0 +1,430 @@
+#include <vector>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "DeltaAutosave.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Autosave file identifier.
+const char *AUTOSAVE_FILE_ID = "AIBD";
+/// Autosave format version.
+const unsigned AUTOSAVE_VERSION = 1;
+/// Chunk with the whole scene.
+const char *BASELINE_CHUNK_ID = "BASE";
+/// Chunk with the changes since the previous chunk.
+const char *DELTA_CHUNK_ID = "DLTA";
+/// Chunk type and size.
+const unsigned CHUNK_HEADER_SIZE = 8;
+/// Moved node flag: rigid body velocities follow the transform.
+const unsigned char DELTA_HAS_BODY = 1;
+
+}
+
+DeltaAutosave::DeltaAutosave(Context *context) :
+  Component(context),
+  interval_(5.0f),
+  maxDeltas_(60),
+  elapsed_(0.0f),
+  started_(false),
+  numDeltas_(0),
+  lastCheckpointUSec_(0) {
+    // The autosave is not part of the scene it saves
+    SetTemporary(true);
+}
+
+DeltaAutosave::~DeltaAutosave() {
+    WaitBaseline();
+}
+
+bool DeltaAutosave::Start(const String &fileName) {
+    Scene *scene = GetScene();
+    if (!scene)
+        return false;
+
+    Stop();
+    fileName_ = fileName;
+    if (!WriteBaseline())
+        return false;
+
+    started_ = true;
+    for (const SharedPtr<Node> &node : scene->GetChildren())
+        Track(node);
+    return true;
+}
+
+void DeltaAutosave::Stop() {
+    WaitBaseline();
+    if (Scene *scene = GetScene()) {
+        for (const SharedPtr<Node> &node : scene->GetChildren())
+            node->RemoveListener(this);
+    }
+    file_.Reset();
+    started_ = false;
+    dirty_.clear();
+    added_.clear();
+    removed_.clear();
+    elapsed_ = 0.0f;
+}
+
+void DeltaAutosave::Checkpoint() {
+    Scene *scene = GetScene();
+    if (!started_ || !scene)
+        return;
+
+    elapsed_ = 0.0f;
+    if (numDeltas_ >= maxDeltas_ && !baselineJob_) {
+        // Start over so that a restore does not have to replay an ever longer chain
+        if (!WriteBaseline())
+            Stop();
+        return;
+    }
+
+    HiresTimer timer;
+    std::vector<Node *> added;
+    std::vector<Node *> moved;
+    for (unsigned id : added_) {
+        if (Node *node = scene->GetNode(id))
+            added.push_back(node);
+    }
+    for (unsigned id : dirty_) {
+        if (!added_.count(id)) {
+            if (Node *node = scene->GetNode(id))
+                moved.push_back(node);
+        }
+    }
+
+    chunk_.Clear();
+    chunk_.WriteUInt(numDeltas_);
+    chunk_.WriteVLE((unsigned) removed_.size());
+    for (unsigned id : removed_)
+        chunk_.WriteUInt(id);
+
+    // Created nodes are saved whole, they are not in the baseline
+    chunk_.WriteVLE((unsigned) added.size());
+    for (Node *node : added) {
+        chunk_.WriteUInt(node->GetID());
+        node->Save(chunk_);
+    }
+
+    chunk_.WriteVLE((unsigned) moved.size());
+    for (Node *node : moved) {
+        auto *body = node->GetComponent<RigidBody>();
+        chunk_.WriteUInt(node->GetID());
+        chunk_.WriteUByte(body ? DELTA_HAS_BODY : (unsigned char) 0);
+        chunk_.WriteVector3(node->GetPosition());
+        chunk_.WriteQuaternion(node->GetRotation());
+        chunk_.WriteVector3(node->GetScale());
+        if (body) {
+            chunk_.WriteVector3(body->GetLinearVelocity());
+            chunk_.WriteVector3(body->GetAngularVelocity());
+        }
+    }
+
+    WriteChunk(DELTA_CHUNK_ID, chunk_);
+    ++numDeltas_;
+
+    // A node only notifies its listeners when it goes from clean to dirty, clean the saved ones so that their next
+    // change is seen. Without a renderer nothing else would
+    for (Node *node : added)
+        node->GetWorldTransform();
+    for (Node *node : moved)
+        node->GetWorldTransform();
+    dirty_.clear();
+    added_.clear();
+    removed_.clear();
+    lastCheckpointUSec_ = timer.GetUSec(false);
+
+    if (auto *debugHud = GetSubsystem<DebugHud>()) {
+        debugHud->SetAppStats("Autosave delta nodes", (unsigned) (added.size() + moved.size()));
+        debugHud->SetAppStats("Autosave delta us", (unsigned) lastCheckpointUSec_);
+    }
+}
+
+bool DeltaAutosave::Restore(Scene *scene, const String &fileName) {
+    // A baseline still being written is finished first, so that the chain read here is complete
+    if (auto *autosave = scene->GetComponent<DeltaAutosave>())
+        autosave->Stop();
+
+    HiresTimer timer;
+    File file(scene->GetContext(), fileName, FILE_READ);
+    if (!file.IsOpen() || file.ReadFileID() != AUTOSAVE_FILE_ID || file.ReadUInt() != AUTOSAVE_VERSION) {
+        URHO3D_LOGERROR("Could not read autosave " + fileName);
+        return false;
+    }
+
+    bool hasBaseline = false;
+    unsigned numDeltas = 0;
+    PODVector<unsigned char> data;
+    while (file.GetSize() - file.GetPosition() >= CHUNK_HEADER_SIZE) {
+        const String id = file.ReadFileID();
+        const unsigned size = file.ReadUInt();
+        if (size > file.GetSize() - file.GetPosition()) {
+            // Interrupted while appending, the chain up to the previous chunk is still valid
+            URHO3D_LOGWARNING("Autosave " + fileName + " ends with an incomplete chunk");
+            break;
+        }
+
+        data.Resize(size);
+        file.Read(data.Buffer(), size);
+        MemoryBuffer buffer(data);
+        if (id == BASELINE_CHUNK_ID) {
+            if (!scene->Load(buffer)) {
+                URHO3D_LOGERROR("Could not load autosave baseline " + fileName);
+                return false;
+            }
+            hasBaseline = true;
+        } else if (id == DELTA_CHUNK_ID && hasBaseline) {
+            ApplyDelta(scene, buffer);
+            ++numDeltas;
+        }
+    }
+
+    if (!hasBaseline) {
+        URHO3D_LOGERROR("Autosave " + fileName + " has no baseline");
+        return false;
+    }
+    URHO3D_LOGINFOF("Restored autosave with %u deltas in %.1f ms", numDeltas, (float) timer.GetUSec(false)/1000.0f);
+    return true;
+}
+
+void DeltaAutosave::OnSceneSet(Scene *scene) {
+    if (scene) {
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(DeltaAutosave, HandleScenePostUpdate));
+        SubscribeToEvent(scene, E_NODEADDED, URHO3D_HANDLER(DeltaAutosave, HandleNodeAdded));
+        SubscribeToEvent(scene, E_NODEREMOVED, URHO3D_HANDLER(DeltaAutosave, HandleNodeRemoved));
+    } else {
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+        UnsubscribeFromEvent(E_NODEADDED);
+        UnsubscribeFromEvent(E_NODEREMOVED);
+        Stop();
+    }
+}
+
+void DeltaAutosave::OnMarkedDirty(Node *node) {
+    if (started_)
+        dirty_.insert(node->GetID());
+}
+
+void DeltaAutosave::HandleScenePostUpdate(StringHash eventType, VariantMap &eventData) {
+    using namespace ScenePostUpdate;
+
+    if (!started_)
+        return;
+    if (baselineJob_ && baselineJob_->item_->completed_ && !FinishBaseline()) {
+        Stop();
+        return;
+    }
+    if (!IsEnabledEffective())
+        return;
+
+    elapsed_ += eventData[P_TIMESTEP].GetFloat();
+    if (elapsed_ >= interval_)
+        Checkpoint();
+}
+
+void DeltaAutosave::HandleNodeAdded(StringHash eventType, VariantMap &eventData) {
+    using namespace NodeAdded;
+
+    if (!started_ || eventData[P_PARENT].GetPtr() != GetScene())
+        return;
+
+    // Saved at the next checkpoint, the components are created after the node is added
+    auto *node = static_cast<Node *>(eventData[P_NODE].GetPtr());
+    if (!node->IsTemporary()) {
+        added_.insert(node->GetID());
+        Track(node);
+    }
+}
+
+void DeltaAutosave::HandleNodeRemoved(StringHash eventType, VariantMap &eventData) {
+    using namespace NodeRemoved;
+
+    if (!started_ || eventData[P_PARENT].GetPtr() != GetScene())
+        return;
+
+    auto *node = static_cast<Node *>(eventData[P_NODE].GetPtr());
+    const unsigned id = node->GetID();
+    dirty_.erase(id);
+    // A node created and destroyed between two checkpoints never reaches the file
+    if (!added_.erase(id))
+        removed_.insert(id);
+}
+
+bool DeltaAutosave::WriteBaseline() {
+    Scene *scene = GetScene();
+    HiresTimer timer;
+
+    // The capture is the only part that has to see a consistent scene, the file is written on a worker thread
+    std::unique_ptr<BaselineJob> job(new BaselineJob());
+    job->data_.WriteFileID(AUTOSAVE_FILE_ID);
+    job->data_.WriteUInt(AUTOSAVE_VERSION);
+    job->data_.WriteFileID(BASELINE_CHUNK_ID);
+    job->data_.WriteUInt(0);
+    const unsigned chunkStart = job->data_.GetPosition();
+    if (!scene->Save(job->data_)) {
+        URHO3D_LOGERROR("Could not capture scene for autosave " + fileName_);
+        return false;
+    }
+    // The chunk size goes in front of the captured scene
+    const unsigned chunkSize = job->data_.GetSize() - chunkStart;
+    job->data_.Seek(chunkStart - 4);
+    job->data_.WriteUInt(chunkSize);
+
+    job->context_ = context_;
+    job->tempName_ = fileName_ + ".tmp";
+    job->success_ = false;
+    job->mainUSec_ = timer.GetUSec(false);
+    job->workUSec_ = 0;
+    // Not taken from the pool so that the item keeps its completed flag after the queue purges it
+    job->item_ = new WorkItem();
+    job->item_->priority_ = 0;
+    job->item_->workFunction_ = BaselineWork;
+    job->item_->aux_ = job.get();
+
+    // The previous file is closed, the deltas that follow wait for the new one in memory
+    file_.Reset();
+    pendingDeltas_.Clear();
+    baselineJob_ = std::move(job);
+    GetSubsystem<WorkQueue>()->AddWorkItem(baselineJob_->item_);
+
+    // Everything up to now is in the baseline
+    for (const SharedPtr<Node> &node : scene->GetChildren())
+        node->GetWorldTransform();
+    dirty_.clear();
+    added_.clear();
+    removed_.clear();
+    numDeltas_ = 0;
+    lastCheckpointUSec_ = timer.GetUSec(false);
+    return true;
+}
+
+void DeltaAutosave::BaselineWork(const WorkItem *item, unsigned threadIndex) {
+    BaselineJob &job = *static_cast<BaselineJob *>(item->aux_);
+    HiresTimer timer;
+
+    // Written to a temporary file first so that the previous chain stays restorable until the new one is complete
+    File file(job.context_, job.tempName_, FILE_WRITE);
+    job.success_ = file.IsOpen() && file.Write(job.data_.GetData(), job.data_.GetSize()) == job.data_.GetSize();
+    job.workUSec_ = timer.GetUSec(false);
+}
+
+bool DeltaAutosave::FinishBaseline() {
+    std::unique_ptr<BaselineJob> job(std::move(baselineJob_));
+    auto *fileSystem = GetSubsystem<FileSystem>();
+
+    bool success = job->success_;
+    if (success) {
+        fileSystem->Delete(fileName_);
+        success = fileSystem->Rename(job->tempName_, fileName_);
+    }
+    if (success) {
+        // Reopened for appending the deltas
+        file_ = new File(context_, fileName_, FILE_READWRITE);
+        success = file_->IsOpen();
+    }
+    if (!success) {
+        fileSystem->Delete(job->tempName_);
+        URHO3D_LOGERROR("Could not write autosave " + fileName_);
+        file_.Reset();
+        pendingDeltas_.Clear();
+        return false;
+    }
+
+    file_->Seek(file_->GetSize());
+    if (pendingDeltas_.GetSize()) {
+        file_->Write(pendingDeltas_.GetData(), pendingDeltas_.GetSize());
+        file_->Flush();
+    }
+    URHO3D_LOGINFOF("Autosave baseline: %.1f ms capture on the main thread, %.1f ms write on a worker thread, "
+                    "%u bytes", (float) job->mainUSec_/1000.0f, (float) job->workUSec_/1000.0f,
+                    job->data_.GetSize());
+    pendingDeltas_.Clear();
+    return true;
+}
+
+void DeltaAutosave::WaitBaseline() {
+    if (!baselineJob_)
+        return;
+
+    // The worker thread holds a pointer to the job. One that has not started yet is written right here
+    auto *workQueue = GetSubsystem<WorkQueue>();
+    const SharedPtr<WorkItem> item = baselineJob_->item_;
+    if (!item->completed_) {
+        if (workQueue->RemoveWorkItem(item))
+            BaselineWork(item, 0);
+        else
+            workQueue->Complete(0);
+    }
+    FinishBaseline();
+}
+
+void DeltaAutosave::Track(Node *node) {
+    if (!node->IsTemporary())
+        node->AddListener(this);
+}
+
+void DeltaAutosave::WriteChunk(const char *id, const VectorBuffer &data) {
+    // While a baseline is being written the deltas are kept in memory, they go after it
+    Serializer *dest = baselineJob_ ? static_cast<Serializer *>(&pendingDeltas_)
+                                    : static_cast<Serializer *>(file_.Get());
+    dest->WriteFileID(id);
+    dest->WriteUInt(data.GetSize());
+    dest->Write(data.GetData(), data.GetSize());
+    if (!baselineJob_)
+        file_->Flush();
+}
+
+void DeltaAutosave::ApplyDelta(Scene *scene, Deserializer &source) {
+    source.ReadUInt();
+
+    const unsigned numRemoved = source.ReadVLE();
+    for (unsigned i = 0; i < numRemoved; ++i) {
+        if (Node *node = scene->GetNode(source.ReadUInt()))
+            node->Remove();
+    }
+
+    const unsigned numAdded = source.ReadVLE();
+    for (unsigned i = 0; i < numAdded; ++i) {
+        const unsigned id = source.ReadUInt();
+        if (Node *existing = scene->GetNode(id))
+            existing->Remove();
+        Node *node = scene->CreateChild(String::EMPTY, id < FIRST_LOCAL_ID ? REPLICATED : LOCAL, id);
+        node->Load(source);
+    }
+
+    const unsigned numMoved = source.ReadVLE();
+    for (unsigned i = 0; i < numMoved; ++i) {
+        const unsigned id = source.ReadUInt();
+        const unsigned char flags = source.ReadUByte();
+        const Vector3 position = source.ReadVector3();
+        const Quaternion rotation = source.ReadQuaternion();
+        const Vector3 scale = source.ReadVector3();
+        Vector3 linearVelocity;
+        Vector3 angularVelocity;
+        if (flags & DELTA_HAS_BODY) {
+            linearVelocity = source.ReadVector3();
+            angularVelocity = source.ReadVector3();
+        }
+
+        Node *node = scene->GetNode(id);
+        if (!node)
+            continue;
+        node->SetTransform(position, rotation, scale);
+        if (flags & DELTA_HAS_BODY) {
+            if (auto *body = node->GetComponent<RigidBody>()) {
+                body->SetLinearVelocity(linearVelocity);
+                body->SetAngularVelocity(angularVelocity);
+            }
+        }
+    }
+}
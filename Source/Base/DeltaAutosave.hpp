@@ -0,0 +1,125 @@
+#ifndef AIBATTLEGROUND_DELTAAUTOSAVE_HPP
+#define AIBATTLEGROUND_DELTAAUTOSAVE_HPP
+
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Scene/Component.h>
+#include <memory>
+#include <unordered_set>
+
+/// Periodic autosave that writes only what changed. Starting writes a baseline of the whole scene, after that every
+/// checkpoint appends a delta with the transforms and rigid body velocities of the top-level nodes that moved, plus the
+/// nodes created and destroyed since the previous checkpoint. Moved nodes are found through the node dirty flags, so
+/// static nodes such as the terrain and the props cost nothing. The file is a sequence of chunks, each with a type and
+/// a size, and is only ever appended to until the delta chain gets long enough to start over with a new baseline. The
+/// baseline is captured into memory on the main thread and written by a worker thread; deltas taken meanwhile wait in
+/// memory until it is on disk. Component state other than the transforms is only saved in the baseline and with
+/// created nodes.
+class DeltaAutosave : public Urho3D::Component {
+    URHO3D_OBJECT(DeltaAutosave, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit DeltaAutosave(Urho3D::Context *context);
+    /// Destruct. Waits for a baseline being written.
+    ~DeltaAutosave() override;
+
+    /// Set time between checkpoints in seconds.
+    void SetInterval(float interval) { interval_ = Urho3D::Max(interval, 0.0f); }
+    /// Set number of deltas after which a new baseline is written.
+    void SetMaxDeltas(unsigned count) { maxDeltas_ = Urho3D::Max(count, 1u); }
+    /// Capture the baseline, queue it for writing and start tracking changes. Return false if the scene could not be
+    /// captured; a file that cannot be written is logged and stops the autosave later.
+    bool Start(const Urho3D::String &fileName);
+    /// Finish writing a pending baseline, stop tracking changes and close the file.
+    void Stop();
+    /// Append a delta with the changes since the previous checkpoint.
+    void Checkpoint();
+    /// Load the baseline of an autosave into a scene and replay its delta chain. Replaces the scene content, including
+    /// this component when it is in the scene.
+    static bool Restore(Urho3D::Scene *scene, const Urho3D::String &fileName);
+
+    /// Return time between checkpoints in seconds.
+    float GetInterval() const { return interval_; }
+    /// Return number of deltas after which a new baseline is written.
+    unsigned GetMaxDeltas() const { return maxDeltas_; }
+    /// Return whether tracking changes.
+    bool IsStarted() const { return started_; }
+    /// Return number of deltas written since the baseline.
+    unsigned GetNumDeltas() const { return numDeltas_; }
+    /// Return main thread time of the last checkpoint in microseconds.
+    long long GetLastCheckpointTime() const { return lastCheckpointUSec_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+    /// Handle a tracked node being marked dirty.
+    void OnMarkedDirty(Urho3D::Node *node) override;
+
+ private:
+    /// Handle the scene post-update event.
+    void HandleScenePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle a node being added to the scene.
+    void HandleNodeAdded(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle a node being removed from the scene.
+    void HandleNodeRemoved(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Capture the baseline and queue the new file for writing. Return false if the scene could not be captured.
+    bool WriteBaseline();
+    /// Work item function writing a baseline to the temporary file.
+    static void BaselineWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+    /// Replace the file with a written baseline and append the deltas taken meanwhile. Return false on failure.
+    bool FinishBaseline();
+    /// Wait for a baseline being written and finish it.
+    void WaitBaseline();
+    /// Start tracking a top-level node.
+    void Track(Urho3D::Node *node);
+    /// Append a chunk to the file.
+    void WriteChunk(const char *id, const Urho3D::VectorBuffer &data);
+    /// Apply a delta chunk to a scene.
+    static void ApplyDelta(Urho3D::Scene *scene, Urho3D::Deserializer &source);
+
+    /// File work of a baseline.
+    struct BaselineJob {
+        Urho3D::Context *context_;
+        Urho3D::String tempName_;
+        /// File header and baseline chunk.
+        Urho3D::VectorBuffer data_;
+        bool success_;
+        /// Main thread and worker thread time.
+        long long mainUSec_;
+        long long workUSec_;
+        Urho3D::SharedPtr<Urho3D::WorkItem> item_;
+    };
+
+    /// Time between checkpoints.
+    float interval_;
+    /// Number of deltas after which a new baseline is written.
+    unsigned maxDeltas_;
+    /// Time since the last checkpoint.
+    float elapsed_;
+    /// Autosave file name.
+    Urho3D::String fileName_;
+    /// Whether tracking changes.
+    bool started_;
+    /// Autosave file, null when not started or while a baseline is being written.
+    Urho3D::SharedPtr<Urho3D::File> file_;
+    /// Baseline being written, null when none.
+    std::unique_ptr<BaselineJob> baselineJob_;
+    /// Delta chunks taken while the baseline is being written.
+    Urho3D::VectorBuffer pendingDeltas_;
+    /// Number of deltas written since the baseline.
+    unsigned numDeltas_;
+    /// Ids of the nodes that moved since the last checkpoint.
+    std::unordered_set<unsigned> dirty_;
+    /// Ids of the nodes created since the last checkpoint.
+    std::unordered_set<unsigned> added_;
+    /// Ids of the nodes destroyed since the last checkpoint.
+    std::unordered_set<unsigned> removed_;
+    /// Chunk being written.
+    Urho3D::VectorBuffer chunk_;
+    /// Main thread time of the last checkpoint.
+    long long lastCheckpointUSec_;
+};
+
+#endif //AIBATTLEGROUND_DELTAAUTOSAVE_HPP
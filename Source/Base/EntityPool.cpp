@@ -0,0 +1,151 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "EntityPool.hpp"
+#include "TraceRecorder.hpp"
+
+using namespace Urho3D;
+
+EntityPool::EntityPool(Context *context) :
+  Component(context),
+  bounds_(Vector3(-M_LARGE_VALUE, -M_LARGE_VALUE, -M_LARGE_VALUE), Vector3(M_LARGE_VALUE, M_LARGE_VALUE, M_LARGE_VALUE)),
+  nextSerial_(0),
+  numRecycled_(0) {
+}
+
+EntityPool::~EntityPool() = default;
+
+unsigned EntityPool::CreatePool(const String &name, unsigned capacity, const BuildFunction &build) {
+    Scene *scene = GetScene();
+    if (!scene)
+        return M_MAX_UNSIGNED;
+
+    Pool pool;
+    pool.name_ = name;
+    pool.lifetime_ = 0.0f;
+    pool.despawnWhenSleeping_ = false;
+    pool.slots_.reserve(capacity);
+    pool.free_.reserve(capacity);
+    for (unsigned i = 0; i < capacity; ++i) {
+        // Built enabled like any other entity, then switched off until spawned. Not saved with the scene, the pools are
+        // created again after a load
+        Node *node = scene->CreateChild(name, LOCAL);
+        node->SetTemporary(true);
+        build(node);
+        node->SetDeepEnabled(false);
+        pool.slots_.push_back(Slot{SharedPtr<Node>(node), 0.0f, 0, false});
+        pool.free_.push_back(capacity - 1 - i);
+    }
+
+    pools_.push_back(std::move(pool));
+    return (unsigned) pools_.size() - 1;
+}
+
+void EntityPool::SetLifetime(unsigned pool, float lifetime) {
+    if (pool < pools_.size())
+        pools_[pool].lifetime_ = Max(lifetime, 0.0f);
+}
+
+void EntityPool::SetDespawnWhenSleeping(unsigned pool, bool enable) {
+    if (pool < pools_.size())
+        pools_[pool].despawnWhenSleeping_ = enable;
+}
+
+Node *EntityPool::Spawn(unsigned pool, const Vector3 &position, const Quaternion &rotation) {
+    if (pool >= pools_.size() || pools_[pool].slots_.empty())
+        return nullptr;
+    AIBG_PROFILE(PoolSpawn);
+
+    Pool &entities = pools_[pool];
+    unsigned index;
+    if (!entities.free_.empty()) {
+        index = entities.free_.back();
+        entities.free_.pop_back();
+    } else {
+        // The cap is reached, the oldest entity makes way
+        index = 0;
+        for (unsigned i = 1; i < entities.slots_.size(); ++i) {
+            if (entities.slots_[i].serial_ < entities.slots_[index].serial_)
+                index = i;
+        }
+        ++numRecycled_;
+    }
+
+    Slot &slot = entities.slots_[index];
+    slot.age_ = 0.0f;
+    slot.serial_ = nextSerial_++;
+    slot.active_ = true;
+
+    // The transform is set before enabling so that the components are switched on where the entity appears
+    Node *node = slot.node_;
+    node->SetTransform(position, rotation);
+    if (auto *body = node->GetComponent<RigidBody>()) {
+        body->SetLinearVelocity(Vector3::ZERO);
+        body->SetAngularVelocity(Vector3::ZERO);
+        body->ResetForces();
+    }
+    node->SetDeepEnabled(true);
+    return node;
+}
+
+void EntityPool::Despawn(Node *node) {
+    for (Pool &pool : pools_) {
+        for (unsigned i = 0; i < pool.slots_.size(); ++i) {
+            if (pool.slots_[i].node_ == node) {
+                if (pool.slots_[i].active_)
+                    Deactivate(pool, i);
+                return;
+            }
+        }
+    }
+}
+
+unsigned EntityPool::GetNumActive(unsigned pool) const {
+    return pool < pools_.size() ? (unsigned) (pools_[pool].slots_.size() - pools_[pool].free_.size()) : 0;
+}
+
+void EntityPool::OnSceneSet(Scene *scene) {
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(EntityPool, HandleScenePostUpdate));
+    else
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+}
+
+void EntityPool::HandleScenePostUpdate(StringHash eventType, VariantMap &eventData) {
+    using namespace ScenePostUpdate;
+
+    const float timeStep = eventData[P_TIMESTEP].GetFloat();
+    unsigned numActive = 0;
+    for (Pool &pool : pools_) {
+        for (unsigned i = 0; i < pool.slots_.size(); ++i) {
+            Slot &slot = pool.slots_[i];
+            if (!slot.active_)
+                continue;
+
+            slot.age_ += timeStep;
+            bool expired = pool.lifetime_ > 0.0f && slot.age_ >= pool.lifetime_;
+            expired = expired || bounds_.IsInside(slot.node_->GetWorldPosition()) == OUTSIDE;
+            if (!expired && pool.despawnWhenSleeping_) {
+                auto *body = slot.node_->GetComponent<RigidBody>();
+                expired = body && !body->IsActive();
+            }
+
+            if (expired)
+                Deactivate(pool, i);
+            else
+                ++numActive;
+        }
+    }
+
+    if (auto *debugHud = GetSubsystem<DebugHud>())
+        debugHud->SetAppStats("Pooled entities active", numActive);
+}
+
+void EntityPool::Deactivate(Pool &pool, unsigned slot) {
+    pool.slots_[slot].active_ = false;
+    pool.slots_[slot].node_->SetDeepEnabled(false);
+    pool.free_.push_back(slot);
+}
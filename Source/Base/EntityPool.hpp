@@ -0,0 +1,91 @@
+#ifndef AIBATTLEGROUND_ENTITYPOOL_HPP
+#define AIBATTLEGROUND_ENTITYPOOL_HPP
+
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
+#include <functional>
+#include <vector>
+
+/// Fixed pools of preallocated entities that are switched on when spawned and off when despawned, instead of being
+/// created and never removed. Disabled nodes are out of the octree and the physics world, so the scene cost stays at
+/// the number of active entities. An entity despawns when its lifetime runs out, when it leaves the bounds, or, if the
+/// pool asks for it, when its rigid body falls asleep. When a pool is exhausted, its oldest active entity is reused.
+/// The pooled nodes are local and temporary, so they are not saved; the pools have to be created again after a scene
+/// load, which drops the entities that were active.
+class EntityPool : public Urho3D::Component {
+    URHO3D_OBJECT(EntityPool, Urho3D::Component);
+
+ public:
+    /// Function building the components of one pooled node.
+    using BuildFunction = std::function<void(Urho3D::Node *)>;
+
+    /// Construct.
+    explicit EntityPool(Urho3D::Context *context);
+    /// Destruct.
+    ~EntityPool() override;
+
+    /// Create a pool and build all of its nodes up front. Return pool index.
+    unsigned CreatePool(const Urho3D::String &name, unsigned capacity, const BuildFunction &build);
+    /// Set lifetime of a pool's entities in seconds, zero for no limit.
+    void SetLifetime(unsigned pool, float lifetime);
+    /// Set whether a pool's entities despawn once their rigid body is asleep.
+    void SetDespawnWhenSleeping(unsigned pool, bool enable);
+    /// Set bounds outside which entities despawn.
+    void SetBounds(const Urho3D::BoundingBox &bounds) { bounds_ = bounds; }
+    /// Activate an entity at a transform. Reuses the oldest active entity when the pool is exhausted.
+    Urho3D::Node *Spawn(unsigned pool, const Urho3D::Vector3 &position, const Urho3D::Quaternion &rotation);
+    /// Deactivate an entity.
+    void Despawn(Urho3D::Node *node);
+
+    /// Return number of pools.
+    unsigned GetNumPools() const { return (unsigned) pools_.size(); }
+    /// Return capacity of a pool.
+    unsigned GetCapacity(unsigned pool) const { return (unsigned) pools_[pool].slots_.size(); }
+    /// Return number of active entities of a pool.
+    unsigned GetNumActive(unsigned pool) const;
+    /// Return number of entities reused while still active because their pool was exhausted.
+    unsigned GetNumRecycled() const { return numRecycled_; }
+    /// Return bounds outside which entities despawn.
+    const Urho3D::BoundingBox &GetBounds() const { return bounds_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// One pooled entity.
+    struct Slot {
+        Urho3D::SharedPtr<Urho3D::Node> node_;
+        /// Time since spawned.
+        float age_;
+        /// Spawn order, the lowest active one is reused first.
+        unsigned serial_;
+        bool active_;
+    };
+    /// Entities of one kind.
+    struct Pool {
+        Urho3D::String name_;
+        std::vector<Slot> slots_;
+        /// Inactive slots.
+        std::vector<unsigned> free_;
+        float lifetime_;
+        bool despawnWhenSleeping_;
+    };
+
+    /// Handle the scene post-update event.
+    void HandleScenePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Deactivate a slot.
+    void Deactivate(Pool &pool, unsigned slot);
+
+    /// Pools.
+    std::vector<Pool> pools_;
+    /// Bounds outside which entities despawn.
+    Urho3D::BoundingBox bounds_;
+    /// Spawn order of the next entity.
+    unsigned nextSerial_;
+    /// Number of entities reused while still active.
+    unsigned numRecycled_;
+};
+
+#endif //AIBATTLEGROUND_ENTITYPOOL_HPP
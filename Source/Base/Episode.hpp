@@ -22,10 +22,13 @@
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/UI/Text.h>
 #include "../Base/AIBattleGround.hpp"
+#include "../Base/ResourcePreloader.hpp"
 
 class Episode {
     // Enable type information.
  public:
+    /// List the resources to load in the background before the scene is constructed.
+    virtual void GetResourceManifest(ResourceManifest &manifest)=0;
     virtual Urho3D::Scene *InitScene()=0;
     virtual void InitObjects()=0;
     virtual Urho3D::SharedPtr<Urho3D::Node> InitCamera()=0;
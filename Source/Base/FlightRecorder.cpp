@@ -0,0 +1,213 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "CrowdSystem.hpp"
+#include "EntityPool.hpp"
+#include "FlightRecorder.hpp"
+#include "PhysicsLod.hpp"
+#include "SpawnScheduler.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Frames kept unless set.
+const unsigned DEFAULT_CAPACITY = 300;
+/// Frame time threshold unless set, two frames at 60 fps.
+const float DEFAULT_THRESHOLD_MSEC = 33.3f;
+
+}
+
+FlightRecorder::FlightRecorder(Context *context) :
+  Component(context),
+  next_(0),
+  numFrames_(0),
+  thresholdMSec_(DEFAULT_THRESHOLD_MSEC),
+  frameNumber_(0),
+  lastDumpFrame_(0),
+  numDumps_(0) {
+    frames_.resize(DEFAULT_CAPACITY);
+    outputDir_ = GetSubsystem<FileSystem>()->GetAppPreferencesDir("AIBattleGround", "logs");
+}
+
+FlightRecorder::~FlightRecorder() {
+    // The worker thread holds a pointer to the dump
+    if (dumpJob_ && !dumpJob_->item_->completed_ && !GetSubsystem<WorkQueue>()->RemoveWorkItem(dumpJob_->item_))
+        GetSubsystem<WorkQueue>()->Complete(0);
+}
+
+void FlightRecorder::SetCapacity(unsigned frames) {
+    frames_.assign(Max(frames, 1u), Frame{});
+    next_ = 0;
+    numFrames_ = 0;
+}
+
+float FlightRecorder::ThresholdFromArguments(const Vector<String> &arguments, float defaultMSec) {
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+        if (arguments[i].ToLower() == "-spikems")
+            return Max(ToFloat(arguments[i + 1]), 1.0f);
+    }
+    return defaultMSec;
+}
+
+void FlightRecorder::OnSceneSet(Scene *scene) {
+    if (scene) {
+        frameTimer_.Reset();
+        SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(FlightRecorder, HandleBeginFrame));
+    } else
+        UnsubscribeFromEvent(E_BEGINFRAME);
+}
+
+void FlightRecorder::HandleBeginFrame(StringHash eventType, VariantMap &eventData) {
+    if (dumpJob_ && dumpJob_->item_->completed_)
+        FinishDump();
+
+    // Nothing has run yet in the first frame
+    if (!frameNumber_++) {
+        frameTimer_.Reset();
+        return;
+    }
+    if (!IsEnabledEffective())
+        return;
+
+    Frame &frame = frames_[next_];
+    frame.number_ = frameNumber_ - 1;
+    if (auto *timings = GetSubsystem<FrameTimings>()) {
+        for (unsigned i = 0; i < MAX_FRAME_SECTIONS; ++i)
+            frame.sectionMSec_[i] = (float) timings->GetLastFrameTime((FrameSection) i)/1000.0f;
+    } else {
+        for (float &msec : frame.sectionMSec_)
+            msec = 0.0f;
+        frame.sectionMSec_[FS_FRAME] = (float) frameTimer_.GetUSec(false)/1000.0f;
+    }
+    frameTimer_.Reset();
+    Sample(frame);
+    next_ = (next_ + 1)%(unsigned) frames_.size();
+    numFrames_ = Min(numFrames_ + 1, (unsigned) frames_.size());
+
+    // The profiler has just closed the frame, so its tree is still the one of the slow frame
+    if (frame.sectionMSec_[FS_FRAME] > thresholdMSec_
+        && (!numDumps_ || frame.number_ - lastDumpFrame_ >= frames_.size()))
+        Dump(ToString("Frame %u took %.1f ms", frame.number_, frame.sectionMSec_[FS_FRAME]));
+}
+
+void FlightRecorder::Sample(Frame &frame) const {
+    Scene *scene = GetScene();
+    frame.timeStep_ = GetSubsystem<Time>()->GetTimeStep();
+    frame.numNodes_ = scene->GetNumChildren(false);
+
+    auto *crowd = scene->GetComponent<CrowdSystem>();
+    frame.numAgents_ = crowd ? crowd->GetNumAgents() : 0;
+
+    auto *physicsWorld = scene->GetComponent<PhysicsWorld>();
+    frame.numBodies_ = physicsWorld ? (unsigned) physicsWorld->GetWorld()->getNumCollisionObjects() : 0;
+    auto *physicsLod = scene->GetComponent<PhysicsLod>();
+    frame.numActiveBodies_ = physicsLod ? physicsLod->GetNumActive() : frame.numBodies_;
+    frame.numReducedBodies_ = physicsLod ? physicsLod->GetNumReduced() : 0;
+
+    auto *spawnScheduler = scene->GetComponent<SpawnScheduler>();
+    frame.numQueuedSpawns_ = spawnScheduler ? spawnScheduler->GetNumQueued() : 0;
+
+    frame.numPooled_ = 0;
+    if (auto *entityPool = scene->GetComponent<EntityPool>()) {
+        for (unsigned i = 0; i < entityPool->GetNumPools(); ++i)
+            frame.numPooled_ += entityPool->GetNumActive(i);
+    }
+}
+
+bool FlightRecorder::Dump(const String &reason) {
+    if (dumpJob_)
+        return false;
+    lastDumpFrame_ = frameNumber_ - 1;
+    ++numDumps_;
+
+    // Only the copy is made here, the frame that triggered the dump is already slow enough
+    std::unique_ptr<DumpJob> job(new DumpJob());
+    job->context_ = context_;
+    job->fileName_ = outputDir_ + "Spike_" + Time::GetTimeStamp().Replaced(':', '_').Replaced('.', '_')
+                                               .Replaced(' ', '_') + "_" + String(lastDumpFrame_) + ".json";
+    job->reason_ = reason;
+    job->thresholdMSec_ = thresholdMSec_;
+    job->success_ = false;
+    const auto capacity = (unsigned) frames_.size();
+    job->frames_.reserve(numFrames_);
+    for (unsigned i = 0; i < numFrames_; ++i)
+        job->frames_.push_back(frames_[(next_ + capacity - numFrames_ + i)%capacity]);
+    // The profiler keeps only the last frame, its tree has to be taken now
+    if (auto *profiler = GetSubsystem<Profiler>())
+        job->profiler_ = GetProfilerTree(profiler->GetRootBlock());
+
+    // Not taken from the pool so that the item keeps its completed flag after the queue purges it
+    job->item_ = new WorkItem();
+    job->item_->priority_ = 0;
+    job->item_->workFunction_ = DumpWork;
+    job->item_->aux_ = job.get();
+    dumpJob_ = std::move(job);
+    GetSubsystem<WorkQueue>()->AddWorkItem(dumpJob_->item_);
+    return true;
+}
+
+void FlightRecorder::FinishDump() {
+    std::unique_ptr<DumpJob> job(std::move(dumpJob_));
+    if (!job->success_) {
+        URHO3D_LOGERROR("Could not write flight recorder dump " + job->fileName_);
+        return;
+    }
+    URHO3D_LOGWARNING(job->reason_ + ", last " + String((unsigned) job->frames_.size()) + " frames written to "
+                      + job->fileName_);
+}
+
+void FlightRecorder::DumpWork(const WorkItem *item, unsigned threadIndex) {
+    DumpJob &job = *static_cast<DumpJob *>(item->aux_);
+
+    JSONFile file(job.context_);
+    JSONValue &root = file.GetRoot();
+    root.Set("reason", JSONValue(job.reason_));
+    root.Set("thresholdMs", JSONValue(job.thresholdMSec_));
+
+    JSONArray frames;
+    for (const Frame &frame : job.frames_) {
+        JSONValue entry;
+        entry.Set("frame", JSONValue(frame.number_));
+        entry.Set("timeStep", JSONValue(frame.timeStep_));
+        for (unsigned j = 0; j < MAX_FRAME_SECTIONS; ++j)
+            entry.Set(String(FrameTimings::GetSectionName((FrameSection) j)) + "Ms", JSONValue(frame.sectionMSec_[j]));
+        entry.Set("nodes", JSONValue(frame.numNodes_));
+        entry.Set("agents", JSONValue(frame.numAgents_));
+        entry.Set("bodies", JSONValue(frame.numBodies_));
+        entry.Set("activeBodies", JSONValue(frame.numActiveBodies_));
+        entry.Set("reducedBodies", JSONValue(frame.numReducedBodies_));
+        entry.Set("queuedSpawns", JSONValue(frame.numQueuedSpawns_));
+        entry.Set("pooled", JSONValue(frame.numPooled_));
+        frames.Push(entry);
+    }
+    root.Set("frames", JSONValue(frames));
+    if (!job.profiler_.IsNull())
+        root.Set("profiler", job.profiler_);
+    job.success_ = file.SaveFile(job.fileName_);
+}
+
+JSONValue FlightRecorder::GetProfilerTree(const ProfilerBlock *block) {
+    JSONValue node;
+    if (!block)
+        return node;
+
+    node.Set("name", JSONValue(block->name_));
+    node.Set("ms", JSONValue((float) block->frameTime_/1000.0f));
+    node.Set("maxMs", JSONValue((float) block->frameMaxTime_/1000.0f));
+    node.Set("calls", JSONValue(block->frameCount_));
+    JSONArray children;
+    for (ProfilerBlock *child : block->children_) {
+        if (child->frameCount_)
+            children.Push(GetProfilerTree(child));
+    }
+    if (!children.Empty())
+        node.Set("children", JSONValue(children));
+    return node;
+}
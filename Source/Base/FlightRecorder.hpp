@@ -0,0 +1,114 @@
+#ifndef AIBATTLEGROUND_FLIGHTRECORDER_HPP
+#define AIBATTLEGROUND_FLIGHTRECORDER_HPP
+
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Resource/JSONValue.h>
+#include <Urho3D/Scene/Component.h>
+#include <memory>
+#include <vector>
+
+#include "FrameTimings.hpp"
+
+/// Always-on recorder of the last frames of a scene, for hitches that are over before anyone looks. Every frame a fixed
+/// size ring buffer takes the section times of FrameTimings and a few counters that are already kept elsewhere: top
+/// level nodes, crowd agents, physics bodies and their level of detail, queued spawns and active pooled entities. When
+/// a frame takes longer than the threshold, the buffer is written as JSON to the log directory together with that
+/// frame's engine profiler tree, at most once per buffer length of frames. The dump copies the buffer and the profiler
+/// tree on the main thread, the JSON is built and written on a worker thread. Without a FrameTimings subsystem only
+/// the whole frame time is known.
+class FlightRecorder : public Urho3D::Component {
+    URHO3D_OBJECT(FlightRecorder, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit FlightRecorder(Urho3D::Context *context);
+    /// Destruct. Waits for a dump being written.
+    ~FlightRecorder() override;
+
+    /// Set number of frames kept.
+    void SetCapacity(unsigned frames);
+    /// Set frame time in milliseconds above which the buffer is written.
+    void SetThreshold(float msec) { thresholdMSec_ = msec; }
+    /// Set directory of the dumps.
+    void SetOutputDir(const Urho3D::String &dir) { outputDir_ = dir; }
+    /// Queue the buffer for writing. Return false if the previous dump is still being written.
+    bool Dump(const Urho3D::String &reason);
+
+    /// Return number of frames kept.
+    unsigned GetCapacity() const { return (unsigned) frames_.size(); }
+    /// Return frame time threshold in milliseconds.
+    float GetThreshold() const { return thresholdMSec_; }
+    /// Return number of dumps written.
+    unsigned GetNumDumps() const { return numDumps_; }
+
+    /// Read -spikems <ms> from the program arguments, or return a default.
+    static float ThresholdFromArguments(const Urho3D::Vector<Urho3D::String> &arguments, float defaultMSec);
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// Recorded frame.
+    struct Frame {
+        unsigned number_;
+        float timeStep_;
+        float sectionMSec_[MAX_FRAME_SECTIONS];
+        unsigned numNodes_;
+        unsigned numAgents_;
+        unsigned numBodies_;
+        unsigned numActiveBodies_;
+        unsigned numReducedBodies_;
+        unsigned numQueuedSpawns_;
+        unsigned numPooled_;
+    };
+
+    /// Copied buffer and profiler tree of one dump.
+    struct DumpJob {
+        Urho3D::Context *context_;
+        Urho3D::String fileName_;
+        Urho3D::String reason_;
+        float thresholdMSec_;
+        /// Frames, oldest first.
+        std::vector<Frame> frames_;
+        Urho3D::JSONValue profiler_;
+        bool success_;
+        Urho3D::SharedPtr<Urho3D::WorkItem> item_;
+    };
+
+    /// Handle the frame begin event, the last frame has ended.
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Log the result of a written dump.
+    void FinishDump();
+    /// Work item function writing a dump.
+    static void DumpWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+    /// Fill a frame from the scene counters.
+    void Sample(Frame &frame) const;
+    /// Return the engine profiler tree of the last frame below a block.
+    static Urho3D::JSONValue GetProfilerTree(const Urho3D::ProfilerBlock *block);
+
+    /// Ring buffer of frames.
+    std::vector<Frame> frames_;
+    /// Next slot to write.
+    unsigned next_;
+    /// Number of frames written, capped at the capacity.
+    unsigned numFrames_;
+    /// Frame time threshold in milliseconds.
+    float thresholdMSec_;
+    /// Frames begun.
+    unsigned frameNumber_;
+    /// Frame of the last dump.
+    unsigned lastDumpFrame_;
+    /// Number of dumps written.
+    unsigned numDumps_;
+    /// Dump being written, null when none.
+    std::unique_ptr<DumpJob> dumpJob_;
+    /// Time since the frame began, when there is no FrameTimings.
+    Urho3D::HiresTimer frameTimer_;
+    /// Directory of the dumps.
+    Urho3D::String outputDir_;
+};
+
+#endif //AIBATTLEGROUND_FLIGHTRECORDER_HPP
@@ -0,0 +1,270 @@
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "FlowField.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Length of a diagonal step in cells.
+const float SQRT2 = 1.41421356f;
+/// Direction index of the goal cell and of cells without a route.
+const unsigned char NO_DIRECTION = 8;
+/// Neighbour offsets, orthogonal first.
+const int NEIGHBOUR_X[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+const int NEIGHBOUR_Z[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+/// Neighbour step lengths in cells.
+const float NEIGHBOUR_LENGTH[8] = {1.0f, 1.0f, 1.0f, 1.0f, SQRT2, SQRT2, SQRT2, SQRT2};
+/// Normalized neighbour directions.
+const float DIRECTION_X[8] = {1.0f, -1.0f, 0.0f, 0.0f, SQRT2*0.5f, SQRT2*0.5f, -SQRT2*0.5f, -SQRT2*0.5f};
+const float DIRECTION_Z[8] = {0.0f, 0.0f, 1.0f, -1.0f, SQRT2*0.5f, -SQRT2*0.5f, SQRT2*0.5f, -SQRT2*0.5f};
+/// Number of terrain rows sampled per work item.
+const unsigned ROWS_PER_ITEM = 16;
+
+}
+
+FlowField::FlowField(Context *context) :
+  Component(context),
+  bounds_(-1000.0f, 1000.0f),
+  cellSize_(10.0f),
+  waterHeight_(5.0f),
+  maxSlope_(40.0f),
+  width_(0),
+  height_(0) {
+}
+
+void FlowField::Build(Terrain *terrain) {
+    terrain_ = terrain;
+    width_ = (unsigned) Max(CeilToInt((bounds_.max_.x_ - bounds_.min_.x_)/cellSize_), 1);
+    height_ = (unsigned) Max(CeilToInt((bounds_.max_.z_ - bounds_.min_.z_)/cellSize_), 1);
+    costs_.assign(width_*height_, 0);
+
+    if (terrain) {
+        // Make sure the terrain transform is clean before the worker threads read it
+        terrain->GetNode()->GetWorldTransform();
+
+        auto *queue = GetSubsystem<WorkQueue>();
+        std::vector<RowRange> ranges;
+        for (unsigned begin = 0; begin < height_; begin += ROWS_PER_ITEM)
+            ranges.push_back(RowRange{this, begin, Min(begin + ROWS_PER_ITEM, height_)});
+
+        for (RowRange &range : ranges) {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = BuildRowsWork;
+            item->aux_ = &range;
+            queue->AddWorkItem(item);
+        }
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+
+    for (Goal &goal : goals_) {
+        goal.cell_ = FindPassableCell(GetCell(goal.position_.x_, goal.position_.z_));
+        goal.dirty_ = true;
+    }
+}
+
+unsigned FlowField::AddGoal(const Vector3 &position) {
+    goals_.push_back(Goal{position, 0, {}, {}, true});
+    SetGoal((unsigned) goals_.size() - 1, position);
+    return (unsigned) goals_.size() - 1;
+}
+
+void FlowField::SetGoal(unsigned goal, const Vector3 &position) {
+    Goal &target = goals_[goal];
+    target.cell_ = costs_.empty() ? 0 : FindPassableCell(GetCell(position.x_, position.z_));
+    target.position_ = position;
+    if (!costs_.empty()) {
+        // Keep the goal position on the passable cell it was snapped to
+        const Vector3 center = GetCellCenter(target.cell_);
+        target.position_.x_ = center.x_;
+        target.position_.z_ = center.z_;
+    }
+    target.dirty_ = true;
+}
+
+void FlowField::UpdateFields() {
+    if (costs_.empty())
+        return;
+
+    jobs_.clear();
+    for (unsigned i = 0; i < goals_.size(); ++i) {
+        if (goals_[i].dirty_)
+            jobs_.emplace_back(this, i);
+    }
+    if (jobs_.empty())
+        return;
+
+    // Every goal owns its fields, so the goals are computed in parallel without synchronization
+    auto *queue = GetSubsystem<WorkQueue>();
+    for (auto &job : jobs_) {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = GoalFieldWork;
+        item->aux_ = &job;
+        queue->AddWorkItem(item);
+    }
+    queue->Complete(M_MAX_UNSIGNED);
+
+    for (auto &job : jobs_)
+        goals_[job.second].dirty_ = false;
+}
+
+bool FlowField::IsPassable(const Vector3 &position) const {
+    return !costs_.empty() && costs_[GetCell(position.x_, position.z_)] != 0;
+}
+
+bool FlowField::GetDirection(unsigned goal, float x, float z, float &dirX, float &dirZ) const {
+    if (goal >= goals_.size() || goals_[goal].directions_.empty())
+        return false;
+
+    const unsigned char direction = goals_[goal].directions_[GetCell(x, z)];
+    if (direction == NO_DIRECTION)
+        return false;
+
+    dirX = DIRECTION_X[direction];
+    dirZ = DIRECTION_Z[direction];
+    return true;
+}
+
+void FlowField::OnSceneSet(Scene *scene) {
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(FlowField, HandleSceneUpdate));
+    else
+        UnsubscribeFromEvent(E_SCENEUPDATE);
+}
+
+void FlowField::HandleSceneUpdate(StringHash eventType, VariantMap &eventData) {
+    UpdateFields();
+}
+
+void FlowField::BuildRowsWork(const WorkItem *item, unsigned threadIndex) {
+    const auto *range = static_cast<const RowRange *>(item->aux_);
+    range->field_->BuildRows(range->begin_, range->end_);
+}
+
+void FlowField::GoalFieldWork(const WorkItem *item, unsigned threadIndex) {
+    const auto *job = static_cast<const std::pair<FlowField *, unsigned> *>(item->aux_);
+    job->first->ComputeGoalField(job->second);
+}
+
+void FlowField::BuildRows(unsigned beginRow, unsigned endRow) {
+    for (unsigned z = beginRow; z < endRow; ++z) {
+        for (unsigned x = 0; x < width_; ++x) {
+            const Vector3 position(bounds_.min_.x_ + ((float) x + 0.5f)*cellSize_, 0.0f,
+                                   bounds_.min_.z_ + ((float) z + 0.5f)*cellSize_);
+            const float height = terrain_->GetHeight(position);
+            const float slope = Acos(Clamp(terrain_->GetNormal(position).y_, -1.0f, 1.0f));
+
+            // Water and steep slopes block the way, gentler slopes only make it more expensive
+            unsigned char cost = 0;
+            if (height >= waterHeight_ && slope <= maxSlope_)
+                cost = (unsigned char) (1 + RoundToInt(slope/maxSlope_*15.0f));
+            costs_[z*width_ + x] = cost;
+        }
+    }
+}
+
+void FlowField::ComputeGoalField(unsigned goalIndex) {
+    Goal &goal = goals_[goalIndex];
+    const unsigned numCells = width_*height_;
+    goal.integration_.assign(numCells, M_INFINITY);
+    goal.directions_.assign(numCells, NO_DIRECTION);
+
+    // Dijkstra over the 8-connected cost grid, starting from the goal
+    using Entry = std::pair<float, unsigned>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    goal.integration_[goal.cell_] = 0.0f;
+    open.emplace(0.0f, goal.cell_);
+
+    while (!open.empty()) {
+        const Entry current = open.top();
+        open.pop();
+        if (current.first > goal.integration_[current.second])
+            continue;
+
+        const auto cx = (int) (current.second%width_);
+        const auto cz = (int) (current.second/width_);
+        for (unsigned n = 0; n < 8; ++n) {
+            const int nx = cx + NEIGHBOUR_X[n];
+            const int nz = cz + NEIGHBOUR_Z[n];
+            if (nx < 0 || nz < 0 || nx >= (int) width_ || nz >= (int) height_)
+                continue;
+            const unsigned neighbour = nz*width_ + nx;
+            if (!costs_[neighbour])
+                continue;
+            // Do not cut corners of impassable cells diagonally
+            if (n >= 4 && (!costs_[cz*width_ + nx] || !costs_[nz*width_ + cx]))
+                continue;
+
+            const float cost = current.first + NEIGHBOUR_LENGTH[n]*costs_[neighbour];
+            if (cost < goal.integration_[neighbour]) {
+                goal.integration_[neighbour] = cost;
+                open.emplace(cost, neighbour);
+            }
+        }
+    }
+
+    // Every reachable cell points at its cheapest neighbour
+    for (unsigned cell = 0; cell < numCells; ++cell) {
+        if (cell == goal.cell_ || goal.integration_[cell] == M_INFINITY)
+            continue;
+
+        const auto cx = (int) (cell%width_);
+        const auto cz = (int) (cell/width_);
+        float best = goal.integration_[cell];
+        for (unsigned n = 0; n < 8; ++n) {
+            const int nx = cx + NEIGHBOUR_X[n];
+            const int nz = cz + NEIGHBOUR_Z[n];
+            if (nx < 0 || nz < 0 || nx >= (int) width_ || nz >= (int) height_)
+                continue;
+            if (n >= 4 && (!costs_[cz*width_ + nx] || !costs_[nz*width_ + cx]))
+                continue;
+            const float value = goal.integration_[nz*width_ + nx];
+            if (value < best) {
+                best = value;
+                goal.directions_[cell] = (unsigned char) n;
+            }
+        }
+    }
+}
+
+unsigned FlowField::GetCell(float x, float z) const {
+    const int cx = Clamp(FloorToInt((x - bounds_.min_.x_)/cellSize_), 0, (int) width_ - 1);
+    const int cz = Clamp(FloorToInt((z - bounds_.min_.z_)/cellSize_), 0, (int) height_ - 1);
+    return (unsigned) (cz*(int) width_ + cx);
+}
+
+Vector3 FlowField::GetCellCenter(unsigned cell) const {
+    return Vector3(bounds_.min_.x_ + ((float) (cell%width_) + 0.5f)*cellSize_, 0.0f,
+                   bounds_.min_.z_ + ((float) (cell/width_) + 0.5f)*cellSize_);
+}
+
+unsigned FlowField::FindPassableCell(unsigned cell) const {
+    if (costs_[cell])
+        return cell;
+
+    // Search outwards in growing square rings
+    const auto cx = (int) (cell%width_);
+    const auto cz = (int) (cell/width_);
+    const auto maxRing = (int) Max(width_, height_);
+    for (int ring = 1; ring < maxRing; ++ring) {
+        for (int z = cz - ring; z <= cz + ring; ++z) {
+            for (int x = cx - ring; x <= cx + ring; ++x) {
+                if (Abs(x - cx) != ring && Abs(z - cz) != ring)
+                    continue;
+                if (x < 0 || z < 0 || x >= (int) width_ || z >= (int) height_)
+                    continue;
+                const unsigned candidate = z*width_ + x;
+                if (costs_[candidate])
+                    return candidate;
+            }
+        }
+    }
+    return cell;
+}
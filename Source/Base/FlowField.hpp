@@ -0,0 +1,118 @@
+#ifndef AIBATTLEGROUND_FLOWFIELD_HPP
+#define AIBATTLEGROUND_FLOWFIELD_HPP
+
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Terrain.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Scene/Component.h>
+#include <utility>
+#include <vector>
+
+/// Flow-field navigation for crowds over a heightmap terrain. A cost grid is built once from the terrain slope and
+/// the water level. For every shared goal an integration field (path cost to the goal) and a direction field (best
+/// neighbour towards the goal) are computed, goals in parallel on the WorkQueue. Agents then steer with a single
+/// lookup per frame instead of a path search each.
+class FlowField : public Urho3D::Component {
+    URHO3D_OBJECT(FlowField, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit FlowField(Urho3D::Context *context);
+
+    /// Set grid extent on the XZ plane. Takes effect on the next Build.
+    void SetBounds(const Urho3D::BoundingBox &bounds) { bounds_ = bounds; }
+    /// Set grid cell size. Takes effect on the next Build.
+    void SetCellSize(float cellSize) { cellSize_ = Urho3D::Max(cellSize, 1.0f); }
+    /// Set height below which the ground is water and impassable. Takes effect on the next Build.
+    void SetWaterHeight(float height) { waterHeight_ = height; }
+    /// Set slope in degrees above which the ground is impassable. Takes effect on the next Build.
+    void SetMaxSlope(float degrees) { maxSlope_ = degrees; }
+
+    /// Build the cost grid from a terrain. Invalidates all goal fields.
+    void Build(Urho3D::Terrain *terrain);
+    /// Add a shared goal, snapped to the nearest passable cell. Return goal index.
+    unsigned AddGoal(const Urho3D::Vector3 &position);
+    /// Move a shared goal.
+    void SetGoal(unsigned goal, const Urho3D::Vector3 &position);
+    /// Compute the fields of all goals that changed. Called automatically on scene update.
+    void UpdateFields();
+
+    /// Return number of goals.
+    unsigned GetNumGoals() const { return (unsigned) goals_.size(); }
+    /// Return goal position.
+    const Urho3D::Vector3 &GetGoalPosition(unsigned goal) const { return goals_[goal].position_; }
+    /// Return whether the point is on a passable cell.
+    bool IsPassable(const Urho3D::Vector3 &position) const;
+    /// Return the direction towards a goal on the XZ plane. Return false when there is no route or the goal cell is
+    /// reached. Safe to call from worker threads while the fields are not being updated.
+    bool GetDirection(unsigned goal, float x, float z, float &dirX, float &dirZ) const;
+
+    /// Return terrain the cost grid was built from.
+    Urho3D::Terrain *GetTerrain() const { return terrain_; }
+    /// Return number of cell columns.
+    unsigned GetWidth() const { return width_; }
+    /// Return number of cell rows.
+    unsigned GetHeight() const { return height_; }
+    /// Return traversal cost of a cell, 0 for impassable.
+    unsigned char GetCellCost(unsigned cell) const { return costs_[cell]; }
+    /// Return cell index of a point, clamped to the grid.
+    unsigned GetCell(float x, float z) const;
+    /// Return center of a cell on the XZ plane.
+    Urho3D::Vector3 GetCellCenter(unsigned cell) const;
+    /// Return the nearest passable cell to a cell, or the cell itself if none is found.
+    unsigned FindPassableCell(unsigned cell) const;
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// Handle the scene update event.
+    void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Work item function filling a range of cost grid rows.
+    static void BuildRowsWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+    /// Work item function computing the fields of one goal.
+    static void GoalFieldWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+    /// Fill the cost of a range of rows.
+    void BuildRows(unsigned beginRow, unsigned endRow);
+    /// Compute the integration and direction fields of one goal.
+    void ComputeGoalField(unsigned goal);
+
+    /// Fields of one shared goal.
+    struct Goal {
+        Urho3D::Vector3 position_;
+        unsigned cell_;
+        std::vector<float> integration_;
+        std::vector<unsigned char> directions_;
+        bool dirty_;
+    };
+
+    /// Range of rows filled by one work item.
+    struct RowRange {
+        FlowField *field_;
+        unsigned begin_;
+        unsigned end_;
+    };
+
+    /// Terrain the cost grid is built from.
+    Urho3D::WeakPtr<Urho3D::Terrain> terrain_;
+    /// Grid extent.
+    Urho3D::BoundingBox bounds_;
+    /// Cell size.
+    float cellSize_;
+    /// Water height.
+    float waterHeight_;
+    /// Maximum passable slope in degrees.
+    float maxSlope_;
+    /// Number of cell columns and rows.
+    unsigned width_;
+    unsigned height_;
+    /// Traversal cost per cell, 0 for impassable.
+    std::vector<unsigned char> costs_;
+    /// Shared goals.
+    std::vector<Goal> goals_;
+    /// Goal indices of the current parallel update, referenced by the work items.
+    std::vector<std::pair<FlowField *, unsigned>> jobs_;
+};
+
+#endif //AIBATTLEGROUND_FLOWFIELD_HPP
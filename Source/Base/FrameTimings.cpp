@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Graphics/Renderer.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Resource/JSONFile.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "FrameTimings.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Percentiles written per section.
+const float REPORT_PERCENTILES[] = {0.5f, 0.9f, 0.95f, 0.99f};
+/// Report keys of the percentiles.
+const char *REPORT_PERCENTILE_NAMES[] = {"p50", "p90", "p95", "p99"};
+/// Report keys of the sections.
+const char *SECTION_NAMES[] = {"frame", "scene", "agents", "physics", "animation", "culling"};
+
+}
+
+FrameTimings::FrameTimings(Context *context) :
+  Object(context),
+  postUpdateUSec_(0),
+  current_{},
+  last_{},
+  recording_(false) {
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(FrameTimings, HandleBeginFrame));
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(FrameTimings, HandlePostUpdate));
+    SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(FrameTimings, HandlePostRenderUpdate));
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(FrameTimings, HandleEndFrame));
+    SubscribeToEvent(E_PHYSICSPRESTEP, URHO3D_HANDLER(FrameTimings, HandlePhysicsPreStep));
+    SubscribeToEvent(E_PHYSICSPOSTSTEP, URHO3D_HANDLER(FrameTimings, HandlePhysicsPostStep));
+}
+
+FrameTimings::~FrameTimings() = default;
+
+void FrameTimings::SetCullCamera(Camera *camera, Octree *octree) {
+    cullCamera_ = camera;
+    cullOctree_ = octree;
+}
+
+void FrameTimings::Clear() {
+    for (std::vector<float> &samples : samples_)
+        samples.clear();
+}
+
+bool FrameTimings::SaveReport(const String &fileName, const JSONValue &scenario) const {
+    JSONFile file(context_);
+    JSONValue &root = file.GetRoot();
+    root.Set("scenario", scenario);
+    root.Set("frames", JSONValue(GetNumFrames()));
+    root.Set("peakMemoryBytes", JSONValue((double) GetPeakMemory()));
+
+    // Times are in milliseconds, percentiles use the nearest rank
+    JSONValue sections;
+    for (unsigned i = 0; i < MAX_FRAME_SECTIONS; ++i) {
+        std::vector<float> sorted = samples_[i];
+        std::sort(sorted.begin(), sorted.end());
+
+        JSONValue stats;
+        double sum = 0.0;
+        for (float sample : sorted)
+            sum += sample;
+        stats.Set("mean", JSONValue(sorted.empty() ? 0.0 : sum/sorted.size()));
+        for (unsigned j = 0; j < sizeof(REPORT_PERCENTILES)/sizeof(REPORT_PERCENTILES[0]); ++j) {
+            const auto rank = (unsigned) CeilToInt(REPORT_PERCENTILES[j]*sorted.size());
+            stats.Set(REPORT_PERCENTILE_NAMES[j], JSONValue(sorted.empty() ? 0.0f : sorted[Max(rank, 1u) - 1]));
+        }
+        stats.Set("max", JSONValue(sorted.empty() ? 0.0f : sorted.back()));
+        sections.Set(GetSectionName((FrameSection) i), stats);
+    }
+    root.Set("sections", sections);
+
+    return file.SaveFile(fileName);
+}
+
+const char *FrameTimings::GetSectionName(FrameSection section) {
+    return section < MAX_FRAME_SECTIONS ? SECTION_NAMES[section] : "";
+}
+
+unsigned long long FrameTimings::GetPeakMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+#ifdef __APPLE__
+    return (unsigned long long) usage.ru_maxrss;
+#else
+    // Kilobytes on Linux
+    return (unsigned long long) usage.ru_maxrss*1024u;
+#endif
+#endif
+}
+
+void FrameTimings::HandleBeginFrame(StringHash eventType, VariantMap &eventData) {
+    for (long long &time : current_)
+        time = 0;
+    frameTimer_.Reset();
+}
+
+void FrameTimings::HandlePostUpdate(StringHash eventType, VariantMap &eventData) {
+    postUpdateUSec_ = frameTimer_.GetUSec(false);
+}
+
+void FrameTimings::HandlePostRenderUpdate(StringHash eventType, VariantMap &eventData) {
+    // The render update between the two events updates the drawables and, with a renderer, culls the views
+    const long long renderUpdateUSec = frameTimer_.GetUSec(false) - postUpdateUSec_;
+    if (GetSubsystem<Renderer>()) {
+        current_[FS_CULLING] += renderUpdateUSec;
+        return;
+    }
+
+    current_[FS_ANIMATION] += renderUpdateUSec;
+    if (cullCamera_ && cullOctree_) {
+        HiresTimer timer;
+        culled_.Clear();
+        FrustumOctreeQuery query(culled_, cullCamera_->GetFrustum(), DRAWABLE_GEOMETRY, cullCamera_->GetViewMask());
+        cullOctree_->GetDrawables(query);
+        current_[FS_CULLING] += timer.GetUSec(false);
+    }
+}
+
+void FrameTimings::HandleEndFrame(StringHash eventType, VariantMap &eventData) {
+    current_[FS_FRAME] = frameTimer_.GetUSec(false);
+    // What the update spent outside the agents and physics is the rest of the scene update
+    current_[FS_SCENE] = Max(postUpdateUSec_ - current_[FS_AGENTS] - current_[FS_PHYSICS], 0LL);
+    for (unsigned i = 0; i < MAX_FRAME_SECTIONS; ++i)
+        last_[i] = current_[i];
+
+    if (!recording_)
+        return;
+    for (unsigned i = 0; i < MAX_FRAME_SECTIONS; ++i)
+        samples_[i].push_back((float) current_[i]/1000.0f);
+}
+
+void FrameTimings::HandlePhysicsPreStep(StringHash eventType, VariantMap &eventData) {
+    stepTimer_.Reset();
+}
+
+void FrameTimings::HandlePhysicsPostStep(StringHash eventType, VariantMap &eventData) {
+    current_[FS_PHYSICS] += stepTimer_.GetUSec(false);
+}
@@ -0,0 +1,102 @@
+#ifndef AIBATTLEGROUND_FRAMETIMINGS_HPP
+#define AIBATTLEGROUND_FRAMETIMINGS_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Resource/JSONValue.h>
+#include <vector>
+
+/// Part of a frame measured by FrameTimings.
+enum FrameSection {
+    /// Whole frame.
+    FS_FRAME = 0,
+    /// Scene update except the agents and physics: logic components, scene post-update handlers.
+    FS_SCENE,
+    /// Crowd agent update.
+    FS_AGENTS,
+    /// Physics steps.
+    FS_PHYSICS,
+    /// Drawable updates in the render update, dominated by the skinned animation.
+    FS_ANIMATION,
+    /// View culling of the main camera.
+    FS_CULLING,
+    /// Number of sections.
+    MAX_FRAME_SECTIONS
+};
+
+/// Per-frame time breakdown of the main subsystems for benchmark reports. The frame, physics and drawable update
+/// sections are measured from the engine events around them; systems without a bracketing event, such as the crowd,
+/// add their own time. With a renderer the whole render update counts as culling; without one the culling is stood in
+/// by a frustum query of the main camera, so that headless runs still measure it. Register as a subsystem; recorded
+/// frames are written as a JSON report with percentiles per section and the peak memory of the process. The sections of
+/// the last finished frame are kept whether recording or not.
+class FrameTimings : public Urho3D::Object {
+    URHO3D_OBJECT(FrameTimings, Urho3D::Object);
+
+ public:
+    /// Construct.
+    explicit FrameTimings(Urho3D::Context *context);
+    /// Destruct.
+    ~FrameTimings() override;
+
+    /// Set whether frames are recorded.
+    void SetRecording(bool enable) { recording_ = enable; }
+    /// Set camera and octree culled when there is no renderer.
+    void SetCullCamera(Urho3D::Camera *camera, Urho3D::Octree *octree);
+    /// Add time to a section of the current frame.
+    void AddTime(FrameSection section, long long usec) { current_[section] += usec; }
+    /// Clear the recorded frames.
+    void Clear();
+    /// Write the recorded frames as a JSON report, with the scenario parameters. Return true on success.
+    bool SaveReport(const Urho3D::String &fileName, const Urho3D::JSONValue &scenario) const;
+
+    /// Return whether frames are recorded.
+    bool IsRecording() const { return recording_; }
+    /// Return time of a section in the last finished frame in microseconds, recorded or not.
+    long long GetLastFrameTime(FrameSection section) const { return last_[section]; }
+    /// Return number of recorded frames.
+    unsigned GetNumFrames() const { return (unsigned) samples_[FS_FRAME].size(); }
+    /// Return name of a section as used in the report.
+    static const char *GetSectionName(FrameSection section);
+    /// Return peak resident memory of the process in bytes, or 0 when unknown.
+    static unsigned long long GetPeakMemory();
+
+ private:
+    /// Handle the frame begin event.
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the post-update event.
+    void HandlePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the post-render update event.
+    void HandlePostRenderUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the frame end event.
+    void HandleEndFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the physics pre-step event.
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the physics post-step event.
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+
+    /// Camera culled against without a renderer.
+    Urho3D::WeakPtr<Urho3D::Camera> cullCamera_;
+    /// Octree culled without a renderer.
+    Urho3D::WeakPtr<Urho3D::Octree> cullOctree_;
+    /// Drawables returned by the culling query.
+    Urho3D::PODVector<Urho3D::Drawable *> culled_;
+    /// Time since the frame began.
+    Urho3D::HiresTimer frameTimer_;
+    /// Time since the current physics step began.
+    Urho3D::HiresTimer stepTimer_;
+    /// Frame time at the post-update event.
+    long long postUpdateUSec_;
+    /// Section times of the current frame in microseconds.
+    long long current_[MAX_FRAME_SECTIONS];
+    /// Section times of the last finished frame in microseconds.
+    long long last_[MAX_FRAME_SECTIONS];
+    /// Recorded section times in milliseconds, one entry per frame.
+    std::vector<float> samples_[MAX_FRAME_SECTIONS];
+    /// Whether frames are recorded.
+    bool recording_;
+};
+
+#endif //AIBATTLEGROUND_FRAMETIMINGS_HPP
@@ -0,0 +1,248 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "AsyncLog.hpp"
+#include "Lockstep.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Recording file identifier.
+const char *REPLAY_FILE_ID = "AIBR";
+/// Recording format version.
+const unsigned REPLAY_VERSION = 1;
+
+/// Fold a value into an FNV-1a hash.
+void HashBytes(unsigned &hash, const void *data, unsigned size) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (unsigned i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+}
+
+/// Return whether a command type carries a transform.
+bool HasTransform(LockstepCommandType type) {
+    return type == LC_CAMERA || type == LC_SPAWN_OBJECT || type == LC_SPAWN_DRONE || type == LC_MOVE_SCREEN;
+}
+
+}
+
+LockstepOptions LockstepOptions::FromArguments(const Vector<String> &arguments) {
+    LockstepOptions options;
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+        const String argument = arguments[i].ToLower();
+        if (argument == "-seed") {
+            options.seed_ = ToUInt(arguments[++i]);
+            options.hasSeed_ = true;
+        } else if (argument == "-record")
+            options.recordPath_ = arguments[++i];
+        else if (argument == "-replay")
+            options.replayPath_ = arguments[++i];
+    }
+    return options;
+}
+
+Lockstep::Lockstep(Context *context) :
+  Component(context),
+  seed_(0),
+  tick_(0),
+  lastWrittenTick_(0),
+  replayIndex_(0),
+  replaying_(false),
+  numMismatches_(0) {
+}
+
+Lockstep::~Lockstep() = default;
+
+bool Lockstep::Start(const LockstepOptions &options) {
+    seed_ = options.hasSeed_ ? options.seed_ : Time::GetSystemTime();
+    tick_ = 0;
+    replaying_ = false;
+
+    if (!options.replayPath_.Empty()) {
+        File file(context_, options.replayPath_, FILE_READ);
+        if (!file.IsOpen() || !ReadReplay(file)) {
+            URHO3D_LOGERROR("Could not read replay " + options.replayPath_);
+            return false;
+        }
+        replaying_ = true;
+        URHO3D_LOGINFOF("Replaying %s, %u ticks", options.replayPath_.CString(), (unsigned) replayHashes_.size());
+    }
+
+    if (!options.recordPath_.Empty()) {
+        recordFile_ = new File(context_, options.recordPath_, FILE_WRITE);
+        if (!recordFile_->IsOpen()) {
+            URHO3D_LOGERROR("Could not open recording " + options.recordPath_);
+            recordFile_.Reset();
+            return false;
+        }
+        recordFile_->WriteFileID(REPLAY_FILE_ID);
+        recordFile_->WriteUInt(REPLAY_VERSION);
+        recordFile_->WriteUInt(seed_);
+        lastWrittenTick_ = 0;
+    }
+
+    // The streams are derived from the seed, recreate them so that they start over
+    streams_.Clear();
+    URHO3D_LOGINFOF("Simulation seed %u", seed_);
+    return true;
+}
+
+RandomStream &Lockstep::GetStream(const String &name) {
+    const StringHash key(name);
+    auto i = streams_.Find(key);
+    if (i == streams_.End()) {
+        // Mix the subsystem name into the seed so that the streams are unrelated
+        std::uint64_t seed = ((std::uint64_t) seed_ << 32u) | key.Value();
+        seed ^= seed >> 33u;
+        seed *= 0xff51afd7ed558ccdULL;
+        seed ^= seed >> 33u;
+        i = streams_.Insert(MakePair(key, RandomStream(seed)));
+    }
+    return i->second_;
+}
+
+void Lockstep::Submit(const LockstepCommand &command) {
+    if (replaying_)
+        return;
+
+    pending_.push_back(command);
+    pending_.back().tick_ = tick_;
+}
+
+void Lockstep::TakeCommands(std::vector<LockstepCommand> &commands) {
+    commands.clear();
+    if (replaying_) {
+        while (replayIndex_ < replay_.size() && replay_[replayIndex_].tick_ <= tick_)
+            commands.push_back(replay_[replayIndex_++]);
+    } else {
+        // Commands submitted after the input of a tick, such as from a scene update, run on the next one
+        commands.swap(pending_);
+        for (LockstepCommand &command : commands)
+            command.tick_ = tick_;
+    }
+
+    for (const LockstepCommand &command : commands)
+        Write(command);
+}
+
+unsigned Lockstep::ComputeStateHash() const {
+    unsigned hash = 2166136261u;
+    Scene *scene = GetScene();
+    if (!scene)
+        return hash;
+
+    // Exact float bits: a replay on the same build has to match bit for bit
+    for (const SharedPtr<Node> &node : scene->GetChildren()) {
+        const unsigned id = node->GetID();
+        const Vector3 &position = node->GetPosition();
+        const Quaternion &rotation = node->GetRotation();
+        HashBytes(hash, &id, sizeof id);
+        HashBytes(hash, position.Data(), sizeof(float)*3);
+        HashBytes(hash, rotation.Data(), sizeof(float)*4);
+    }
+    return hash;
+}
+
+void Lockstep::OnSceneSet(Scene *scene) {
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(Lockstep, HandleScenePostUpdate));
+    else
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+}
+
+void Lockstep::HandleScenePostUpdate(StringHash eventType, VariantMap &eventData) {
+    if (recordFile_ || replaying_) {
+        const unsigned hash = ComputeStateHash();
+        if (recordFile_)
+            Write(LockstepCommand{tick_, LC_STATE_HASH, Vector3::ZERO, Quaternion::IDENTITY, hash, 0});
+
+        if (replaying_ && tick_ < replayHashes_.size() && replayHashes_[tick_] != hash) {
+            if (!numMismatches_)
+                URHO3D_LOGWARNINGF("State hash mismatch at tick %u", tick_);
+            else
+                AIBG_LOGDEBUGF("State hash mismatch at tick %u, %08x recorded, %08x replayed", tick_,
+                               replayHashes_[tick_], hash);
+            ++numMismatches_;
+        }
+    }
+
+    ++tick_;
+    if (replaying_ && tick_ >= replayHashes_.size())
+        FinishReplay();
+}
+
+void Lockstep::Write(const LockstepCommand &command) {
+    if (!recordFile_)
+        return;
+
+    // Tick delta and type, then only the payload the type uses
+    recordFile_->WriteVLE(command.tick_ - lastWrittenTick_);
+    recordFile_->WriteUByte((unsigned char) command.type_);
+    lastWrittenTick_ = command.tick_;
+
+    if (HasTransform(command.type_)) {
+        recordFile_->WriteVector3(command.position_);
+        recordFile_->WriteQuaternion(command.rotation_);
+    } else if (command.type_ == LC_AGENT_GOAL) {
+        recordFile_->WriteVLE(command.target_);
+        recordFile_->WriteVLE(command.value_);
+    } else if (command.type_ == LC_STATE_HASH)
+        recordFile_->WriteUInt(command.target_);
+}
+
+bool Lockstep::ReadReplay(File &file) {
+    if (file.ReadFileID() != REPLAY_FILE_ID || file.ReadUInt() != REPLAY_VERSION)
+        return false;
+    seed_ = file.ReadUInt();
+
+    replay_.clear();
+    replayHashes_.clear();
+    replayIndex_ = 0;
+    numMismatches_ = 0;
+    unsigned tick = 0;
+    while (!file.IsEof()) {
+        LockstepCommand command{0, LC_CAMERA, Vector3::ZERO, Quaternion::IDENTITY, 0, 0};
+        tick += file.ReadVLE();
+        command.tick_ = tick;
+        command.type_ = (LockstepCommandType) file.ReadUByte();
+
+        if (HasTransform(command.type_)) {
+            command.position_ = file.ReadVector3();
+            command.rotation_ = file.ReadQuaternion();
+        } else if (command.type_ == LC_AGENT_GOAL) {
+            command.target_ = file.ReadVLE();
+            command.value_ = file.ReadVLE();
+        } else if (command.type_ == LC_STATE_HASH) {
+            command.target_ = file.ReadUInt();
+            if (replayHashes_.size() <= tick)
+                replayHashes_.resize(tick + 1, 0);
+            replayHashes_[tick] = command.target_;
+            continue;
+        } else if (command.type_ != LC_TOGGLE_POSES && command.type_ != LC_TOGGLE_PHYSICS_LOD)
+            return false;
+
+        replay_.push_back(command);
+    }
+    return true;
+}
+
+void Lockstep::FinishReplay() {
+    using namespace ReplayFinished;
+
+    replaying_ = false;
+    if (numMismatches_)
+        URHO3D_LOGWARNINGF("Replay finished after %u ticks, %u state hash mismatches", tick_, numMismatches_);
+    else
+        URHO3D_LOGINFOF("Replay finished after %u ticks, state matched on every tick", tick_);
+
+    VariantMap &eventData = GetEventDataMap();
+    eventData[P_TICKS] = tick_;
+    eventData[P_MISMATCHES] = numMismatches_;
+    SendEvent(E_REPLAYFINISHED, eventData);
+}
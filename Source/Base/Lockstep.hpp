@@ -0,0 +1,144 @@
+#ifndef AIBATTLEGROUND_LOCKSTEP_HPP
+#define AIBATTLEGROUND_LOCKSTEP_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Scene/Component.h>
+#include <vector>
+
+#include "RandomStream.hpp"
+
+/// Replay reached its last recorded tick. Sent by the Lockstep component.
+URHO3D_EVENT(E_REPLAYFINISHED, ReplayFinished) {
+    URHO3D_PARAM(P_TICKS, Ticks);             // unsigned
+    URHO3D_PARAM(P_MISMATCHES, Mismatches);   // unsigned
+}
+
+/// Type of a recorded command.
+enum LockstepCommandType {
+    /// Main camera moved to a transform.
+    LC_CAMERA = 0,
+    /// Physics object spawned at a transform.
+    LC_SPAWN_OBJECT,
+    /// Drone spawned at a transform.
+    LC_SPAWN_DRONE,
+    /// Drone control display moved to a position.
+    LC_MOVE_SCREEN,
+    /// Shared animation poses toggled.
+    LC_TOGGLE_POSES,
+    /// Agent node ordered to a FlowField goal.
+    LC_AGENT_GOAL,
+    /// State hash at the end of a tick. Written by the Lockstep component itself.
+    LC_STATE_HASH,
+    /// Physics level of detail toggled. Added after the hash to keep the values of existing recordings.
+    LC_TOGGLE_PHYSICS_LOD
+};
+
+/// One command of the simulation input stream.
+struct LockstepCommand {
+    /// Tick the command is executed on.
+    unsigned tick_;
+    /// Command type.
+    LockstepCommandType type_;
+    /// Position of transform commands.
+    Urho3D::Vector3 position_;
+    /// Rotation of transform commands.
+    Urho3D::Quaternion rotation_;
+    /// Node id of agent orders, or the state hash.
+    unsigned target_;
+    /// Goal of agent orders.
+    unsigned value_;
+};
+
+/// Lockstep options read from the command line: -seed <n>, -record <file> and -replay <file>.
+struct LockstepOptions {
+    /// Read the options from the program arguments.
+    static LockstepOptions FromArguments(const Urho3D::Vector<Urho3D::String> &arguments);
+    /// Return whether the simulation has to be reproducible.
+    bool IsDeterministic() const { return hasSeed_ || !recordPath_.Empty() || !replayPath_.Empty(); }
+
+    /// Master seed.
+    unsigned seed_ = 0;
+    /// Whether the seed was given.
+    bool hasSeed_ = false;
+    /// File to record the command stream to.
+    Urho3D::String recordPath_;
+    /// File to replay the command stream from.
+    Urho3D::String replayPath_;
+};
+
+/// Deterministic simulation support. Hands out seeded random streams per subsystem and carries the command stream of
+/// a run: commands submitted from input are executed on the tick they were taken, and can be recorded to a compact
+/// binary file together with a hash of the scene state after every tick. A replay executes the recorded commands
+/// instead of live input and checks the state hash of every tick. Reproducing a run needs the fixed timestep.
+class Lockstep : public Urho3D::Component {
+    URHO3D_OBJECT(Lockstep, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit Lockstep(Urho3D::Context *context);
+    /// Destruct. Closes the recording.
+    ~Lockstep() override;
+
+    /// Seed the streams and open the recording or the replay. Return false if a file could not be opened.
+    bool Start(const LockstepOptions &options);
+    /// Return the random stream of a subsystem.
+    RandomStream &GetStream(const Urho3D::String &name);
+    /// Submit a command from live input, executed on the next TakeCommands. Ignored while replaying.
+    void Submit(const LockstepCommand &command);
+    /// Return the commands to execute on the current tick and record them.
+    void TakeCommands(std::vector<LockstepCommand> &commands);
+    /// Return hash of the positions and rotations of the scene's top-level nodes.
+    unsigned ComputeStateHash() const;
+
+    /// Return master seed.
+    unsigned GetSeed() const { return seed_; }
+    /// Return current tick.
+    unsigned GetTick() const { return tick_; }
+    /// Return whether recording.
+    bool IsRecording() const { return recordFile_ != nullptr; }
+    /// Return whether replaying.
+    bool IsReplaying() const { return replaying_; }
+    /// Return number of ticks whose state hash differed from the replay.
+    unsigned GetNumMismatches() const { return numMismatches_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// Handle the scene post-update event, the end of a tick.
+    void HandleScenePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Write a command to the recording.
+    void Write(const LockstepCommand &command);
+    /// Read a whole recording. Return false if it is not a valid recording.
+    bool ReadReplay(Urho3D::File &file);
+    /// End the replay and announce the result.
+    void FinishReplay();
+
+    /// Master seed.
+    unsigned seed_;
+    /// Current tick.
+    unsigned tick_;
+    /// Random streams by subsystem name.
+    Urho3D::HashMap<Urho3D::StringHash, RandomStream> streams_;
+    /// Commands submitted for the current tick.
+    std::vector<LockstepCommand> pending_;
+    /// Recording file, null when not recording.
+    Urho3D::SharedPtr<Urho3D::File> recordFile_;
+    /// Tick of the last written command, the file stores tick deltas.
+    unsigned lastWrittenTick_;
+    /// Replayed commands in tick order.
+    std::vector<LockstepCommand> replay_;
+    /// Next replayed command.
+    unsigned replayIndex_;
+    /// Recorded state hash per tick.
+    std::vector<unsigned> replayHashes_;
+    /// Whether replaying.
+    bool replaying_;
+    /// Number of ticks whose state hash differed from the replay.
+    unsigned numMismatches_;
+};
+
+#endif //AIBATTLEGROUND_LOCKSTEP_HPP
@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Graphics/Terrain.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "FlowField.hpp"
+#include "PathService.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Length of a diagonal step.
+const float SQRT2 = 1.41421356f;
+/// Neighbour offsets, orthogonal first.
+const int NEIGHBOUR_X[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+const int NEIGHBOUR_Z[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+/// Neighbour step lengths.
+const float NEIGHBOUR_LENGTH[8] = {1.0f, 1.0f, 1.0f, 1.0f, SQRT2, SQRT2, SQRT2, SQRT2};
+
+/// A* over an 8-connected grid. The cost function returns the cost of entering a cell, 0 for impassable; minCost is a
+/// lower bound of it for the heuristic. Fill the cell path from start to goal and return whether one was found.
+bool FindGridPath(unsigned width, unsigned height, unsigned start, unsigned goal,
+                  const std::function<float(unsigned)> &cost, float minCost, std::vector<unsigned> &path) {
+    path.clear();
+    const auto goalX = (int) (goal%width);
+    const auto goalZ = (int) (goal/width);
+    auto heuristic = [&](unsigned cell) {
+        // Octile distance
+        const int dx = Abs((int) (cell%width) - goalX);
+        const int dz = Abs((int) (cell/width) - goalZ);
+        return ((float) Max(dx, dz) + (SQRT2 - 1.0f)*(float) Min(dx, dz))*minCost;
+    };
+
+    std::vector<float> distances(width*height, M_INFINITY);
+    std::vector<unsigned> parents(width*height, M_MAX_UNSIGNED);
+    using Entry = std::pair<float, unsigned>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    distances[start] = 0.0f;
+    open.emplace(heuristic(start), start);
+
+    while (!open.empty()) {
+        const unsigned current = open.top().second;
+        const float estimate = open.top().first;
+        open.pop();
+        if (current == goal)
+            break;
+        if (estimate > distances[current] + heuristic(current))
+            continue;
+
+        const auto cx = (int) (current%width);
+        const auto cz = (int) (current/width);
+        for (unsigned n = 0; n < 8; ++n) {
+            const int nx = cx + NEIGHBOUR_X[n];
+            const int nz = cz + NEIGHBOUR_Z[n];
+            if (nx < 0 || nz < 0 || nx >= (int) width || nz >= (int) height)
+                continue;
+            const unsigned neighbour = nz*width + nx;
+            const float neighbourCost = cost(neighbour);
+            if (neighbourCost <= 0.0f)
+                continue;
+            // Do not cut corners of impassable cells diagonally
+            if (n >= 4 && (cost(cz*width + nx) <= 0.0f || cost(nz*width + cx) <= 0.0f))
+                continue;
+
+            const float distance = distances[current] + NEIGHBOUR_LENGTH[n]*neighbourCost;
+            if (distance < distances[neighbour]) {
+                distances[neighbour] = distance;
+                parents[neighbour] = current;
+                open.emplace(distance + heuristic(neighbour), neighbour);
+            }
+        }
+    }
+
+    if (distances[goal] == M_INFINITY)
+        return false;
+    for (unsigned cell = goal; cell != M_MAX_UNSIGNED; cell = parents[cell])
+        path.push_back(cell);
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+/// Keep only the cells of a path where its direction changes, and its end points.
+void SimplifyPath(unsigned width, std::vector<unsigned> &path) {
+    if (path.size() < 3)
+        return;
+
+    std::vector<unsigned> simplified;
+    simplified.push_back(path.front());
+    for (unsigned i = 1; i + 1 < path.size(); ++i) {
+        const int inX = (int) (path[i]%width) - (int) (path[i - 1]%width);
+        const int inZ = (int) (path[i]/width) - (int) (path[i - 1]/width);
+        const int outX = (int) (path[i + 1]%width) - (int) (path[i]%width);
+        const int outZ = (int) (path[i + 1]/width) - (int) (path[i]/width);
+        if (inX != outX || inZ != outZ)
+            simplified.push_back(path[i]);
+    }
+    simplified.push_back(path.back());
+    path.swap(simplified);
+}
+
+}
+
+PathService::PathService(Context *context) :
+  Component(context),
+  clusterSize_(16),
+  width_(0),
+  clustersX_(0),
+  clustersZ_(0),
+  nextId_(1),
+  cacheSize_(256),
+  maxSearchesPerFrame_(4),
+  maxSearchesInFlight_(8),
+  synchronous_(false),
+  cacheHits_(0),
+  cacheMisses_(0) {
+}
+
+PathService::~PathService() {
+    WaitForSearches();
+}
+
+void PathService::SetCacheSize(unsigned size) {
+    cacheSize_ = size;
+    while (cache_.size() > cacheSize_) {
+        cacheIndex_.erase(cache_.back().first);
+        cache_.pop_back();
+    }
+}
+
+void PathService::Build(FlowField *field) {
+    // The searches in flight read the cluster grid. Pending requests refer to the old grid and fail
+    WaitForSearches();
+    for (auto &request : running_)
+        ready_.push_back(std::move(request));
+    for (auto &request : queued_)
+        ready_.push_back(std::move(request));
+    running_.clear();
+    queued_.clear();
+    for (auto &request : ready_) {
+        request->success_ = false;
+        request->cells_.clear();
+    }
+
+    field_ = field;
+    cache_.clear();
+    cacheIndex_.clear();
+    clusterCosts_.clear();
+    width_ = 0;
+    clustersX_ = 0;
+    clustersZ_ = 0;
+    if (!field || !field->GetWidth())
+        return;
+
+    width_ = field->GetWidth();
+    const unsigned width = width_;
+    const unsigned height = field->GetHeight();
+    clustersX_ = (width + clusterSize_ - 1)/clusterSize_;
+    clustersZ_ = (height + clusterSize_ - 1)/clusterSize_;
+    clusterCosts_.assign(clustersX_*clustersZ_, 0.0f);
+
+    // A cluster costs the average of its passable cells scaled to the cluster size, so coarse routes prefer open ground
+    std::vector<unsigned> passable(clusterCosts_.size(), 0);
+    for (unsigned z = 0; z < height; ++z) {
+        for (unsigned x = 0; x < width; ++x) {
+            const unsigned char cost = field->GetCellCost(z*width + x);
+            if (!cost)
+                continue;
+            const unsigned cluster = (z/clusterSize_)*clustersX_ + x/clusterSize_;
+            clusterCosts_[cluster] += cost;
+            ++passable[cluster];
+        }
+    }
+    for (unsigned i = 0; i < clusterCosts_.size(); ++i) {
+        if (passable[i])
+            clusterCosts_[i] = clusterCosts_[i]/passable[i]*clusterSize_;
+    }
+}
+
+unsigned PathService::RequestPath(const Vector3 &start, const Vector3 &goal) {
+    std::unique_ptr<Request> request(new Request{this, nextId_++, 0, 0, {}, false, false, nullptr});
+    if (nextId_ == M_MAX_UNSIGNED)
+        nextId_ = 1;
+
+    FlowField *field = field_;
+    if (!field || clusterCosts_.empty()) {
+        // Nothing to search, fail on the next update
+        ready_.push_back(std::move(request));
+        return ready_.back()->id_;
+    }
+
+    request->startCell_ = field->FindPassableCell(field->GetCell(start.x_, start.z_));
+    request->goalCell_ = field->FindPassableCell(field->GetCell(goal.x_, goal.z_));
+
+    auto cached = cacheIndex_.find(GetCacheKey(*request));
+    if (cached != cacheIndex_.end()) {
+        // Requests between the same clusters share the route, only the end point is the request's own
+        cache_.splice(cache_.begin(), cache_, cached->second);
+        request->cells_ = cached->second->second;
+        request->cells_.back() = request->goalCell_;
+        request->success_ = true;
+        ++cacheHits_;
+        ready_.push_back(std::move(request));
+        return ready_.back()->id_;
+    }
+
+    ++cacheMisses_;
+    queued_.push_back(std::move(request));
+    return queued_.back()->id_;
+}
+
+void PathService::CancelRequest(unsigned id) {
+    for (auto i = queued_.begin(); i != queued_.end(); ++i) {
+        if ((*i)->id_ == id) {
+            queued_.erase(i);
+            return;
+        }
+    }
+    // Running searches cannot be stopped, their result is dropped instead
+    for (auto &request : running_) {
+        if (request->id_ == id)
+            request->cancelled_ = true;
+    }
+    for (auto &request : ready_) {
+        if (request->id_ == id)
+            request->cancelled_ = true;
+    }
+}
+
+void PathService::OnSceneSet(Scene *scene) {
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(PathService, HandleSceneUpdate));
+    else
+        UnsubscribeFromEvent(E_SCENEUPDATE);
+}
+
+void PathService::HandleSceneUpdate(StringHash eventType, VariantMap &eventData) {
+    // Collect the finished requests first, the event handlers may queue new ones
+    std::vector<std::unique_ptr<Request>> finished;
+    finished.swap(ready_);
+    for (auto i = running_.begin(); i != running_.end();) {
+        if ((*i)->item_->completed_) {
+            finished.push_back(std::move(*i));
+            i = running_.erase(i);
+        } else
+            ++i;
+    }
+
+    // Low priority items do not hold up the frame's own parallel work, the budget keeps them from piling up
+    auto *queue = GetSubsystem<WorkQueue>();
+    unsigned started = 0;
+    while (!queued_.empty() && started < maxSearchesPerFrame_ && running_.size() < maxSearchesInFlight_) {
+        std::unique_ptr<Request> request = std::move(queued_.front());
+        queued_.pop_front();
+
+        // Not taken from the pool so that the item keeps its completed flag after the queue purges it
+        request->item_ = new WorkItem();
+        request->item_->priority_ = 0;
+        request->item_->workFunction_ = SearchWork;
+        request->item_->aux_ = request.get();
+        running_.push_back(std::move(request));
+        queue->AddWorkItem(running_.back()->item_);
+        ++started;
+    }
+
+    if (synchronous_ && !running_.empty()) {
+        queue->Complete(0);
+        for (auto &request : running_)
+            finished.push_back(std::move(request));
+        running_.clear();
+    }
+
+    for (auto &request : finished) {
+        if (!request->cancelled_)
+            Deliver(*request);
+    }
+
+    if (auto *debugHud = GetSubsystem<DebugHud>()) {
+        debugHud->SetAppStats("Paths queued", GetNumQueued() + GetNumInFlight());
+        debugHud->SetAppStats("Path cache hits", String(cacheHits_) + " / " + String(cacheHits_ + cacheMisses_));
+    }
+}
+
+void PathService::SearchWork(const WorkItem *item, unsigned threadIndex) {
+    auto *request = static_cast<Request *>(item->aux_);
+    request->service_->Search(*request);
+}
+
+void PathService::Search(Request &request) const {
+    const FlowField *field = field_.Get();
+    const unsigned width = width_;
+    const unsigned height = field->GetHeight();
+
+    // Coarse route between the clusters
+    std::vector<unsigned> clusters;
+    const bool coarseFound = FindGridPath(clustersX_, clustersZ_, GetCluster(request.startCell_),
+                                          GetCluster(request.goalCell_),
+                                          [this](unsigned cluster) { return clusterCosts_[cluster]; },
+                                          (float) clusterSize_, clusters);
+
+    // Refine over the fine cells of the route and its neighbouring clusters
+    if (coarseFound) {
+        std::vector<unsigned char> corridor(clusterCosts_.size(), 0);
+        for (unsigned cluster : clusters) {
+            const auto cx = (int) (cluster%clustersX_);
+            const auto cz = (int) (cluster/clustersX_);
+            for (int z = Max(cz - 1, 0); z <= Min(cz + 1, (int) clustersZ_ - 1); ++z) {
+                for (int x = Max(cx - 1, 0); x <= Min(cx + 1, (int) clustersX_ - 1); ++x)
+                    corridor[z*clustersX_ + x] = 1;
+            }
+        }
+        request.success_ = FindGridPath(width, height, request.startCell_, request.goalCell_,
+                                        [&](unsigned cell) {
+                                            return corridor[GetCluster(cell)] ? (float) field->GetCellCost(cell) : 0.0f;
+                                        }, 1.0f, request.cells_);
+    }
+
+    // The averaged clusters can miss narrow passages, fall back to the whole grid
+    if (!request.success_)
+        request.success_ = FindGridPath(width, height, request.startCell_, request.goalCell_,
+                                        [field](unsigned cell) { return (float) field->GetCellCost(cell); }, 1.0f,
+                                        request.cells_);
+
+    SimplifyPath(width, request.cells_);
+}
+
+void PathService::Deliver(Request &request) {
+    using namespace PathReady;
+
+    FlowField *field = field_;
+    VariantVector path;
+    if (request.success_ && field) {
+        if (cacheSize_ && !cacheIndex_.count(GetCacheKey(request))) {
+            cache_.emplace_front(GetCacheKey(request), request.cells_);
+            cacheIndex_[GetCacheKey(request)] = cache_.begin();
+            if (cache_.size() > cacheSize_) {
+                cacheIndex_.erase(cache_.back().first);
+                cache_.pop_back();
+            }
+        }
+
+        Terrain *terrain = field->GetTerrain();
+        for (unsigned i = 1; i < request.cells_.size(); ++i) {
+            Vector3 waypoint = field->GetCellCenter(request.cells_[i]);
+            if (terrain)
+                waypoint.y_ = terrain->GetHeight(waypoint);
+            path.Push(waypoint);
+        }
+        // Start and goal in the same cell
+        if (path.Empty())
+            path.Push(field->GetCellCenter(request.goalCell_));
+    }
+
+    VariantMap &eventData = GetEventDataMap();
+    eventData[P_REQUEST] = request.id_;
+    eventData[P_SUCCESS] = request.success_ && field;
+    eventData[P_PATH] = path;
+    SendEvent(E_PATHREADY, eventData);
+}
+
+void PathService::WaitForSearches() {
+    auto *queue = GetSubsystem<WorkQueue>();
+    bool started = false;
+    for (auto &request : running_) {
+        if (!request->item_->completed_ && !queue->RemoveWorkItem(request->item_))
+            started = true;
+    }
+    // Searches already picked up by a worker thread cannot be removed
+    if (started)
+        queue->Complete(0);
+}
+
+unsigned long long PathService::GetCacheKey(const Request &request) const {
+    return (unsigned long long) GetCluster(request.startCell_)*clusterCosts_.size() + GetCluster(request.goalCell_);
+}
+
+unsigned PathService::GetCluster(unsigned cell) const {
+    return ((cell/width_)/clusterSize_)*clustersX_ + (cell%width_)/clusterSize_;
+}
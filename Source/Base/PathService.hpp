@@ -0,0 +1,131 @@
+#ifndef AIBATTLEGROUND_PATHSERVICE_HPP
+#define AIBATTLEGROUND_PATHSERVICE_HPP
+
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Scene/Component.h>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class FlowField;
+
+/// Path request finished. Sent by the PathService on a frame after the request was made.
+URHO3D_EVENT(E_PATHREADY, PathReady) {
+    URHO3D_PARAM(P_REQUEST, Request);   // unsigned
+    URHO3D_PARAM(P_SUCCESS, Success);   // bool
+    URHO3D_PARAM(P_PATH, Path);         // VariantVector of Vector3 waypoints, start excluded
+}
+
+/// Point-to-point path requests over the FlowField cost grid. Requests are queued and searched on the WorkQueue worker
+/// threads at low priority: first over a coarse grid of clusters, then over the fine cells of the clusters along the
+/// coarse route. Results are cached per pair of start and goal clusters and announced with E_PATHREADY. At most a fixed
+/// number of searches are started per frame and kept in flight, so request bursts are spread over several frames.
+class PathService : public Urho3D::Component {
+    URHO3D_OBJECT(PathService, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit PathService(Urho3D::Context *context);
+    /// Destruct. Waits for the searches in flight.
+    ~PathService() override;
+
+    /// Set cluster size in cells. Takes effect on the next Build.
+    void SetClusterSize(unsigned cells) { clusterSize_ = Urho3D::Max(cells, 1u); }
+    /// Set maximum number of cached paths.
+    void SetCacheSize(unsigned size);
+    /// Set maximum number of searches started per frame.
+    void SetMaxSearchesPerFrame(unsigned count) { maxSearchesPerFrame_ = Urho3D::Max(count, 1u); }
+    /// Set maximum number of searches running at the same time.
+    void SetMaxSearchesInFlight(unsigned count) { maxSearchesInFlight_ = Urho3D::Max(count, 1u); }
+    /// Set whether searches finish within the update they are started in. Makes result delivery independent of the
+    /// worker thread timing, as needed for reproducible runs.
+    void SetSynchronous(bool enable) { synchronous_ = enable; }
+
+    /// Build the cluster grid from a flow field's cost grid. Clears the cache.
+    void Build(FlowField *field);
+    /// Queue a path request. Return request id.
+    unsigned RequestPath(const Urho3D::Vector3 &start, const Urho3D::Vector3 &goal);
+    /// Cancel a request. No event is sent for it.
+    void CancelRequest(unsigned id);
+
+    /// Return number of requests waiting for a search.
+    unsigned GetNumQueued() const { return (unsigned) queued_.size(); }
+    /// Return number of searches running.
+    unsigned GetNumInFlight() const { return (unsigned) running_.size(); }
+    /// Return number of requests answered from the cache.
+    unsigned GetNumCacheHits() const { return cacheHits_; }
+    /// Return number of requests that needed a search.
+    unsigned GetNumCacheMisses() const { return cacheMisses_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// One path request.
+    struct Request {
+        PathService *service_;
+        unsigned id_;
+        unsigned startCell_;
+        unsigned goalCell_;
+        /// Simplified fine cell path, filled by the search.
+        std::vector<unsigned> cells_;
+        bool success_;
+        bool cancelled_;
+        Urho3D::SharedPtr<Urho3D::WorkItem> item_;
+    };
+
+    /// Handle the scene update event.
+    void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Work item function running one search.
+    static void SearchWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+    /// Search the path of a request. Only reads the cost grids.
+    void Search(Request &request) const;
+    /// Send the result of a finished request and cache it.
+    void Deliver(Request &request);
+    /// Wait until no search is running.
+    void WaitForSearches();
+    /// Return cache key of a request.
+    unsigned long long GetCacheKey(const Request &request) const;
+    /// Return cluster of a fine cell.
+    unsigned GetCluster(unsigned cell) const;
+
+    /// Flow field providing the fine cost grid.
+    Urho3D::WeakPtr<FlowField> field_;
+    /// Cluster size in cells.
+    unsigned clusterSize_;
+    /// Number of fine cell columns.
+    unsigned width_;
+    /// Number of cluster columns and rows.
+    unsigned clustersX_;
+    unsigned clustersZ_;
+    /// Average traversal cost per cluster, 0 when the cluster has no passable cell.
+    std::vector<float> clusterCosts_;
+    /// Next request id.
+    unsigned nextId_;
+    /// Requests waiting for a search.
+    std::deque<std::unique_ptr<Request>> queued_;
+    /// Requests being searched.
+    std::vector<std::unique_ptr<Request>> running_;
+    /// Requests answered from the cache, delivered on the next update.
+    std::vector<std::unique_ptr<Request>> ready_;
+    /// Cached paths, most recently used first.
+    std::list<std::pair<unsigned long long, std::vector<unsigned>>> cache_;
+    /// Cache entries by key.
+    std::unordered_map<unsigned long long, decltype(cache_)::iterator> cacheIndex_;
+    /// Maximum number of cached paths.
+    unsigned cacheSize_;
+    /// Maximum number of searches started per frame.
+    unsigned maxSearchesPerFrame_;
+    /// Maximum number of searches running at the same time.
+    unsigned maxSearchesInFlight_;
+    /// Whether searches finish within the update they are started in.
+    bool synchronous_;
+    /// Cache statistics.
+    unsigned cacheHits_;
+    unsigned cacheMisses_;
+};
+
+#endif //AIBATTLEGROUND_PATHSERVICE_HPP
@@ -0,0 +1,221 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "PhysicsLod.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Weight of the latest frame in the averaged step time.
+const float STEP_TIME_SMOOTHING = 0.05f;
+/// Height difference below which a kinematic body is not moved to the terrain.
+const float SNAP_TOLERANCE = 0.01f;
+/// Node variable with the mode of a managed body.
+const StringHash VAR_PHYSICS_LOD_MODE("PhysicsLodMode");
+
+}
+
+PhysicsLod::PhysicsLod(Context *context) :
+  Component(context),
+  margin_(50.0f),
+  checksPerFrame_(200),
+  nextCheck_(0),
+  numReduced_(0),
+  numActive_(0),
+  frameStepUSec_(0),
+  stepTime_(0.0f) {
+}
+
+PhysicsLod::~PhysicsLod() = default;
+
+void PhysicsLod::AddObserver(Node *node, float radius) {
+    if (!node)
+        return;
+    for (Observer &observer : observers_) {
+        if (observer.node_ == node) {
+            observer.radius_ = radius;
+            return;
+        }
+    }
+    observers_.push_back(Observer{WeakPtr<Node>(node), radius});
+}
+
+void PhysicsLod::AddBody(RigidBody *body, PhysicsLodMode mode) {
+    if (!body)
+        return;
+
+    bodies_.push_back(Body{WeakPtr<RigidBody>(body), mode, false});
+    // Kept on the node so that the body is managed again after a load
+    body->GetNode()->SetVar(VAR_PHYSICS_LOD_MODE, (int) mode);
+}
+
+void PhysicsLod::RestoreBodies() {
+    Scene *scene = GetScene();
+    if (!scene)
+        return;
+
+    PODVector<Node *> nodes;
+    scene->GetChildren(nodes, true);
+    for (Node *node : nodes) {
+        const Variant &mode = node->GetVar(VAR_PHYSICS_LOD_MODE);
+        auto *rigidBody = node->GetComponent<RigidBody>();
+        if (mode.IsEmpty() || !rigidBody)
+            continue;
+
+        // A body saved while reduced was loaded removed or kinematic, it starts out dynamic like a new one
+        Body body{WeakPtr<RigidBody>(rigidBody), (PhysicsLodMode) mode.GetInt(), false};
+        body.reduced_ = body.mode_ == PLOD_REMOVE ? !rigidBody->IsEnabled() : rigidBody->IsKinematic();
+        if (body.reduced_)
+            Promote(body);
+        bodies_.push_back(body);
+    }
+}
+
+void PhysicsLod::OnSceneSet(Scene *scene) {
+    if (scene) {
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(PhysicsLod, HandleScenePostUpdate));
+        SubscribeToEvent(E_PHYSICSPRESTEP, URHO3D_HANDLER(PhysicsLod, HandlePhysicsPreStep));
+        SubscribeToEvent(E_PHYSICSPOSTSTEP, URHO3D_HANDLER(PhysicsLod, HandlePhysicsPostStep));
+    } else {
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+        UnsubscribeFromEvent(E_PHYSICSPRESTEP);
+        UnsubscribeFromEvent(E_PHYSICSPOSTSTEP);
+    }
+}
+
+void PhysicsLod::OnSetEnabled() {
+    URHO3D_LOGINFOF("Physics LOD %s: %u of %u managed bodies active, %.2f ms physics step",
+                    IsEnabledEffective() ? "on" : "off", numActive_, GetNumBodies(), stepTime_);
+    if (IsEnabledEffective())
+        return;
+
+    for (Body &body : bodies_) {
+        if (body.reduced_ && body.body_)
+            Promote(body);
+    }
+    numReduced_ = 0;
+}
+
+void PhysicsLod::HandleScenePostUpdate(StringHash eventType, VariantMap &eventData) {
+    if (IsEnabledEffective() && !bodies_.empty()) {
+        // Check a slice of the bodies, the order is fixed so that reproducible runs reduce the same bodies
+        const unsigned numChecks = Min(checksPerFrame_, (unsigned) bodies_.size());
+        for (unsigned i = 0; i < numChecks && !bodies_.empty(); ++i) {
+            if (nextCheck_ >= bodies_.size())
+                nextCheck_ = 0;
+
+            Body &body = bodies_[nextCheck_];
+            if (!body.body_) {
+                // Destroyed, swap with the last body and check the moved one next
+                if (body.reduced_)
+                    --numReduced_;
+                body = bodies_.back();
+                bodies_.pop_back();
+                continue;
+            }
+
+            const float distance = GetObserverDistance(body.body_->GetNode()->GetWorldPosition());
+            if (body.reduced_ && distance < 0.0f) {
+                Promote(body);
+                --numReduced_;
+            } else if (!body.reduced_ && distance > margin_ && Reduce(body)) {
+                ++numReduced_;
+            }
+            ++nextCheck_;
+        }
+    }
+
+    // Kinematic bodies are moved by their owner on the plane only, they follow the terrain here
+    numActive_ = 0;
+    for (Body &body : bodies_) {
+        RigidBody *rigidBody = body.body_;
+        if (!rigidBody)
+            continue;
+
+        if (body.reduced_ && body.mode_ == PLOD_KINEMATIC) {
+            if (!terrain_)
+                terrain_ = GetScene()->GetComponent<Terrain>(true);
+            if (terrain_) {
+                Node *node = rigidBody->GetNode();
+                Vector3 position = node->GetWorldPosition();
+                const float height = terrain_->GetHeight(position);
+                if (Abs(position.y_ - height) > SNAP_TOLERANCE) {
+                    position.y_ = height;
+                    node->SetWorldPosition(position);
+                }
+            }
+        } else if (rigidBody->IsEnabledEffective() && !rigidBody->IsKinematic() && rigidBody->IsActive()) {
+            ++numActive_;
+        }
+    }
+
+    stepTime_ = Lerp(stepTime_, (float) frameStepUSec_/1000.0f, STEP_TIME_SMOOTHING);
+    frameStepUSec_ = 0;
+
+    if (auto *debugHud = GetSubsystem<DebugHud>()) {
+        debugHud->SetAppStats("Physics bodies active", numActive_);
+        debugHud->SetAppStats("Physics bodies reduced", numReduced_);
+        debugHud->SetAppStats("Physics step ms", String(stepTime_));
+    }
+}
+
+void PhysicsLod::HandlePhysicsPreStep(StringHash eventType, VariantMap &eventData) {
+    using namespace PhysicsPreStep;
+
+    auto *world = static_cast<PhysicsWorld *>(eventData[P_WORLD].GetPtr());
+    if (world && world->GetScene() == GetScene())
+        stepTimer_.Reset();
+}
+
+void PhysicsLod::HandlePhysicsPostStep(StringHash eventType, VariantMap &eventData) {
+    using namespace PhysicsPostStep;
+
+    // Sent once per internal substep, the substeps of a frame are added up
+    auto *world = static_cast<PhysicsWorld *>(eventData[P_WORLD].GetPtr());
+    if (world && world->GetScene() == GetScene())
+        frameStepUSec_ += stepTimer_.GetUSec(false);
+}
+
+float PhysicsLod::GetObserverDistance(const Vector3 &position) const {
+    float distance = M_INFINITY;
+    for (const Observer &observer : observers_) {
+        if (observer.node_ && observer.node_->IsEnabled())
+            distance = Min(distance, (observer.node_->GetWorldPosition() - position).Length() - observer.radius_);
+    }
+    return distance;
+}
+
+bool PhysicsLod::Reduce(Body &body) {
+    RigidBody *rigidBody = body.body_;
+    if (body.mode_ == PLOD_REMOVE) {
+        // A prop still falling or rolling finishes its motion first, it would otherwise freeze mid-air
+        if (rigidBody->IsActive())
+            return false;
+        rigidBody->SetEnabled(false);
+    } else {
+        rigidBody->SetLinearVelocity(Vector3::ZERO);
+        rigidBody->SetKinematic(true);
+    }
+    body.reduced_ = true;
+    return true;
+}
+
+void PhysicsLod::Promote(Body &body) {
+    RigidBody *rigidBody = body.body_;
+    if (body.mode_ == PLOD_REMOVE) {
+        rigidBody->SetEnabled(true);
+    } else {
+        // The body starts from rest on the terrain, so it does not jump when gravity takes over again
+        rigidBody->SetKinematic(false);
+        rigidBody->SetLinearVelocity(Vector3::ZERO);
+        rigidBody->ResetForces();
+        rigidBody->Activate();
+    }
+    body.reduced_ = false;
+}
@@ -0,0 +1,115 @@
+#ifndef AIBATTLEGROUND_PHYSICSLOD_HPP
+#define AIBATTLEGROUND_PHYSICSLOD_HPP
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Terrain.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Component.h>
+#include <vector>
+
+/// How a body is simplified while nothing observes it.
+enum PhysicsLodMode {
+    /// Removed from the physics world once asleep. For props.
+    PLOD_REMOVE = 0,
+    /// Made kinematic and snapped to the terrain, whatever moves the node keeps moving it. For agents.
+    PLOD_KINEMATIC
+};
+
+/// Physics level of detail. Bodies far from every observer leave the dynamics simulation: props are removed from the
+/// physics world once they have come to rest, agents become kinematic bodies that follow the terrain height. A body is
+/// promoted back to a full dynamic body as soon as an observer comes within its radius, and is reduced again only once
+/// every observer is a margin further away, so bodies near the border do not flip every frame. A limited number of
+/// bodies is checked per frame in a fixed order. Disabling the component promotes every body, which together with the
+/// active body count and the step time on the debug HUD gives a before and after comparison. The reduced state is
+/// saved with the bodies; after a load, RestoreBodies finds the managed bodies through a node variable and makes them
+/// dynamic again.
+class PhysicsLod : public Urho3D::Component {
+    URHO3D_OBJECT(PhysicsLod, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit PhysicsLod(Urho3D::Context *context);
+    /// Destruct.
+    ~PhysicsLod() override;
+
+    /// Add a node that keeps bodies within a radius dynamic while it is enabled, such as the camera.
+    void AddObserver(Urho3D::Node *node, float radius);
+    /// Set distance beyond an observer's radius at which bodies are reduced again.
+    void SetMargin(float margin) { margin_ = Urho3D::Max(margin, 0.0f); }
+    /// Set number of bodies checked per frame.
+    void SetChecksPerFrame(unsigned count) { checksPerFrame_ = Urho3D::Max(count, 1u); }
+    /// Manage a body.
+    void AddBody(Urho3D::RigidBody *body, PhysicsLodMode mode);
+    /// Manage the bodies of a loaded scene that were managed when it was saved, promoting those saved while reduced.
+    void RestoreBodies();
+
+    /// Return distance beyond the observer radius at which bodies are reduced.
+    float GetMargin() const { return margin_; }
+    /// Return number of bodies checked per frame.
+    unsigned GetChecksPerFrame() const { return checksPerFrame_; }
+    /// Return number of managed bodies.
+    unsigned GetNumBodies() const { return (unsigned) bodies_.size(); }
+    /// Return number of managed bodies currently reduced.
+    unsigned GetNumReduced() const { return numReduced_; }
+    /// Return number of managed bodies simulated as awake dynamic bodies in the last frame.
+    unsigned GetNumActive() const { return numActive_; }
+    /// Return time spent stepping the physics world, averaged over recent frames, in milliseconds.
+    float GetStepTime() const { return stepTime_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+    /// Handle enabled/disabled state change.
+    void OnSetEnabled() override;
+
+ private:
+    /// Observer node and radius.
+    struct Observer {
+        Urho3D::WeakPtr<Urho3D::Node> node_;
+        float radius_;
+    };
+    /// Managed body.
+    struct Body {
+        Urho3D::WeakPtr<Urho3D::RigidBody> body_;
+        PhysicsLodMode mode_;
+        bool reduced_;
+    };
+
+    /// Handle the scene post-update event.
+    void HandleScenePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the physics pre-step event.
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the physics post-step event.
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Return the smallest distance from a position to the edge of an observer radius, negative inside one.
+    float GetObserverDistance(const Urho3D::Vector3 &position) const;
+    /// Take a body out of the dynamics simulation. Return false if it has to stay dynamic for now.
+    bool Reduce(Body &body);
+    /// Make a body fully dynamic again.
+    void Promote(Body &body);
+
+    /// Observers.
+    std::vector<Observer> observers_;
+    /// Managed bodies.
+    std::vector<Body> bodies_;
+    /// Terrain the kinematic bodies are snapped to.
+    Urho3D::WeakPtr<Urho3D::Terrain> terrain_;
+    /// Distance beyond the observer radius at which bodies are reduced.
+    float margin_;
+    /// Bodies checked per frame.
+    unsigned checksPerFrame_;
+    /// Next body to check.
+    unsigned nextCheck_;
+    /// Reduced bodies.
+    unsigned numReduced_;
+    /// Awake dynamic bodies in the last frame.
+    unsigned numActive_;
+    /// Timer of the current physics step.
+    Urho3D::HiresTimer stepTimer_;
+    /// Physics step time of the current frame in microseconds.
+    long long frameStepUSec_;
+    /// Averaged physics step time in milliseconds.
+    float stepTime_;
+};
+
+#endif //AIBATTLEGROUND_PHYSICSLOD_HPP
@@ -0,0 +1,202 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/Scene.h>
+#include <vector>
+
+#ifdef AIBATTLEGROUND_BULLET_MT
+#include <Bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <Bullet/LinearMath/btThreads.h>
+#endif
+
+#include "PhysicsThreading.hpp"
+#include "TraceRecorder.hpp"
+
+using namespace Urho3D;
+
+#ifdef AIBATTLEGROUND_BULLET_MT
+namespace {
+
+/// One slice of a Bullet parallel loop.
+struct ParallelTask {
+    const btIParallelForBody *forBody_;
+    const btIParallelSumBody *sumBody_;
+    int begin_;
+    int end_;
+    btScalar sum_;
+};
+
+/// Run a slice of a Bullet parallel loop on a WorkQueue thread.
+void ParallelTaskWork(const WorkItem *item, unsigned threadIndex) {
+    AIBG_TRACE(PhysicsParallelLoop);
+    auto *task = static_cast<ParallelTask *>(item->aux_);
+    if (task->forBody_)
+        task->forBody_->forLoop(task->begin_, task->end_);
+    else
+        task->sum_ = task->sumBody_->sumLoop(task->begin_, task->end_);
+}
+
+/// Bullet task scheduler on the engine WorkQueue. Bullet only starts parallel loops from the thread stepping the
+/// world, which takes part in the loop while waiting for the WorkQueue threads to finish theirs.
+class WorkQueueTaskScheduler : public btITaskScheduler {
+ public:
+    explicit WorkQueueTaskScheduler(WorkQueue *queue) :
+      btITaskScheduler("WorkQueue"),
+      queue_(queue),
+      numThreads_(getMaxNumThreads()) {
+    }
+
+    int getMaxNumThreads() const override { return queue_ ? (int) queue_->GetNumThreads() + 1 : 1; }
+    int getNumThreads() const override { return numThreads_; }
+    void setNumThreads(int numThreads) override { numThreads_ = Clamp(numThreads, 1, getMaxNumThreads()); }
+
+    void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body) override {
+        Run(iBegin, iEnd, grainSize, &body, nullptr);
+    }
+
+    btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body) override {
+        return Run(iBegin, iEnd, grainSize, nullptr, &body);
+    }
+
+ private:
+    /// Split a loop into one slice per thread at most, no smaller than the grain size, and wait for all of them.
+    btScalar Run(int begin, int end, int grainSize, const btIParallelForBody *forBody, const btIParallelSumBody *sumBody) {
+        const int count = end - begin;
+        if (count <= 0)
+            return btScalar(0);
+
+        const int numTasks = Clamp((count + Max(grainSize, 1) - 1)/Max(grainSize, 1), 1, numThreads_);
+        if (numTasks == 1) {
+            if (forBody) {
+                forBody->forLoop(begin, end);
+                return btScalar(0);
+            }
+            return sumBody->sumLoop(begin, end);
+        }
+
+        const int perTask = (count + numTasks - 1)/numTasks;
+        tasks_.clear();
+        for (int taskBegin = begin; taskBegin < end; taskBegin += perTask)
+            tasks_.push_back(ParallelTask{forBody, sumBody, taskBegin, Min(taskBegin + perTask, end), btScalar(0)});
+
+        for (ParallelTask &task : tasks_) {
+            SharedPtr<WorkItem> item = queue_->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = ParallelTaskWork;
+            item->aux_ = &task;
+            queue_->AddWorkItem(item);
+        }
+        queue_->Complete(M_MAX_UNSIGNED);
+
+        btScalar sum(0);
+        for (const ParallelTask &task : tasks_)
+            sum += task.sum_;
+        return sum;
+    }
+
+    /// Engine work queue.
+    WorkQueue *queue_;
+    /// Threads used, including the calling one.
+    int numThreads_;
+    /// Slices of the running loop.
+    std::vector<ParallelTask> tasks_;
+};
+
+}
+#endif
+
+PhysicsThreading::PhysicsThreading(Context *context) :
+  Component(context),
+  numThreads_(1),
+  threaded_(false)
+#ifdef AIBATTLEGROUND_BULLET_MT
+  , defaultSolver_(nullptr)
+#endif
+{
+}
+
+PhysicsThreading::~PhysicsThreading() {
+    Restore();
+}
+
+bool PhysicsThreading::IsAvailable() {
+#ifdef AIBATTLEGROUND_BULLET_MT
+    return true;
+#else
+    return false;
+#endif
+}
+
+unsigned PhysicsThreading::ThreadsFromArguments(const Vector<String> &arguments) {
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+        if (arguments[i].ToLower() == "-physicsthreads")
+            return Max(ToUInt(arguments[i + 1]), 1u);
+    }
+    return 1;
+}
+
+void PhysicsThreading::SetNumThreads(unsigned numThreads) {
+    numThreads_ = Max(numThreads, 1u);
+    Apply();
+}
+
+void PhysicsThreading::OnSceneSet(Scene *scene) {
+    if (scene) {
+        physicsWorld_ = scene->GetComponent<PhysicsWorld>();
+        Apply();
+    } else {
+        Restore();
+        physicsWorld_.Reset();
+    }
+}
+
+void PhysicsThreading::OnSetEnabled() {
+    Apply();
+}
+
+void PhysicsThreading::Apply() {
+    if (!physicsWorld_)
+        return;
+    if (numThreads_ <= 1 || !IsEnabledEffective()) {
+        Restore();
+        return;
+    }
+
+#ifdef AIBATTLEGROUND_BULLET_MT
+    btDiscreteDynamicsWorld *world = physicsWorld_->GetWorld();
+    if (!scheduler_)
+        scheduler_ = std::make_unique<WorkQueueTaskScheduler>(GetSubsystem<WorkQueue>());
+    scheduler_->setNumThreads((int) numThreads_);
+    btSetTaskScheduler(scheduler_.get());
+
+    if (!threaded_) {
+        if (!solver_)
+            solver_ = std::make_unique<btSequentialImpulseConstraintSolverMt>();
+        defaultSolver_ = world->getConstraintSolver();
+        world->setConstraintSolver(solver_.get());
+        // All islands reach the solver in one call, which then spreads their contacts over the threads
+        world->getSimulationIslandManager()->setSplitIslands(false);
+        threaded_ = true;
+    }
+    URHO3D_LOGINFOF("Physics solving on %d threads", scheduler_->getNumThreads());
+#else
+    URHO3D_LOGWARNINGF("Physics stays single-threaded, %u threads need a build with AIBATTLEGROUND_BULLET_MT",
+                       numThreads_);
+#endif
+}
+
+void PhysicsThreading::Restore() {
+#ifdef AIBATTLEGROUND_BULLET_MT
+    if (threaded_ && physicsWorld_) {
+        btDiscreteDynamicsWorld *world = physicsWorld_->GetWorld();
+        world->setConstraintSolver(defaultSolver_);
+        world->getSimulationIslandManager()->setSplitIslands(true);
+    }
+    if (scheduler_ && btGetTaskScheduler() == scheduler_.get())
+        btSetTaskScheduler(btGetSequentialTaskScheduler());
+    defaultSolver_ = nullptr;
+#endif
+    threaded_ = false;
+}
@@ -0,0 +1,67 @@
+#ifndef AIBATTLEGROUND_PHYSICSTHREADING_HPP
+#define AIBATTLEGROUND_PHYSICSTHREADING_HPP
+
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Component.h>
+#include <memory>
+
+#ifdef AIBATTLEGROUND_BULLET_MT
+class btConstraintSolver;
+class btITaskScheduler;
+#endif
+
+/// Spreads the constraint solving of the scene's PhysicsWorld over the engine WorkQueue threads. Replaces the world's
+/// solver with Bullet's multithreaded one and installs a Bullet task scheduler that runs its parallel loops as
+/// WorkQueue items, so physics shares the worker threads with the rest of the engine instead of starting its own.
+/// Needs a build with AIBATTLEGROUND_BULLET_MT against an Urho3D whose Bullet is thread safe; otherwise the world stays
+/// single-threaded and a warning is logged when more threads are asked for.
+class PhysicsThreading : public Urho3D::Component {
+    URHO3D_OBJECT(PhysicsThreading, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit PhysicsThreading(Urho3D::Context *context);
+    /// Destruct.
+    ~PhysicsThreading() override;
+
+    /// Return whether the build supports multithreaded physics.
+    static bool IsAvailable();
+    /// Read the thread count from the program arguments: -physicsthreads <n>. Return 1 when not given.
+    static unsigned ThreadsFromArguments(const Urho3D::Vector<Urho3D::String> &arguments);
+
+    /// Set number of threads stepping physics, including the main thread. 1 is the stock single-threaded world.
+    void SetNumThreads(unsigned numThreads);
+    /// Return requested number of threads.
+    unsigned GetNumThreads() const { return numThreads_; }
+    /// Return whether the physics world currently runs multithreaded.
+    bool IsThreaded() const { return threaded_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+    /// Handle enabled/disabled state change.
+    void OnSetEnabled() override;
+
+ private:
+    /// Switch the physics world to match the thread count and the enabled state.
+    void Apply();
+    /// Give the physics world back its own solver.
+    void Restore();
+
+    /// Physics world being threaded.
+    Urho3D::WeakPtr<Urho3D::PhysicsWorld> physicsWorld_;
+    /// Requested number of threads.
+    unsigned numThreads_;
+    /// Whether the world currently runs multithreaded.
+    bool threaded_;
+#ifdef AIBATTLEGROUND_BULLET_MT
+    /// Task scheduler running Bullet's parallel loops on the WorkQueue.
+    std::unique_ptr<btITaskScheduler> scheduler_;
+    /// Multithreaded solver.
+    std::unique_ptr<btConstraintSolver> solver_;
+    /// Solver of the physics world, restored when threading is switched off.
+    btConstraintSolver *defaultSolver_;
+#endif
+};
+
+#endif //AIBATTLEGROUND_PHYSICSTHREADING_HPP
@@ -0,0 +1,126 @@
+#include <cmath>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "PoseCache.hpp"
+
+using namespace Urho3D;
+
+PoseCache::PoseCache(Context *context) :
+  Component(context),
+  numBuckets_(16) {
+}
+
+void PoseCache::Update(float timeStep) {
+    unsigned numChanged = 0;
+    for (Clip &clip : clips_) {
+        // Advance the clip's shared clock, each bucket only changes pose when the clock crosses its own boundary
+        clip.time_ = std::fmod(clip.time_ + timeStep, clip.length_);
+        for (unsigned bucket = 0; bucket < numBuckets_; ++bucket) {
+            const unsigned step = GetStep(clip.length_, clip.time_, bucket);
+            clip.changed_[bucket] = (unsigned char) (step != clip.steps_[bucket]);
+            clip.steps_[bucket] = step;
+            if (clip.changed_[bucket]) {
+                EvaluatePose(clip, bucket);
+                ++numChanged;
+            }
+        }
+    }
+
+    if (auto *debugHud = GetSubsystem<DebugHud>()) {
+        debugHud->SetAppStats("Shared poses", GetNumClips()*numBuckets_);
+        debugHud->SetAppStats("Poses evaluated", numChanged);
+    }
+}
+
+unsigned PoseCache::GetClipIndex(Animation *animation) {
+    for (unsigned i = 0; i < clips_.size(); ++i) {
+        if (clips_[i].animation_ == animation)
+            return i;
+    }
+
+    // New buckets start changed so that their agents pick up the first pose
+    Clip clip{SharedPtr<Animation>(animation), Max(animation->GetLength(), M_EPSILON), 0.0f, {}, {}, {}, {}};
+    const HashMap<StringHash, AnimationTrack> &tracks = animation->GetTracks();
+    for (auto i = tracks.Begin(); i != tracks.End(); ++i)
+        clip.tracks_.push_back(&i->second_);
+    clip.poses_.resize(clip.tracks_.size()*numBuckets_);
+    for (unsigned bucket = 0; bucket < numBuckets_; ++bucket) {
+        clip.steps_.push_back(GetStep(clip.length_, 0.0f, bucket));
+        EvaluatePose(clip, bucket);
+    }
+    clip.changed_.resize(numBuckets_, 1);
+    clips_.push_back(std::move(clip));
+    return (unsigned) clips_.size() - 1;
+}
+
+unsigned PoseCache::GetBucket(unsigned clipIndex, float time) const {
+    const Clip &clip = clips_[clipIndex];
+    const float phase = std::fmod(Max(time, 0.0f), clip.length_)/clip.length_;
+    return Min((unsigned) (phase*numBuckets_), numBuckets_ - 1);
+}
+
+void PoseCache::GetBoneNodes(unsigned clipIndex, AnimatedModel *model, std::vector<Node *> &nodes) const {
+    const Clip &clip = clips_[clipIndex];
+    Skeleton &skeleton = model->GetSkeleton();
+    nodes.clear();
+    for (const AnimationTrack *track : clip.tracks_) {
+        Bone *bone = skeleton.GetBone(track->nameHash_);
+        nodes.push_back(bone && bone->animated_ ? bone->node_.Get() : nullptr);
+    }
+}
+
+void PoseCache::ApplyPose(unsigned clipIndex, unsigned bucket, AnimatedModel *model,
+                          const std::vector<Node *> &nodes) const {
+    const Clip &clip = clips_[clipIndex];
+    const BoneTransform *pose = &clip.poses_[bucket*clip.tracks_.size()];
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+        Node *node = nodes[i];
+        if (!node)
+            continue;
+        const unsigned char channelMask = clip.tracks_[i]->channelMask_;
+        if (channelMask & CHANNEL_POSITION)
+            node->SetPositionSilent(pose[i].position_);
+        if (channelMask & CHANNEL_ROTATION)
+            node->SetRotationSilent(pose[i].rotation_);
+        if (channelMask & CHANNEL_SCALE)
+            node->SetScaleSilent(pose[i].scale_);
+    }
+    // The bone transforms are set silently like the engine's own animation apply, one dirty pass covers them all
+    model->GetNode()->MarkDirty();
+}
+
+unsigned PoseCache::GetStep(float length, float time, unsigned bucket) const {
+    // Bucket b steps b/N of a bucket length later than bucket 0, which spreads the steps over the bucket length
+    const float steps = time/length*numBuckets_ - (float) bucket/numBuckets_;
+    const auto step = (int) std::floor(steps);
+    return (unsigned) ((step + (int) numBuckets_)%(int) numBuckets_);
+}
+
+void PoseCache::EvaluatePose(Clip &clip, unsigned bucket) const {
+    const float bucketLength = clip.length_/numBuckets_;
+    const float time = (float) ((clip.steps_[bucket] + bucket)%numBuckets_)*bucketLength;
+    BoneTransform *pose = &clip.poses_[bucket*clip.tracks_.size()];
+
+    // Same sampling as a looped AnimationState at full weight
+    for (unsigned i = 0; i < clip.tracks_.size(); ++i) {
+        const AnimationTrack *track = clip.tracks_[i];
+        if (track->keyFrames_.Empty())
+            continue;
+        unsigned frame = 0;
+        track->GetKeyFrameIndex(time, frame);
+        const unsigned nextFrame = frame + 1 < track->keyFrames_.Size() ? frame + 1 : 0;
+        const AnimationKeyFrame &keyFrame = track->keyFrames_[frame];
+        const AnimationKeyFrame &nextKeyFrame = track->keyFrames_[nextFrame];
+        float timeInterval = nextKeyFrame.time_ - keyFrame.time_;
+        if (timeInterval < 0.0f)
+            timeInterval += clip.length_;
+        const float t = timeInterval > 0.0f ? (time - keyFrame.time_)/timeInterval : 1.0f;
+
+        pose[i].position_ = keyFrame.position_.Lerp(nextKeyFrame.position_, t);
+        pose[i].rotation_ = keyFrame.rotation_.Slerp(nextKeyFrame.rotation_, t);
+        pose[i].scale_ = keyFrame.scale_.Lerp(nextKeyFrame.scale_, t);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef AIBATTLEGROUND_POSECACHE_HPP
+#define AIBATTLEGROUND_POSECACHE_HPP
+
+#include <Urho3D/Graphics/Animation.h>
+#include <Urho3D/Scene/Component.h>
+#include <vector>
+
+namespace Urho3D {
+class AnimatedModel;
+}
+
+/// Shared animation poses for agents playing the same clip. The phase of every clip is quantized into a fixed number
+/// of buckets, and the pose of each bucket is evaluated once per step from the clip's keyframes, so keyframe search
+/// and interpolation scale with clips x buckets instead of the agent count. Agents in a bucket get the evaluated bone
+/// transforms copied to their bone nodes, their own animation state is no longer applied. The skin matrices are still
+/// computed per model from its bone nodes, since AnimatedModel has no hook for sharing them, and the bone bounding
+/// box keeps its last evaluated size. The buckets step at staggered offsets, so about 1/N of a clip's agents are
+/// updated per step instead of all of them at once. The cache is advanced by the CrowdSystem right before it applies
+/// the poses.
+class PoseCache : public Urho3D::Component {
+    URHO3D_OBJECT(PoseCache, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit PoseCache(Urho3D::Context *context);
+
+    /// Set number of phase buckets per clip. Reassigns nothing; call before agents are assigned.
+    void SetNumBuckets(unsigned numBuckets) { numBuckets_ = Urho3D::Max(numBuckets, 1u); }
+    /// Return number of phase buckets per clip.
+    unsigned GetNumBuckets() const { return numBuckets_; }
+
+    /// Advance the shared clocks and evaluate the buckets that moved to a new pose.
+    void Update(float timeStep);
+    /// Return clip index for an animation, registering it on first use.
+    unsigned GetClipIndex(Urho3D::Animation *animation);
+    /// Return bucket for an animation time of a clip.
+    unsigned GetBucket(unsigned clipIndex, float time) const;
+    /// Return bone nodes of a model in the track order of a clip, null for tracks without an animated bone.
+    void GetBoneNodes(unsigned clipIndex, Urho3D::AnimatedModel *model, std::vector<Urho3D::Node *> &nodes) const;
+    /// Copy the evaluated pose of a clip bucket to bone nodes returned by GetBoneNodes for the model.
+    void ApplyPose(unsigned clipIndex, unsigned bucket, Urho3D::AnimatedModel *model,
+                   const std::vector<Urho3D::Node *> &nodes) const;
+    /// Return whether a clip bucket moved to a new pose in the last update.
+    bool IsBucketChanged(unsigned clipIndex, unsigned bucket) const { return clips_[clipIndex].changed_[bucket] != 0; }
+    /// Return number of registered clips.
+    unsigned GetNumClips() const { return (unsigned) clips_.size(); }
+
+ private:
+    /// Evaluated transform of one track.
+    struct BoneTransform {
+        Urho3D::Vector3 position_;
+        Urho3D::Quaternion rotation_;
+        Urho3D::Vector3 scale_;
+    };
+
+    /// Shared clock and poses of one clip.
+    struct Clip {
+        Urho3D::SharedPtr<Urho3D::Animation> animation_;
+        float length_;
+        float time_;
+        /// Tracks of the animation, in the order of the poses.
+        std::vector<const Urho3D::AnimationTrack *> tracks_;
+        /// Step of each bucket.
+        std::vector<unsigned> steps_;
+        /// Whether each bucket changed step in the last update.
+        std::vector<unsigned char> changed_;
+        /// Evaluated pose of each bucket, one transform per track.
+        std::vector<BoneTransform> poses_;
+    };
+
+    /// Return step of a bucket at a clip time.
+    unsigned GetStep(float length, float time, unsigned bucket) const;
+    /// Evaluate the pose of a bucket at its current step.
+    void EvaluatePose(Clip &clip, unsigned bucket) const;
+
+    /// Registered clips.
+    std::vector<Clip> clips_;
+    /// Number of phase buckets per clip.
+    unsigned numBuckets_;
+};
+
+#endif //AIBATTLEGROUND_POSECACHE_HPP
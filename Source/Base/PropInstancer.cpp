@@ -0,0 +1,145 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "PropInstancer.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Node variable with the model resource name of an instance.
+const StringHash VAR_PROP_MODEL("PropModel");
+/// Node variable with the material resource name of an instance.
+const StringHash VAR_PROP_MATERIAL("PropMaterial");
+
+}
+
+PropInstancer::PropInstancer(Context *context) :
+  Component(context),
+  tileSize_(256.0f),
+  castShadows_(true),
+  numRegrouped_(0) {
+}
+
+PropInstancer::~PropInstancer() = default;
+
+void PropInstancer::AddInstance(Node *node, Model *model, Material *material) {
+    if (!node || instanceIndex_.Contains(node))
+        return;
+
+    const unsigned group = GetGroup(model, material, node->GetWorldPosition());
+    groups_[group].drawable_->AddInstanceNode(node);
+    instanceIndex_[node] = (unsigned) instances_.size();
+    instances_.push_back(Instance{WeakPtr<Node>(node), WeakPtr<Model>(model), WeakPtr<Material>(material), group});
+    node->AddListener(this);
+
+    // The groups are not saved with the scene, the instance is found again after a load through the node variables
+    node->SetVar(VAR_PROP_MODEL, model ? model->GetName() : String::EMPTY);
+    node->SetVar(VAR_PROP_MATERIAL, material ? material->GetName() : String::EMPTY);
+}
+
+void PropInstancer::RemoveInstance(Node *node) {
+    auto i = instanceIndex_.Find(node);
+    if (i == instanceIndex_.End())
+        return;
+
+    const unsigned index = i->second_;
+    instanceIndex_.Erase(i);
+    if (StaticModelGroup *drawable = groups_[instances_[index].group_].drawable_)
+        drawable->RemoveInstanceNode(node);
+    node->RemoveListener(this);
+
+    // Swap with the last instance to keep the array packed
+    if (index + 1 < instances_.size()) {
+        instances_[index] = instances_.back();
+        if (Node *moved = instances_[index].node_)
+            instanceIndex_[moved] = index;
+    }
+    instances_.pop_back();
+}
+
+void PropInstancer::RestoreInstances() {
+    Scene *scene = GetScene();
+    if (!scene)
+        return;
+
+    auto *cache = GetSubsystem<ResourceCache>();
+    PODVector<Node *> nodes;
+    scene->GetChildren(nodes, true);
+    for (Node *node : nodes) {
+        const String &modelName = node->GetVar(VAR_PROP_MODEL).GetString();
+        if (!modelName.Empty())
+            AddInstance(node, cache->GetResource<Model>(modelName),
+                        cache->GetResource<Material>(node->GetVar(VAR_PROP_MATERIAL).GetString()));
+    }
+}
+
+void PropInstancer::OnSceneSet(Scene *scene) {
+    if (scene) {
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(PropInstancer, HandleScenePostUpdate));
+        SubscribeToEvent(scene, E_NODEREMOVED, URHO3D_HANDLER(PropInstancer, HandleNodeRemoved));
+    } else {
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+        UnsubscribeFromEvent(E_NODEREMOVED);
+    }
+}
+
+void PropInstancer::OnMarkedDirty(Node *node) {
+    moved_.push_back(WeakPtr<Node>(node));
+}
+
+void PropInstancer::HandleScenePostUpdate(StringHash eventType, VariantMap &eventData) {
+    numRegrouped_ = 0;
+    for (const WeakPtr<Node> &node : moved_) {
+        auto i = node ? instanceIndex_.Find(node.Get()) : instanceIndex_.End();
+        if (i == instanceIndex_.End())
+            continue;
+
+        // Reading the world position also clears the dirty flag, so the next move is reported again
+        Instance &instance = instances_[i->second_];
+        const unsigned group = GetGroup(instance.model_, instance.material_, node->GetWorldPosition());
+        if (group == instance.group_)
+            continue;
+
+        if (StaticModelGroup *drawable = groups_[instance.group_].drawable_)
+            drawable->RemoveInstanceNode(node);
+        groups_[group].drawable_->AddInstanceNode(node);
+        instance.group_ = group;
+        ++numRegrouped_;
+    }
+    moved_.clear();
+
+    if (auto *debugHud = GetSubsystem<DebugHud>()) {
+        debugHud->SetAppStats("Prop groups", GetNumGroups());
+        debugHud->SetAppStats("Prop instances", GetNumInstances());
+    }
+}
+
+void PropInstancer::HandleNodeRemoved(StringHash eventType, VariantMap &eventData) {
+    using namespace NodeRemoved;
+
+    RemoveInstance(static_cast<Node *>(eventData[P_NODE].GetPtr()));
+}
+
+unsigned PropInstancer::GetGroup(Model *model, Material *material, const Vector3 &position) {
+    const GroupKey key(model, material, FloorToInt(position.x_/tileSize_), FloorToInt(position.z_/tileSize_));
+    auto i = groupIndex_.find(key);
+    if (i != groupIndex_.end())
+        return i->second;
+
+    Group group;
+    // Local and temporary, the groups are rebuilt from the instance nodes rather than saved
+    group.node_ = GetScene()->CreateChild("PropGroup", LOCAL);
+    group.node_->SetTemporary(true);
+    group.drawable_ = group.node_->CreateComponent<StaticModelGroup>();
+    group.drawable_->SetModel(model);
+    group.drawable_->SetMaterial(material);
+    group.drawable_->SetCastShadows(castShadows_);
+    groups_.push_back(group);
+    return groupIndex_[key] = (unsigned) groups_.size() - 1;
+}
@@ -0,0 +1,93 @@
+#ifndef AIBATTLEGROUND_PROPINSTANCER_HPP
+#define AIBATTLEGROUND_PROPINSTANCER_HPP
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Graphics/StaticModelGroup.h>
+#include <Urho3D/Scene/Component.h>
+#include <map>
+#include <tuple>
+#include <vector>
+
+/// Draws props that share a model and a material as instances of one StaticModelGroup per square tile of the world,
+/// instead of one StaticModel per prop. A group keeps the world transforms of its instances in one contiguous buffer
+/// and renders them as a single instanced batch per view, and the tiles keep the groups small enough to be culled.
+/// Props moved by physics are checked once per frame and moved to the group of their new tile when they cross a tile
+/// border, so their group's bounds do not grow across the world. The group nodes are temporary; after a scene load,
+/// RestoreInstances finds the instanced nodes again through the model and material names kept in their variables.
+class PropInstancer : public Urho3D::Component {
+    URHO3D_OBJECT(PropInstancer, Urho3D::Component);
+
+ public:
+    /// Construct.
+    explicit PropInstancer(Urho3D::Context *context);
+    /// Destruct.
+    ~PropInstancer() override;
+
+    /// Set tile size in world units. Takes effect for props added or moved after the call.
+    void SetTileSize(float size) { tileSize_ = Urho3D::Max(size, 1.0f); }
+    /// Set whether new groups cast shadows.
+    void SetCastShadows(bool enable) { castShadows_ = enable; }
+    /// Draw a node as an instance of a model and material.
+    void AddInstance(Urho3D::Node *node, Urho3D::Model *model, Urho3D::Material *material);
+    /// Stop drawing a node.
+    void RemoveInstance(Urho3D::Node *node);
+    /// Draw the nodes of a loaded scene that were instanced when it was saved.
+    void RestoreInstances();
+
+    /// Return tile size in world units.
+    float GetTileSize() const { return tileSize_; }
+    /// Return number of instanced nodes.
+    unsigned GetNumInstances() const { return (unsigned) instances_.size(); }
+    /// Return number of group drawables.
+    unsigned GetNumGroups() const { return (unsigned) groups_.size(); }
+    /// Return number of instances moved to another group in the last frame.
+    unsigned GetNumRegrouped() const { return numRegrouped_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+    /// Handle an instance node being marked dirty.
+    void OnMarkedDirty(Urho3D::Node *node) override;
+
+ private:
+    /// Group drawable of one model, material and tile.
+    struct Group {
+        Urho3D::SharedPtr<Urho3D::Node> node_;
+        Urho3D::WeakPtr<Urho3D::StaticModelGroup> drawable_;
+    };
+    /// Instanced node.
+    struct Instance {
+        Urho3D::WeakPtr<Urho3D::Node> node_;
+        Urho3D::WeakPtr<Urho3D::Model> model_;
+        Urho3D::WeakPtr<Urho3D::Material> material_;
+        unsigned group_;
+    };
+    /// Group lookup key: model, material and tile coordinates.
+    using GroupKey = std::tuple<Urho3D::Model *, Urho3D::Material *, int, int>;
+
+    /// Handle the scene post-update event.
+    void HandleScenePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle a node being removed from the scene.
+    void HandleNodeRemoved(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Return the group of a model and material at a position, created when needed.
+    unsigned GetGroup(Urho3D::Model *model, Urho3D::Material *material, const Urho3D::Vector3 &position);
+
+    /// Tile size.
+    float tileSize_;
+    /// Whether new groups cast shadows.
+    bool castShadows_;
+    /// Group drawables.
+    std::vector<Group> groups_;
+    /// Group index by key.
+    std::map<GroupKey, unsigned> groupIndex_;
+    /// Instanced nodes.
+    std::vector<Instance> instances_;
+    /// Instance index by node.
+    Urho3D::HashMap<Urho3D::Node *, unsigned> instanceIndex_;
+    /// Instance nodes marked dirty since the last check.
+    std::vector<Urho3D::WeakPtr<Urho3D::Node>> moved_;
+    /// Instances moved to another group in the last frame.
+    unsigned numRegrouped_;
+};
+
+#endif //AIBATTLEGROUND_PROPINSTANCER_HPP
@@ -0,0 +1,46 @@
+#ifndef AIBATTLEGROUND_RANDOMSTREAM_HPP
+#define AIBATTLEGROUND_RANDOMSTREAM_HPP
+
+#include <cstdint>
+
+/// Seeded pseudo-random number stream (PCG32). Unlike the engine's global Random(), every subsystem owns its stream,
+/// so the numbers one subsystem draws do not depend on how many another one drew. The ranges match Random().
+class RandomStream {
+ public:
+    /// Construct with a seed.
+    explicit RandomStream(std::uint64_t seed = 0) { SetSeed(seed); }
+
+    /// Restart the stream from a seed.
+    void SetSeed(std::uint64_t seed) {
+        state_ = 0;
+        Next();
+        state_ += seed;
+        Next();
+    }
+
+    /// Return the next 32-bit value.
+    unsigned Next() {
+        const std::uint64_t state = state_;
+        state_ = state*6364136223846793005ULL + 1442695040888963407ULL;
+        const auto xorShifted = (std::uint32_t) (((state >> 18u) ^ state) >> 27u);
+        const auto rotation = (std::uint32_t) (state >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+    }
+
+    /// Return a float in the range [0, 1).
+    float Random() { return (float) (Next() >> 8u)*(1.0f/16777216.0f); }
+    /// Return a float in the range [0, range).
+    float Random(float range) { return Random()*range; }
+    /// Return a float in the range [min, max).
+    float Random(float min, float max) { return Random()*(max - min) + min; }
+    /// Return an integer in the range [0, range).
+    int Random(int range) { return (int) (Random()*(float) range); }
+    /// Return an integer in the range [min, max).
+    int Random(int min, int max) { return (int) (Random()*(float) (max - min)) + min; }
+
+ private:
+    /// Generator state.
+    std::uint64_t state_;
+};
+
+#endif //AIBATTLEGROUND_RANDOMSTREAM_HPP
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/ResourceEvents.h>
+#include <Urho3D/UI/Font.h>
+#include <Urho3D/UI/UI.h>
+
+#include "ResourcePreloader.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Time per frame the cache may spend finishing background loaded resources while preloading, in milliseconds.
+const int PRELOAD_FINISH_MSEC = 50;
+/// Whether background loads end with the background loaded event. Without threading the cache loads right away and
+/// sends no event.
+#ifdef URHO3D_THREADING
+const bool BACKGROUND_LOAD_EVENTS = true;
+#else
+const bool BACKGROUND_LOAD_EVENTS = false;
+#endif
+
+/// Return key of a resource by type and name, resources of different types may share a name.
+unsigned long long GetResourceKey(StringHash type, const String &name) {
+    return ((unsigned long long) type.Value() << 32u) | StringHash(name).Value();
+}
+
+}
+
+void ResourceManifest::Add(StringHash type, const String &name) {
+    for (const Entry &entry : entries_) {
+        if (entry.type_ == type && entry.name_ == name)
+            return;
+    }
+    entries_.push_back(Entry{type, name});
+}
+
+ResourcePreloader::ResourcePreloader(Context *context) :
+  Object(context),
+  numPending_(0),
+  numFailed_(0),
+  finishMSec_(0) {
+}
+
+ResourcePreloader::~ResourcePreloader() {
+    if (progressText_)
+        progressText_->Remove();
+}
+
+void ResourcePreloader::Start(const ResourceManifest &manifest) {
+    auto *cache = GetSubsystem<ResourceCache>();
+    resources_.clear();
+    pending_.clear();
+    numPending_ = 0;
+    numFailed_ = 0;
+    timer_.Reset();
+
+    if (auto *ui = GetSubsystem<UI>()) {
+        if (!progressText_) {
+            progressText_ = ui->GetRoot()->CreateChild<Text>();
+            progressText_->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 20);
+            progressText_->SetAlignment(HA_CENTER, VA_CENTER);
+        }
+    }
+
+    // Nothing else runs during the preload, so let the cache finish more resources per frame
+    finishMSec_ = cache->GetFinishBackgroundResourcesMs();
+    cache->SetFinishBackgroundResourcesMs(Max(finishMSec_, PRELOAD_FINISH_MSEC));
+    SubscribeToEvent(E_RESOURCEBACKGROUNDLOADED, URHO3D_HANDLER(ResourcePreloader, HandleResourceLoaded));
+    for (const ResourceManifest::Entry &entry : manifest.GetEntries()) {
+        const auto index = (unsigned) resources_.size();
+        resources_.push_back(Resource{entry.name_, 0, false});
+
+        cache->BackgroundLoadResource(entry.type_, entry.name_, true);
+        // Already in the cache, or loaded right away when the engine is built without threading. Otherwise it was
+        // either queued now or is already queued from elsewhere, both end with the background loaded event
+        if (cache->GetExistingResource(entry.type_, entry.name_))
+            Finish(index, true);
+        else if (BACKGROUND_LOAD_EVENTS && !entry.name_.Empty()
+                 && context_->GetObjectFactories().Contains(entry.type_)) {
+            pending_[GetResourceKey(entry.type_, entry.name_)] = index;
+            ++numPending_;
+        } else
+            Finish(index, false);
+    }
+
+    UpdateProgress();
+    if (!numPending_)
+        Report();
+}
+
+void ResourcePreloader::HandleResourceLoaded(StringHash eventType, VariantMap &eventData) {
+    using namespace ResourceBackgroundLoaded;
+
+    // Dependencies of the manifest resources, such as the textures of a material, are announced as well
+    const String &name = eventData[P_RESOURCENAME].GetString();
+    auto *resource = static_cast<Urho3D::Resource *>(eventData[P_RESOURCE].GetPtr());
+    auto i = pending_.end();
+    if (resource)
+        i = pending_.find(GetResourceKey(resource->GetType(), name));
+    else {
+        // A failed load has no resource to take the type from, the name has to do
+        for (auto j = pending_.begin(); j != pending_.end() && i == pending_.end(); ++j) {
+            if (resources_[j->second].name_ == name)
+                i = j;
+        }
+    }
+    if (i == pending_.end())
+        return;
+
+    const unsigned index = i->second;
+    pending_.erase(i);
+    --numPending_;
+    Finish(index, eventData[P_SUCCESS].GetBool());
+    UpdateProgress();
+    if (!numPending_)
+        Report();
+}
+
+void ResourcePreloader::Finish(unsigned index, bool success) {
+    Resource &resource = resources_[index];
+    resource.readyUSec_ = timer_.GetUSec(false);
+    resource.loaded_ = success;
+    if (!success) {
+        ++numFailed_;
+        URHO3D_LOGERROR("Could not preload " + resource.name_);
+    }
+}
+
+void ResourcePreloader::UpdateProgress() {
+    if (!progressText_)
+        return;
+
+    const auto numResources = (unsigned) resources_.size();
+    progressText_->SetText("Loading " + String(numResources - numPending_) + " / " + String(numResources));
+}
+
+void ResourcePreloader::Report() {
+    using namespace PreloadFinished;
+
+    UnsubscribeFromEvent(E_RESOURCEBACKGROUNDLOADED);
+    GetSubsystem<ResourceCache>()->SetFinishBackgroundResourcesMs(finishMSec_);
+    if (progressText_) {
+        progressText_->Remove();
+        progressText_.Reset();
+    }
+
+    // The loads overlap, so the report lists when each resource was ready rather than its own load time
+    std::vector<const Resource *> sorted;
+    for (const Resource &resource : resources_)
+        sorted.push_back(&resource);
+    std::sort(sorted.begin(), sorted.end(), [](const Resource *lhs, const Resource *rhs) {
+        return lhs->readyUSec_ > rhs->readyUSec_;
+    });
+
+    URHO3D_LOGINFOF("Preloaded %u resources in %.1f ms, %u failed", (unsigned) resources_.size(),
+                    (float) timer_.GetUSec(false)/1000.0f, numFailed_);
+    for (const Resource *resource : sorted)
+        URHO3D_LOGINFOF("  ready after %7.1f ms  %s%s", (float) resource->readyUSec_/1000.0f,
+                        resource->name_.CString(), resource->loaded_ ? "" : " (failed)");
+
+    VariantMap &eventData = GetEventDataMap();
+    eventData[P_NUMRESOURCES] = (unsigned) resources_.size();
+    eventData[P_NUMFAILED] = numFailed_;
+    SendEvent(E_PRELOADFINISHED, eventData);
+}
@@ -0,0 +1,96 @@
+#ifndef AIBATTLEGROUND_RESOURCEPRELOADER_HPP
+#define AIBATTLEGROUND_RESOURCEPRELOADER_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/UI/Text.h>
+#include <unordered_map>
+#include <vector>
+
+/// All manifest resources finished loading. Sent by the ResourcePreloader.
+URHO3D_EVENT(E_PRELOADFINISHED, PreloadFinished) {
+    URHO3D_PARAM(P_NUMRESOURCES, NumResources);   // unsigned
+    URHO3D_PARAM(P_NUMFAILED, NumFailed);         // unsigned
+}
+
+/// List of the resources an episode needs before its scene is constructed.
+class ResourceManifest {
+ public:
+    /// One listed resource.
+    struct Entry {
+        /// Resource type.
+        Urho3D::StringHash type_;
+        /// Resource name.
+        Urho3D::String name_;
+    };
+
+    /// Add a resource. Resources listed twice are only kept once.
+    template <class T> void Add(const Urho3D::String &name) { Add(T::GetTypeStatic(), name); }
+    /// Add a resource of a type. Resources listed twice are only kept once.
+    void Add(Urho3D::StringHash type, const Urho3D::String &name);
+
+    /// Return the listed resources.
+    const std::vector<Entry> &GetEntries() const { return entries_; }
+
+ private:
+    /// Listed resources.
+    std::vector<Entry> entries_;
+};
+
+/// Loads an episode's resource manifest with the ResourceCache background loading, so the files are read and parsed
+/// on the worker threads in parallel instead of one by one on first use. Shows the progress when there is a UI, and
+/// logs how long after the start each resource was ready. E_PRELOADFINISHED is sent once all are loaded or failed.
+class ResourcePreloader : public Urho3D::Object {
+    URHO3D_OBJECT(ResourcePreloader, Urho3D::Object);
+
+ public:
+    /// Construct.
+    explicit ResourcePreloader(Urho3D::Context *context);
+    /// Destruct. Removes the progress text.
+    ~ResourcePreloader() override;
+
+    /// Start loading the resources of a manifest. Resources already in the cache count as loaded.
+    void Start(const ResourceManifest &manifest);
+
+    /// Return whether resources are still loading.
+    bool IsLoading() const { return numPending_ > 0; }
+    /// Return number of resources in the manifest.
+    unsigned GetNumResources() const { return (unsigned) resources_.size(); }
+    /// Return number of resources that could not be loaded.
+    unsigned GetNumFailed() const { return numFailed_; }
+
+ private:
+    /// Loading state of one manifest resource.
+    struct Resource {
+        Urho3D::String name_;
+        /// Time after the start at which the resource was ready, in microseconds.
+        long long readyUSec_;
+        bool loaded_;
+    };
+
+    /// Handle a resource finishing background loading.
+    void HandleResourceLoaded(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Record a resource as finished.
+    void Finish(unsigned index, bool success);
+    /// Update the progress text.
+    void UpdateProgress();
+    /// Log the load times and announce the end of the preload.
+    void Report();
+
+    /// Manifest resources.
+    std::vector<Resource> resources_;
+    /// Index of the resources still loading by type and name hash.
+    std::unordered_map<unsigned long long, unsigned> pending_;
+    /// Number of resources still loading.
+    unsigned numPending_;
+    /// Number of resources that could not be loaded.
+    unsigned numFailed_;
+    /// Time per frame the cache spent finishing background loaded resources before the preload.
+    int finishMSec_;
+    /// Time since the start.
+    Urho3D::HiresTimer timer_;
+    /// Progress text, null without a UI.
+    Urho3D::SharedPtr<Urho3D::Text> progressText_;
+};
+
+#endif //AIBATTLEGROUND_RESOURCEPRELOADER_HPP
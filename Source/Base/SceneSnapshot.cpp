@@ -0,0 +1,299 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/IO/Compression.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "SceneSnapshot.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Snapshot file identifier.
+const char *SNAPSHOT_FILE_ID = "AIBS";
+/// Snapshot format version.
+const unsigned SNAPSHOT_VERSION = 1;
+
+/// Copy the attributes an object writes in a binary save.
+void CaptureAttributes(const Serializable *object, std::vector<Variant> &attributes) {
+    const Vector<AttributeInfo> *infos = object->GetAttributes();
+    if (!infos)
+        return;
+    for (const AttributeInfo &info : *infos) {
+        if (!(info.mode_ & AM_FILE))
+            continue;
+        attributes.emplace_back();
+        object->OnGetAttribute(info, attributes.back());
+    }
+}
+
+/// Write copied attributes like Serializable::Save.
+bool WriteAttributes(const std::vector<Variant> &attributes, Serializer &dest) {
+    for (const Variant &value : attributes) {
+        if (!dest.WriteVariantData(value))
+            return false;
+    }
+    return true;
+}
+
+/// Return microseconds as milliseconds.
+float ToMSec(long long usec) {
+    return (float) usec/1000.0f;
+}
+
+/// Return bytes as megabytes.
+float ToMBytes(unsigned bytes) {
+    return (float) bytes/(1024.0f*1024.0f);
+}
+
+}
+
+SceneSnapshot::SceneSnapshot(Context *context) :
+  Object(context),
+  compression_(true),
+  loadReadUSec_(0),
+  loadFrames_(0) {
+}
+
+SceneSnapshot::~SceneSnapshot() {
+    // The worker thread holds a pointer to the job
+    if (job_ && !job_->item_->completed_ && !GetSubsystem<WorkQueue>()->RemoveWorkItem(job_->item_))
+        GetSubsystem<WorkQueue>()->Complete(0);
+}
+
+bool SceneSnapshot::Save(Scene *scene, const String &fileName) {
+    if (IsBusy() || !scene)
+        return false;
+
+    job_.reset(new Job());
+    job_->save_ = true;
+    job_->fileName_ = fileName;
+    job_->compress_ = compression_;
+
+    // Copying the attributes is the only part that has to see a consistent scene, the serialization works on the copy
+    HiresTimer timer;
+    CaptureNode(scene, job_->nodes_);
+    job_->mainUSec_ = timer.GetUSec(false);
+    job_->rawSize_ = 0;
+
+    StartJob();
+    return true;
+}
+
+bool SceneSnapshot::Load(Scene *scene, const String &fileName) {
+    if (IsBusy() || !scene)
+        return false;
+
+    job_.reset(new Job());
+    job_->save_ = false;
+    job_->fileName_ = fileName;
+    job_->scene_ = scene;
+    job_->mainUSec_ = 0;
+    StartJob();
+    return true;
+}
+
+bool SceneSnapshot::SaveXML(Scene *scene, const String &fileName) {
+    HiresTimer timer;
+    File file(context_, fileName, FILE_WRITE);
+    const bool success = file.IsOpen() && scene->SaveXML(file);
+    URHO3D_LOGINFOF("XML save: %.1f ms on the main thread, %.2f MB", ToMSec(timer.GetUSec(false)),
+                    ToMBytes(file.GetSize()));
+    return success;
+}
+
+bool SceneSnapshot::LoadXML(Scene *scene, const String &fileName) {
+    HiresTimer timer;
+    File file(context_, fileName, FILE_READ);
+    const bool success = file.IsOpen() && scene->LoadXML(file);
+    URHO3D_LOGINFOF("XML load: %.1f ms on the main thread, %.2f MB", ToMSec(timer.GetUSec(false)),
+                    ToMBytes(file.GetSize()));
+    return success;
+}
+
+void SceneSnapshot::StartJob() {
+    job_->context_ = context_;
+    job_->tempName_ = job_->fileName_ + ".tmp";
+    job_->success_ = false;
+    job_->loadOffset_ = 0;
+    job_->fileSize_ = 0;
+    job_->workUSec_ = 0;
+
+    // Not taken from the pool so that the item keeps its completed flag after the queue purges it
+    job_->item_ = new WorkItem();
+    job_->item_->priority_ = 0;
+    job_->item_->workFunction_ = JobWork;
+    job_->item_->aux_ = job_.get();
+    GetSubsystem<WorkQueue>()->AddWorkItem(job_->item_);
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(SceneSnapshot, HandleUpdate));
+}
+
+void SceneSnapshot::JobWork(const WorkItem *item, unsigned threadIndex) {
+    Job &job = *static_cast<Job *>(item->aux_);
+    HiresTimer timer;
+    if (job.save_)
+        WriteSnapshot(job);
+    else
+        ReadSnapshot(job);
+    job.workUSec_ = timer.GetUSec(false);
+}
+
+void SceneSnapshot::CaptureNode(const Node *node, std::vector<CapturedNode> &nodes) {
+    const auto index = (unsigned) nodes.size();
+    nodes.emplace_back();
+    nodes[index].id_ = node->GetID();
+    nodes[index].numChildren_ = 0;
+    CaptureAttributes(node, nodes[index].attributes_);
+    for (const SharedPtr<Component> &component : node->GetComponents()) {
+        if (component->IsTemporary())
+            continue;
+        nodes[index].components_.push_back(CapturedComponent{component->GetType(), component->GetID(), {}});
+        CaptureAttributes(component, nodes[index].components_.back().attributes_);
+    }
+
+    // The vector grows while the children are captured, the parent is only addressed by index
+    for (const SharedPtr<Node> &child : node->GetChildren()) {
+        if (child->IsTemporary())
+            continue;
+        ++nodes[index].numChildren_;
+        CaptureNode(child, nodes);
+    }
+}
+
+unsigned SceneSnapshot::SerializeNode(const std::vector<CapturedNode> &nodes, unsigned index, Serializer &dest,
+                                      bool &success) {
+    const CapturedNode &node = nodes[index++];
+    success = success && dest.WriteUInt(node.id_) && WriteAttributes(node.attributes_, dest);
+
+    // Each component goes into a buffer of its own so that its size can be written first, as Node::Save does
+    success = success && dest.WriteVLE((unsigned) node.components_.size());
+    VectorBuffer componentData;
+    for (const CapturedComponent &component : node.components_) {
+        componentData.Clear();
+        success = success && componentData.WriteStringHash(component.type_) && componentData.WriteUInt(component.id_)
+                  && WriteAttributes(component.attributes_, componentData) && dest.WriteVLE(componentData.GetSize())
+                  && dest.Write(componentData.GetData(), componentData.GetSize()) == componentData.GetSize();
+    }
+
+    success = success && dest.WriteVLE(node.numChildren_);
+    for (unsigned i = 0; i < node.numChildren_; ++i)
+        index = SerializeNode(nodes, index, dest, success);
+    return index;
+}
+
+void SceneSnapshot::WriteSnapshot(Job &job) {
+    // Same layout as Scene::Save, so that Scene::LoadAsync reads it back
+    bool serialized = job.data_.WriteFileID("USCN");
+    SerializeNode(job.nodes_, 0, job.data_, serialized);
+    job.nodes_.clear();
+    job.rawSize_ = job.data_.GetSize();
+    if (!serialized)
+        return;
+
+    // Written to a temporary file first so that a failed save does not destroy the previous snapshot
+    File file(job.context_, job.tempName_, FILE_WRITE);
+    if (!file.IsOpen())
+        return;
+
+    file.WriteFileID(SNAPSHOT_FILE_ID);
+    file.WriteUInt(SNAPSHOT_VERSION);
+    file.WriteBool(job.compress_);
+    job.data_.Seek(0);
+    if (job.compress_)
+        job.success_ = CompressStream(file, job.data_);
+    else
+        job.success_ = file.Write(job.data_.GetData(), job.data_.GetSize()) == job.data_.GetSize();
+    job.fileSize_ = file.GetSize();
+}
+
+void SceneSnapshot::ReadSnapshot(Job &job) {
+    File file(job.context_, job.fileName_, FILE_READ);
+    if (!file.IsOpen() || file.ReadFileID() != SNAPSHOT_FILE_ID || file.ReadUInt() != SNAPSHOT_VERSION)
+        return;
+
+    job.fileSize_ = file.GetSize();
+    if (!file.ReadBool()) {
+        // Uncompressed snapshots are loaded straight from the file
+        job.loadName_ = job.fileName_;
+        job.loadOffset_ = file.GetPosition();
+        job.rawSize_ = job.fileSize_ - job.loadOffset_;
+        job.success_ = true;
+        return;
+    }
+
+    // Scene::LoadAsync reads from a file, so the scene data is decompressed into a temporary one
+    File decompressed(job.context_, job.tempName_, FILE_WRITE);
+    if (!decompressed.IsOpen())
+        return;
+    job.success_ = DecompressStream(decompressed, file);
+    job.loadName_ = job.tempName_;
+    job.rawSize_ = decompressed.GetSize();
+}
+
+void SceneSnapshot::HandleUpdate(StringHash eventType, VariantMap &eventData) {
+    if (loadFile_) {
+        ++loadFrames_;
+        return;
+    }
+    if (!job_ || !job_->item_->completed_)
+        return;
+
+    std::unique_ptr<Job> job(std::move(job_));
+    auto *fileSystem = GetSubsystem<FileSystem>();
+
+    if (job->save_) {
+        UnsubscribeFromEvent(E_UPDATE);
+        if (job->success_) {
+            fileSystem->Delete(job->fileName_);
+            job->success_ = fileSystem->Rename(job->tempName_, job->fileName_);
+        }
+        if (!job->success_) {
+            fileSystem->Delete(job->tempName_);
+            URHO3D_LOGERROR("Could not save snapshot " + job->fileName_);
+            return;
+        }
+        URHO3D_LOGINFOF("Snapshot save: %.1f ms copy on the main thread, %.1f ms %s on a worker thread, "
+                        "%.2f MB scene in %.2f MB file", ToMSec(job->mainUSec_), ToMSec(job->workUSec_),
+                        job->compress_ ? "serialize, compress and write" : "serialize and write",
+                        ToMBytes(job->rawSize_),
+                        ToMBytes(job->fileSize_));
+        return;
+    }
+
+    Scene *scene = job->scene_;
+    if (job->success_ && scene) {
+        loadFile_ = new File(context_, job->loadName_, FILE_READ);
+        loadFile_->Seek(job->loadOffset_);
+        loadScene_ = scene;
+        loadTempName_ = job->loadName_ == job->tempName_ ? job->tempName_ : String::EMPTY;
+        loadReadUSec_ = job->workUSec_;
+        loadFrames_ = 0;
+        loadTimer_.Reset();
+        SubscribeToEvent(scene, E_ASYNCLOADFINISHED, URHO3D_HANDLER(SceneSnapshot, HandleAsyncLoadFinished));
+        if (scene->LoadAsync(loadFile_))
+            return;
+        UnsubscribeFromEvent(scene, E_ASYNCLOADFINISHED);
+        loadFile_.Reset();
+    }
+
+    UnsubscribeFromEvent(E_UPDATE);
+    if (job->loadName_ == job->tempName_)
+        fileSystem->Delete(job->tempName_);
+    URHO3D_LOGERROR("Could not load snapshot " + job->fileName_);
+}
+
+void SceneSnapshot::HandleAsyncLoadFinished(StringHash eventType, VariantMap &eventData) {
+    URHO3D_LOGINFOF("Snapshot load: %.1f ms read on a worker thread, %.1f ms incremental load over %u frames, "
+                    "%.2f MB file", ToMSec(loadReadUSec_), ToMSec(loadTimer_.GetUSec(false)), loadFrames_,
+                    ToMBytes(loadFile_->GetSize()));
+
+    UnsubscribeFromEvent(E_UPDATE);
+    if (loadScene_)
+        UnsubscribeFromEvent(loadScene_, E_ASYNCLOADFINISHED);
+    loadFile_.Reset();
+    loadScene_.Reset();
+    if (!loadTempName_.Empty())
+        GetSubsystem<FileSystem>()->Delete(loadTempName_);
+}
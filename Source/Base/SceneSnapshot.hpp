@@ -0,0 +1,120 @@
+#ifndef AIBATTLEGROUND_SCENESNAPSHOT_HPP
+#define AIBATTLEGROUND_SCENESNAPSHOT_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Scene/Scene.h>
+#include <memory>
+#include <vector>
+
+/// Binary scene snapshots that keep file work off the main thread. Saving only copies the saved attributes of the
+/// scene's nodes and components on the main thread; a worker thread writes the copy in the engine's binary scene
+/// format, compresses it with LZ4 and writes the file.
+/// Loading reads and decompresses on a worker thread and then instantiates the nodes incrementally over several frames
+/// with Scene::LoadAsync. Timings and sizes are logged, also for the XML path kept for comparison.
+class SceneSnapshot : public Urho3D::Object {
+    URHO3D_OBJECT(SceneSnapshot, Urho3D::Object);
+
+ public:
+    /// Construct.
+    explicit SceneSnapshot(Urho3D::Context *context);
+    /// Destruct. Waits for the file work in progress.
+    ~SceneSnapshot() override;
+
+    /// Set whether saved snapshots are LZ4 compressed.
+    void SetCompression(bool enable) { compression_ = enable; }
+    /// Save a scene snapshot. Return false if another save or load is in progress.
+    bool Save(Urho3D::Scene *scene, const Urho3D::String &fileName);
+    /// Load a scene snapshot. Return false if another save or load is in progress.
+    bool Load(Urho3D::Scene *scene, const Urho3D::String &fileName);
+    /// Save a scene as XML on the main thread and log the timing.
+    bool SaveXML(Urho3D::Scene *scene, const Urho3D::String &fileName);
+    /// Load a scene from XML on the main thread and log the timing.
+    bool LoadXML(Urho3D::Scene *scene, const Urho3D::String &fileName);
+
+    /// Return whether saved snapshots are compressed.
+    bool GetCompression() const { return compression_; }
+    /// Return whether a save or load is in progress.
+    bool IsBusy() const { return job_ != nullptr || loadFile_; }
+
+ private:
+    /// Copied attributes of a component.
+    struct CapturedComponent {
+        Urho3D::StringHash type_;
+        unsigned id_;
+        std::vector<Urho3D::Variant> attributes_;
+    };
+
+    /// Copied attributes of a node. Nodes are kept depth first, the children follow their parent.
+    struct CapturedNode {
+        unsigned id_;
+        std::vector<Urho3D::Variant> attributes_;
+        std::vector<CapturedComponent> components_;
+        unsigned numChildren_;
+    };
+
+    /// File work of one save or load.
+    struct Job {
+        Urho3D::Context *context_;
+        bool save_;
+        Urho3D::String fileName_;
+        Urho3D::String tempName_;
+        Urho3D::WeakPtr<Urho3D::Scene> scene_;
+        /// Captured scene of a save.
+        std::vector<CapturedNode> nodes_;
+        /// Scene of a save in the binary format.
+        Urho3D::VectorBuffer data_;
+        bool compress_;
+        bool success_;
+        /// File and offset of the scene data to load.
+        Urho3D::String loadName_;
+        unsigned loadOffset_;
+        /// Uncompressed and file size.
+        unsigned rawSize_;
+        unsigned fileSize_;
+        /// Main thread and worker thread time.
+        long long mainUSec_;
+        long long workUSec_;
+        Urho3D::SharedPtr<Urho3D::WorkItem> item_;
+    };
+
+    /// Handle the update event to finish the file work.
+    void HandleUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the scene finishing an incremental load.
+    void HandleAsyncLoadFinished(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Queue the file work of a job.
+    void StartJob();
+    /// Work item function doing the file work of a job.
+    static void JobWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+    /// Copy the saved attributes of a node, its components and its children.
+    static void CaptureNode(const Urho3D::Node *node, std::vector<CapturedNode> &nodes);
+    /// Write a captured node and its children in the binary format of Node::Save. Return the index after them.
+    static unsigned SerializeNode(const std::vector<CapturedNode> &nodes, unsigned index, Urho3D::Serializer &dest,
+                                  bool &success);
+    /// Serialize, compress and write a captured scene.
+    static void WriteSnapshot(Job &job);
+    /// Read and decompress a snapshot.
+    static void ReadSnapshot(Job &job);
+
+    /// Whether saved snapshots are compressed.
+    bool compression_;
+    /// Save or load with file work in progress.
+    std::unique_ptr<Job> job_;
+    /// File being loaded incrementally.
+    Urho3D::SharedPtr<Urho3D::File> loadFile_;
+    /// Scene being loaded incrementally.
+    Urho3D::WeakPtr<Urho3D::Scene> loadScene_;
+    /// Temporary file to delete after the incremental load.
+    Urho3D::String loadTempName_;
+    /// Time spent reading the snapshot before the incremental load.
+    long long loadReadUSec_;
+    /// Number of frames the incremental load took.
+    unsigned loadFrames_;
+    /// Time since the incremental load started.
+    Urho3D::HiresTimer loadTimer_;
+};
+
+#endif //AIBATTLEGROUND_SCENESNAPSHOT_HPP
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <utility>
+
+#include "SpatialGrid.hpp"
+
+using namespace Urho3D;
+
+SpatialGrid::SpatialGrid(const BoundingBox &bounds, float cellSize) :
+  originX_(bounds.min_.x_),
+  originZ_(bounds.min_.z_),
+  cellSize_(Max(cellSize, M_EPSILON)),
+  invCellSize_(1.0f/cellSize_),
+  numCellsX_(Max(CeilToInt((bounds.max_.x_ - bounds.min_.x_)*invCellSize_), 1)),
+  numCellsZ_(Max(CeilToInt((bounds.max_.z_ - bounds.min_.z_)*invCellSize_), 1)),
+  cellHeads_((unsigned) (numCellsX_*numCellsZ_), M_MAX_UNSIGNED),
+  numItems_(0) {
+}
+
+void SpatialGrid::Update(unsigned id, float x, float z) {
+    if (id >= cells_.size()) {
+        cells_.resize(id + 1, M_MAX_UNSIGNED);
+        next_.resize(id + 1, M_MAX_UNSIGNED);
+        prev_.resize(id + 1, M_MAX_UNSIGNED);
+        posX_.resize(id + 1, 0.0f);
+        posZ_.resize(id + 1, 0.0f);
+    }
+
+    posX_[id] = x;
+    posZ_[id] = z;
+
+    const auto cell = (unsigned) (CellZ(z)*numCellsX_ + CellX(x));
+    if (cells_[id] == cell)
+        return;
+
+    if (cells_[id] == M_MAX_UNSIGNED)
+        ++numItems_;
+    else
+        Unlink(id);
+    Link(id, cell);
+}
+
+void SpatialGrid::Remove(unsigned id) {
+    if (!Contains(id))
+        return;
+
+    Unlink(id);
+    cells_[id] = M_MAX_UNSIGNED;
+    --numItems_;
+}
+
+void SpatialGrid::Clear() {
+    std::fill(cellHeads_.begin(), cellHeads_.end(), M_MAX_UNSIGNED);
+    cells_.clear();
+    next_.clear();
+    prev_.clear();
+    posX_.clear();
+    posZ_.clear();
+    numItems_ = 0;
+}
+
+void SpatialGrid::QueryRadius(float x, float z, float radius, PODVector<unsigned> &result) const {
+    const float radiusSquared = radius*radius;
+    const int minX = CellX(x - radius);
+    const int maxX = CellX(x + radius);
+    const int minZ = CellZ(z - radius);
+    const int maxZ = CellZ(z + radius);
+
+    for (int gz = minZ; gz <= maxZ; ++gz) {
+        for (int gx = minX; gx <= maxX; ++gx) {
+            for (unsigned id = cellHeads_[gz*numCellsX_ + gx]; id != M_MAX_UNSIGNED; id = next_[id]) {
+                const float dx = posX_[id] - x;
+                const float dz = posZ_[id] - z;
+                if (dx*dx + dz*dz <= radiusSquared)
+                    result.Push(id);
+            }
+        }
+    }
+}
+
+void SpatialGrid::QueryBox(const BoundingBox &box, PODVector<unsigned> &result) const {
+    const int minX = CellX(box.min_.x_);
+    const int maxX = CellX(box.max_.x_);
+    const int minZ = CellZ(box.min_.z_);
+    const int maxZ = CellZ(box.max_.z_);
+
+    for (int gz = minZ; gz <= maxZ; ++gz) {
+        for (int gx = minX; gx <= maxX; ++gx) {
+            for (unsigned id = cellHeads_[gz*numCellsX_ + gx]; id != M_MAX_UNSIGNED; id = next_[id]) {
+                if (posX_[id] >= box.min_.x_ && posX_[id] <= box.max_.x_ && posZ_[id] >= box.min_.z_
+                  && posZ_[id] <= box.max_.z_)
+                    result.Push(id);
+            }
+        }
+    }
+}
+
+void SpatialGrid::QueryNearest(float x, float z, unsigned k, PODVector<unsigned> &result) const {
+    if (!k || !numItems_)
+        return;
+
+    // Max-heap of the best candidates so far, the farthest one on top
+    std::vector<std::pair<float, unsigned>> best;
+    best.reserve(k + 1);
+
+    const int centerX = CellX(x);
+    const int centerZ = CellZ(z);
+    const int maxRing = Max(numCellsX_, numCellsZ_);
+
+    for (int ring = 0; ring <= maxRing; ++ring) {
+        // Every cell of this ring is at least (ring - 1) cells away from the point, stop once that exceeds the k-th best
+        if (best.size() == k && ring > 1) {
+            const float minDistance = (ring - 1)*cellSize_;
+            if (minDistance*minDistance > best.front().first)
+                break;
+        }
+
+        for (int gz = centerZ - ring; gz <= centerZ + ring; ++gz) {
+            if (gz < 0 || gz >= numCellsZ_)
+                continue;
+            // Inner rows of the ring only have their two end cells in the ring
+            const bool edgeRow = gz == centerZ - ring || gz == centerZ + ring;
+            const int stepX = edgeRow ? 1 : 2*ring;
+            for (int gx = centerX - ring; gx <= centerX + ring; gx += stepX) {
+                if (gx < 0 || gx >= numCellsX_)
+                    continue;
+                for (unsigned id = cellHeads_[gz*numCellsX_ + gx]; id != M_MAX_UNSIGNED; id = next_[id]) {
+                    const float dx = posX_[id] - x;
+                    const float dz = posZ_[id] - z;
+                    const float distanceSquared = dx*dx + dz*dz;
+                    if (best.size() < k) {
+                        best.emplace_back(distanceSquared, id);
+                        std::push_heap(best.begin(), best.end());
+                    } else if (distanceSquared < best.front().first) {
+                        std::pop_heap(best.begin(), best.end());
+                        best.back() = std::make_pair(distanceSquared, id);
+                        std::push_heap(best.begin(), best.end());
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    for (const auto &candidate : best)
+        result.Push(candidate.second);
+}
+
+void SpatialGrid::QueryRadiusBatch(const PODVector<Vector3> &centers, float radius, PODVector<unsigned> &result,
+                                   PODVector<unsigned> &offsets) const {
+    offsets.Clear();
+    offsets.Reserve(centers.Size() + 1);
+    for (const Vector3 &center : centers) {
+        offsets.Push(result.Size());
+        QueryRadius(center.x_, center.z_, radius, result);
+    }
+    offsets.Push(result.Size());
+}
+
+int SpatialGrid::CellX(float x) const {
+    return Clamp(FloorToInt((x - originX_)*invCellSize_), 0, numCellsX_ - 1);
+}
+
+int SpatialGrid::CellZ(float z) const {
+    return Clamp(FloorToInt((z - originZ_)*invCellSize_), 0, numCellsZ_ - 1);
+}
+
+void SpatialGrid::Link(unsigned id, unsigned cell) {
+    const unsigned head = cellHeads_[cell];
+    cells_[id] = cell;
+    prev_[id] = M_MAX_UNSIGNED;
+    next_[id] = head;
+    if (head != M_MAX_UNSIGNED)
+        prev_[head] = id;
+    cellHeads_[cell] = id;
+}
+
+void SpatialGrid::Unlink(unsigned id) {
+    const unsigned prev = prev_[id];
+    const unsigned next = next_[id];
+    if (prev != M_MAX_UNSIGNED)
+        next_[prev] = next;
+    else
+        cellHeads_[cells_[id]] = next;
+    if (next != M_MAX_UNSIGNED)
+        prev_[next] = prev;
+}
@@ -0,0 +1,74 @@
+#ifndef AIBATTLEGROUND_SPATIALGRID_HPP
+#define AIBATTLEGROUND_SPATIALGRID_HPP
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <vector>
+
+/// Uniform grid over the XZ plane for neighbourhood queries. Items are identified by small integer ids and linked into
+/// per-cell intrusive lists, so moving an item costs nothing unless it crosses a cell border. Queries append matching
+/// item ids to dense output arrays.
+class SpatialGrid {
+ public:
+    /// Construct covering the XZ extent of the bounds. Positions outside are clamped to the border cells.
+    SpatialGrid(const Urho3D::BoundingBox &bounds, float cellSize);
+
+    /// Insert or move an item.
+    void Update(unsigned id, float x, float z);
+    /// Remove an item.
+    void Remove(unsigned id);
+    /// Remove all items.
+    void Clear();
+
+    /// Append ids of items within radius of a point.
+    void QueryRadius(float x, float z, float radius, Urho3D::PODVector<unsigned> &result) const;
+    /// Append ids of items inside the XZ extent of a box.
+    void QueryBox(const Urho3D::BoundingBox &box, Urho3D::PODVector<unsigned> &result) const;
+    /// Append ids of the k nearest items to a point, nearest first.
+    void QueryNearest(float x, float z, unsigned k, Urho3D::PODVector<unsigned> &result) const;
+    /// Run a radius query for each center. Results of center i are result[offsets[i]] .. result[offsets[i + 1] - 1].
+    void QueryRadiusBatch(const Urho3D::PODVector<Urho3D::Vector3> &centers, float radius,
+                          Urho3D::PODVector<unsigned> &result, Urho3D::PODVector<unsigned> &offsets) const;
+
+    /// Return whether the item is in the grid.
+    bool Contains(unsigned id) const { return id < cells_.size() && cells_[id] != Urho3D::M_MAX_UNSIGNED; }
+    /// Return number of items.
+    unsigned GetNumItems() const { return numItems_; }
+    /// Return cell size.
+    float GetCellSize() const { return cellSize_; }
+
+ private:
+    /// Return cell column of an X coordinate.
+    int CellX(float x) const;
+    /// Return cell row of a Z coordinate.
+    int CellZ(float z) const;
+    /// Link an item into a cell list.
+    void Link(unsigned id, unsigned cell);
+    /// Unlink an item from its cell list.
+    void Unlink(unsigned id);
+
+    /// Grid origin on the XZ plane.
+    float originX_;
+    float originZ_;
+    /// Cell size.
+    float cellSize_;
+    /// Reciprocal of the cell size.
+    float invCellSize_;
+    /// Number of cell columns and rows.
+    int numCellsX_;
+    int numCellsZ_;
+    /// First item of each cell, M_MAX_UNSIGNED when empty.
+    std::vector<unsigned> cellHeads_;
+    /// Cell of each item, M_MAX_UNSIGNED when not in the grid.
+    std::vector<unsigned> cells_;
+    /// Next and previous item in the same cell.
+    std::vector<unsigned> next_;
+    std::vector<unsigned> prev_;
+    /// Item positions.
+    std::vector<float> posX_;
+    std::vector<float> posZ_;
+    /// Number of items.
+    unsigned numItems_;
+};
+
+#endif //AIBATTLEGROUND_SPATIALGRID_HPP
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "SpawnScheduler.hpp"
+#include "TraceRecorder.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Camera movement after which the queue is prioritized again.
+const float REPRIORITIZE_DISTANCE = 20.0f;
+
+}
+
+SpawnScheduler::SpawnScheduler(Context *context) :
+  Component(context),
+  budget_(4.0f),
+  fixedCount_(0),
+  nextOrder_(0),
+  numSpawned_(0),
+  numFrames_(0),
+  buildUSec_(0) {
+}
+
+void SpawnScheduler::Enqueue(const Vector3 &position, BuildFunction build) {
+    queue_.push_back(Entry{position, (position - cameraPosition_).LengthSquared(), nextOrder_++, std::move(build)});
+    std::push_heap(queue_.begin(), queue_.end(), IsLater);
+}
+
+void SpawnScheduler::OnSceneSet(Scene *scene) {
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(SpawnScheduler, HandleSceneUpdate));
+    else
+        UnsubscribeFromEvent(E_SCENEUPDATE);
+}
+
+void SpawnScheduler::HandleSceneUpdate(StringHash eventType, VariantMap &eventData) {
+    if (queue_.empty() || !IsEnabledEffective())
+        return;
+    AIBG_PROFILE(SpawnQueue);
+
+    if (camera_) {
+        const Vector3 &cameraPosition = camera_->GetWorldPosition();
+        if ((cameraPosition - cameraPosition_).LengthSquared() > REPRIORITIZE_DISTANCE*REPRIORITIZE_DISTANCE)
+            Prioritize(cameraPosition);
+    }
+
+    HiresTimer timer;
+    const auto budgetUSec = (long long) (budget_*1000.0f);
+    unsigned numBuilt = 0;
+    while (!queue_.empty()) {
+        if (fixedCount_ ? numBuilt >= fixedCount_ : numBuilt && timer.GetUSec(false) >= budgetUSec)
+            break;
+
+        // Taken off the queue before building, the build may queue more entities
+        std::pop_heap(queue_.begin(), queue_.end(), IsLater);
+        Entry entry = std::move(queue_.back());
+        queue_.pop_back();
+        entry.build_();
+        ++numBuilt;
+    }
+
+    numSpawned_ += numBuilt;
+    buildUSec_ += timer.GetUSec(false);
+    ++numFrames_;
+    if (auto *debugHud = GetSubsystem<DebugHud>())
+        debugHud->SetAppStats("Spawn queue", GetNumQueued());
+
+    if (queue_.empty()) {
+        using namespace SpawnsFinished;
+
+        URHO3D_LOGINFOF("Spawned %u entities over %u frames, %.1f ms of building", numSpawned_, numFrames_,
+                        (float) buildUSec_/1000.0f);
+        VariantMap &finishedData = GetEventDataMap();
+        finishedData[P_NUMSPAWNED] = numSpawned_;
+        numSpawned_ = 0;
+        numFrames_ = 0;
+        buildUSec_ = 0;
+        SendEvent(E_SPAWNSFINISHED, finishedData);
+    }
+}
+
+void SpawnScheduler::Prioritize(const Vector3 &cameraPosition) {
+    cameraPosition_ = cameraPosition;
+    for (Entry &entry : queue_)
+        entry.distance_ = (entry.position_ - cameraPosition_).LengthSquared();
+    std::make_heap(queue_.begin(), queue_.end(), IsLater);
+}
+
+bool SpawnScheduler::IsLater(const Entry &lhs, const Entry &rhs) {
+    if (lhs.distance_ != rhs.distance_)
+        return lhs.distance_ > rhs.distance_;
+    return lhs.order_ > rhs.order_;
+}
@@ -0,0 +1,90 @@
+#ifndef AIBATTLEGROUND_SPAWNSCHEDULER_HPP
+#define AIBATTLEGROUND_SPAWNSCHEDULER_HPP
+
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
+#include <functional>
+#include <vector>
+
+/// Spawn queue ran empty. Sent by the SpawnScheduler.
+URHO3D_EVENT(E_SPAWNSFINISHED, SpawnsFinished) {
+    URHO3D_PARAM(P_NUMSPAWNED, NumSpawned);   // unsigned
+}
+
+/// Builds queued entities a few at a time on the scene update instead of all at once, nearest to the camera first.
+/// Each frame spends at most a time budget on building, so the first frames do not wait for the whole population and
+/// the rigid bodies do not all wake up together. Reproducible runs use a fixed count per frame instead, as the number of
+/// entities a time budget fits depends on the machine.
+class SpawnScheduler : public Urho3D::Component {
+    URHO3D_OBJECT(SpawnScheduler, Urho3D::Component);
+
+ public:
+    /// Function building one entity.
+    using BuildFunction = std::function<void()>;
+
+    /// Construct.
+    explicit SpawnScheduler(Urho3D::Context *context);
+
+    /// Set camera the priorities are measured from.
+    void SetCamera(Urho3D::Node *camera) { camera_ = camera; }
+    /// Set building time per frame in milliseconds. At least one entity is built per frame.
+    void SetBudget(float msec) { budget_ = Urho3D::Max(msec, 0.0f); }
+    /// Set a fixed number of entities built per frame, ignoring the time budget. Zero uses the time budget.
+    void SetFixedCount(unsigned count) { fixedCount_ = count; }
+    /// Queue an entity at a position.
+    void Enqueue(const Urho3D::Vector3 &position, BuildFunction build);
+
+    /// Return camera node.
+    Urho3D::Node *GetCamera() const { return camera_; }
+    /// Return building time per frame in milliseconds.
+    float GetBudget() const { return budget_; }
+    /// Return fixed number of entities built per frame.
+    unsigned GetFixedCount() const { return fixedCount_; }
+    /// Return number of entities waiting to be built.
+    unsigned GetNumQueued() const { return (unsigned) queue_.size(); }
+    /// Return number of entities built since the queue was last empty.
+    unsigned GetNumSpawned() const { return numSpawned_; }
+
+ protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Urho3D::Scene *scene) override;
+
+ private:
+    /// Queued entity.
+    struct Entry {
+        Urho3D::Vector3 position_;
+        /// Squared distance to the camera when last prioritized.
+        float distance_;
+        /// Queue order, breaks distance ties so that the build order does not depend on the heap implementation.
+        unsigned order_;
+        BuildFunction build_;
+    };
+
+    /// Handle the scene update event.
+    void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Recompute the distances from the camera and reorder the queue.
+    void Prioritize(const Urho3D::Vector3 &cameraPosition);
+    /// Return whether an entry is built after another.
+    static bool IsLater(const Entry &lhs, const Entry &rhs);
+
+    /// Camera node.
+    Urho3D::WeakPtr<Urho3D::Node> camera_;
+    /// Camera position the queue was last prioritized from.
+    Urho3D::Vector3 cameraPosition_;
+    /// Queued entities as a heap, nearest on top.
+    std::vector<Entry> queue_;
+    /// Building time per frame.
+    float budget_;
+    /// Fixed number of entities built per frame.
+    unsigned fixedCount_;
+    /// Queue order of the next entry.
+    unsigned nextOrder_;
+    /// Entities built since the queue was last empty.
+    unsigned numSpawned_;
+    /// Frames spent building since the queue was last empty.
+    unsigned numFrames_;
+    /// Building time since the queue was last empty.
+    long long buildUSec_;
+};
+
+#endif //AIBATTLEGROUND_SPAWNSCHEDULER_HPP
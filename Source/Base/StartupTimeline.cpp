@@ -0,0 +1,290 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/LibraryInfo.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include <Urho3D/Resource/ResourceEvents.h>
+
+#include "StartupTimeline.hpp"
+
+// Application revision, given by the build
+#ifndef AIBATTLEGROUND_REVISION
+#define AIBATTLEGROUND_REVISION "unknown"
+#endif
+
+using namespace Urho3D;
+
+namespace {
+
+/// Whether heap allocations are counted, only while a timeline runs.
+std::atomic<bool> countAllocations(false);
+/// Heap allocations counted.
+std::atomic<unsigned long long> numAllocations(0);
+/// Bytes of the heap allocations counted.
+std::atomic<unsigned long long> allocatedBytes(0);
+
+/// Allocate and count while counting is on.
+void *CountedAlloc(std::size_t size) noexcept {
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        numAllocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return std::malloc(size ? size : 1);
+}
+
+/// Return microseconds as milliseconds.
+double ToMSec(long long usec) {
+    return (double) usec/1000.0;
+}
+
+}
+
+// The global allocation functions are replaced to count the allocations of the whole process, the engine included.
+// The aligned variants are left to the standard library, they pair with their own deallocation functions.
+void *operator new(std::size_t size) {
+    if (void *memory = CountedAlloc(size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    if (void *memory = CountedAlloc(size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return CountedAlloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return CountedAlloc(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+void StartupTimeline::FileRecorder::Route(String &name, ResourceRequest requestType) {
+    if (requestType == RESOURCE_GETFILE)
+        timeline_->AddFile(name);
+}
+
+StartupTimeline::StartupTimeline(Context *context) :
+  Object(context),
+  coldStart_(false),
+  finishing_(false),
+  finished_(false) {
+    outputDir_ = GetSubsystem<FileSystem>()->GetAppPreferencesDir("AIBattleGround", "logs");
+    countAllocations.store(true, std::memory_order_relaxed);
+
+    if (auto *cache = GetSubsystem<ResourceCache>()) {
+        fileRecorder_ = new FileRecorder(context, this);
+        cache->AddResourceRouter(fileRecorder_, true);
+    }
+    SubscribeToEvent(E_RESOURCEBACKGROUNDLOADED, URHO3D_HANDLER(StartupTimeline, HandleResourceBackgroundLoaded));
+}
+
+StartupTimeline::~StartupTimeline() {
+    if (fileRecorder_) {
+        if (auto *cache = GetSubsystem<ResourceCache>())
+            cache->RemoveResourceRouter(fileRecorder_);
+    }
+    if (!finished_)
+        countAllocations.store(false, std::memory_order_relaxed);
+}
+
+void StartupTimeline::BeginPhase(const String &name) {
+    if (finished_)
+        return;
+    open_.push_back((unsigned) phases_.size());
+    phases_.push_back(Phase{name, (unsigned) open_.size() - 1, timer_.GetUSec(false), -1, GetNumAllocations(),
+                            GetAllocatedBytes()});
+}
+
+void StartupTimeline::EndPhase() {
+    if (open_.empty())
+        return;
+    Phase &phase = phases_[open_.back()];
+    open_.pop_back();
+    phase.endUSec_ = timer_.GetUSec(false);
+    phase.allocations_ = GetNumAllocations() - phase.allocations_;
+    phase.allocatedBytes_ = GetAllocatedBytes() - phase.allocatedBytes_;
+}
+
+void StartupTimeline::Finish() {
+    if (finishing_ || finished_)
+        return;
+    finishing_ = true;
+    BeginPhase("FirstFrame");
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(StartupTimeline, HandleEndFrame));
+}
+
+unsigned long long StartupTimeline::GetNumAllocations() {
+    return numAllocations.load(std::memory_order_relaxed);
+}
+
+unsigned long long StartupTimeline::GetAllocatedBytes() {
+    return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+bool StartupTimeline::ColdStartFromArguments(const Vector<String> &arguments) {
+    for (const String &argument : arguments) {
+        if (argument.ToLower() == "-coldstart")
+            return true;
+    }
+    return false;
+}
+
+void StartupTimeline::AddFile(const String &name) {
+    std::lock_guard<std::mutex> lock(filesMutex_);
+    files_.push_back(FileLoad{name, timer_.GetUSec(false), -1});
+}
+
+const String &StartupTimeline::GetPhaseName(long long usec) const {
+    const Phase *innermost = nullptr;
+    for (const Phase &phase : phases_) {
+        if (usec >= phase.beginUSec_ && usec <= phase.endUSec_ && (!innermost || phase.depth_ > innermost->depth_))
+            innermost = &phase;
+    }
+    return innermost ? innermost->name_ : String::EMPTY;
+}
+
+void StartupTimeline::HandleResourceBackgroundLoaded(StringHash eventType, VariantMap &eventData) {
+    using namespace ResourceBackgroundLoaded;
+
+    const String &name = eventData[P_RESOURCENAME].GetString();
+    const long long now = timer_.GetUSec(false);
+    std::lock_guard<std::mutex> lock(filesMutex_);
+    for (auto i = files_.rbegin(); i != files_.rend(); ++i) {
+        if (i->readyUSec_ < 0 && i->name_ == name) {
+            i->readyUSec_ = now;
+            break;
+        }
+    }
+}
+
+void StartupTimeline::HandleEndFrame(StringHash eventType, VariantMap &eventData) {
+    UnsubscribeFromEvent(E_ENDFRAME);
+    UnsubscribeFromEvent(E_RESOURCEBACKGROUNDLOADED);
+    while (!open_.empty())
+        EndPhase();
+    const long long totalUSec = timer_.GetUSec(false);
+    finished_ = true;
+    countAllocations.store(false, std::memory_order_relaxed);
+
+    // The file sizes are read now, so that the files opened for them are not part of the startup
+    auto *cache = GetSubsystem<ResourceCache>();
+    if (fileRecorder_ && cache)
+        cache->RemoveResourceRouter(fileRecorder_);
+    fileRecorder_.Reset();
+
+    const String fileName = outputDir_ + "Startup_" + Time::GetTimeStamp().Replaced(':', '_').Replaced('.', '_')
+                                                        .Replaced(' ', '_') + ".json";
+    if (Save(fileName, totalUSec)) {
+        fileName_ = fileName;
+        URHO3D_LOGINFOF("Startup took %.1f ms, report written to %s", ToMSec(totalUSec), fileName.CString());
+    } else
+        URHO3D_LOGERROR("Could not write startup report " + fileName);
+}
+
+bool StartupTimeline::Save(const String &fileName, long long totalUSec) {
+    auto *cache = GetSubsystem<ResourceCache>();
+
+    // Resources by name, for the type and memory use of the files that were loaded as resources
+    HashMap<StringHash, Resource *> resources;
+    if (cache) {
+        for (auto group = cache->GetAllResources().Begin(); group != cache->GetAllResources().End(); ++group) {
+            for (auto resource = group->second_.resources_.Begin(); resource != group->second_.resources_.End();
+                 ++resource)
+                resources[resource->first_] = resource->second_;
+        }
+    }
+
+    std::vector<unsigned> fileBytes;
+    unsigned long long totalBytes = 0;
+    JSONArray files;
+    for (const FileLoad &load : files_) {
+        SharedPtr<File> file = cache ? cache->GetFile(load.name_, false) : SharedPtr<File>();
+        fileBytes.push_back(file ? file->GetSize() : 0);
+        totalBytes += fileBytes.back();
+
+        JSONValue entry;
+        entry.Set("name", JSONValue(load.name_));
+        entry.Set("phase", JSONValue(GetPhaseName(load.requestUSec_)));
+        entry.Set("requestMs", JSONValue(ToMSec(load.requestUSec_)));
+        if (load.readyUSec_ >= 0) {
+            entry.Set("readyMs", JSONValue(ToMSec(load.readyUSec_)));
+            entry.Set("loadMs", JSONValue(ToMSec(load.readyUSec_ - load.requestUSec_)));
+        }
+        entry.Set("fileBytes", JSONValue(fileBytes.back()));
+        auto resource = resources.Find(StringHash(load.name_));
+        if (resource != resources.End()) {
+            entry.Set("type", JSONValue(resource->second_->GetTypeName()));
+            entry.Set("memoryBytes", JSONValue(resource->second_->GetMemoryUse()));
+        }
+        files.Push(entry);
+    }
+
+    // Nested phases count toward their parents, so the files are matched to every phase open when requested
+    JSONArray phases;
+    for (const Phase &phase : phases_) {
+        unsigned numFiles = 0;
+        unsigned long long bytes = 0;
+        for (unsigned i = 0; i < files_.size(); ++i) {
+            if (files_[i].requestUSec_ >= phase.beginUSec_ && files_[i].requestUSec_ <= phase.endUSec_) {
+                ++numFiles;
+                bytes += fileBytes[i];
+            }
+        }
+
+        JSONValue entry;
+        entry.Set("name", JSONValue(phase.name_));
+        entry.Set("depth", JSONValue(phase.depth_));
+        entry.Set("beginMs", JSONValue(ToMSec(phase.beginUSec_)));
+        entry.Set("durationMs", JSONValue(ToMSec(phase.endUSec_ - phase.beginUSec_)));
+        entry.Set("files", JSONValue(numFiles));
+        entry.Set("fileBytes", JSONValue((double) bytes));
+        entry.Set("allocations", JSONValue((double) phase.allocations_));
+        entry.Set("allocatedBytes", JSONValue((double) phase.allocatedBytes_));
+        phases.Push(entry);
+    }
+
+    JSONFile report(context_);
+    JSONValue &root = report.GetRoot();
+    root.Set("revision", JSONValue(AIBATTLEGROUND_REVISION));
+    root.Set("engineRevision", JSONValue(GetRevision()));
+    root.Set("coldStart", JSONValue(coldStart_));
+    root.Set("totalMs", JSONValue(ToMSec(totalUSec)));
+    root.Set("fileBytes", JSONValue((double) totalBytes));
+    root.Set("allocations", JSONValue((double) GetNumAllocations()));
+    root.Set("allocatedBytes", JSONValue((double) GetAllocatedBytes()));
+    root.Set("phases", JSONValue(phases));
+    root.Set("files", JSONValue(files));
+    return report.SaveFile(fileName);
+}
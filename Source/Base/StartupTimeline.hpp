@@ -0,0 +1,122 @@
+#ifndef AIBATTLEGROUND_STARTUPTIMELINE_HPP
+#define AIBATTLEGROUND_STARTUPTIMELINE_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <mutex>
+#include <vector>
+
+/// Records the startup of the application, from Setup to the end of the first frame with the episode built, as a
+/// sequence of named phases. Each phase gets its wall time, the files the resource cache opened and their bytes, and
+/// the number and bytes of heap allocations; each opened file gets the phase and time it was requested and, when
+/// loaded in the background, the time it was ready. Synchronous loads finish inside the phase without an event, so
+/// their time is only known through the phase. Once the frame after Finish() ends, a JSON report is written to the log
+/// directory, to compare cold and warm starts between builds: it names the application and engine revision and whether
+/// the start was marked cold. File bytes are the sizes of the opened files, not the bytes read. Register as a
+/// subsystem as early as possible.
+class StartupTimeline : public Urho3D::Object {
+    URHO3D_OBJECT(StartupTimeline, Urho3D::Object);
+
+ public:
+    /// Construct and start the timeline.
+    explicit StartupTimeline(Urho3D::Context *context);
+    /// Destruct.
+    ~StartupTimeline() override;
+
+    /// Begin a phase, nested in the open ones.
+    void BeginPhase(const Urho3D::String &name);
+    /// End the innermost open phase.
+    void EndPhase();
+    /// End all phases with the next frame and write the report.
+    void Finish();
+    /// Set directory of the report.
+    void SetOutputDir(const Urho3D::String &dir) { outputDir_ = dir; }
+    /// Set whether the start is cold, after the OS file cache was dropped. Only noted in the report.
+    void SetColdStart(bool enable) { coldStart_ = enable; }
+
+    /// Return whether the report has been written.
+    bool IsFinished() const { return finished_; }
+    /// Return file of the written report.
+    const Urho3D::String &GetFileName() const { return fileName_; }
+
+    /// Return number of heap allocations counted so far.
+    static unsigned long long GetNumAllocations();
+    /// Return bytes of heap allocations counted so far.
+    static unsigned long long GetAllocatedBytes();
+    /// Return whether the start is marked cold with -coldstart.
+    static bool ColdStartFromArguments(const Urho3D::Vector<Urho3D::String> &arguments);
+
+ private:
+    /// Resource router noting every file the cache opens.
+    class FileRecorder : public Urho3D::ResourceRouter {
+        URHO3D_OBJECT(FileRecorder, Urho3D::ResourceRouter);
+
+     public:
+        /// Construct.
+        FileRecorder(Urho3D::Context *context, StartupTimeline *timeline) :
+          ResourceRouter(context),
+          timeline_(timeline) {
+        }
+        /// Note a file request. Called from the background loading thread as well.
+        void Route(Urho3D::String &name, Urho3D::ResourceRequest requestType) override;
+
+     private:
+        /// Timeline recorded into.
+        StartupTimeline *timeline_;
+    };
+
+    /// Startup phase.
+    struct Phase {
+        Urho3D::String name_;
+        unsigned depth_;
+        long long beginUSec_;
+        long long endUSec_;
+        unsigned long long allocations_;
+        unsigned long long allocatedBytes_;
+    };
+
+    /// File opened by the resource cache.
+    struct FileLoad {
+        Urho3D::String name_;
+        long long requestUSec_;
+        /// Time it was ready when loaded in the background, negative otherwise.
+        long long readyUSec_;
+    };
+
+    /// Record a file request.
+    void AddFile(const Urho3D::String &name);
+    /// Return name of the innermost phase at a time.
+    const Urho3D::String &GetPhaseName(long long usec) const;
+    /// Handle a background loaded resource.
+    void HandleResourceBackgroundLoaded(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the frame end event.
+    void HandleEndFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Write the report with the total startup time. Return true on success.
+    bool Save(const Urho3D::String &fileName, long long totalUSec);
+
+    /// Phases in begin order.
+    std::vector<Phase> phases_;
+    /// Indices of the open phases.
+    std::vector<unsigned> open_;
+    /// Opened files in request order.
+    std::vector<FileLoad> files_;
+    /// Guards the files against the background loading thread.
+    std::mutex filesMutex_;
+    /// File router, removed once finished.
+    Urho3D::SharedPtr<FileRecorder> fileRecorder_;
+    /// Time since construction.
+    Urho3D::HiresTimer timer_;
+    /// Directory of the report.
+    Urho3D::String outputDir_;
+    /// File of the written report.
+    Urho3D::String fileName_;
+    /// Whether the start is cold.
+    bool coldStart_;
+    /// Whether Finish() was called.
+    bool finishing_;
+    /// Whether the report has been written.
+    bool finished_;
+};
+
+#endif //AIBATTLEGROUND_STARTUPTIMELINE_HPP
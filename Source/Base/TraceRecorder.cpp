@@ -0,0 +1,309 @@
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/EngineEvents.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+
+#include "TraceRecorder.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Blocks one thread can record per trace.
+const unsigned EVENTS_PER_THREAD = 1u << 18;
+/// Trace thread id of the engine profiler track.
+const unsigned ENGINE_TRACK = 0;
+
+/// Finished block.
+struct TraceEvent {
+    const char *name_;
+    long long begin_;
+    long long end_;
+};
+
+/// Fixed-size block buffer of one thread. Only the owning thread writes; the recorder reads the blocks below the
+/// published count after recording has stopped. A new recording is noticed by the owner, which then resets the count.
+struct TraceBuffer {
+    /// Blocks.
+    std::unique_ptr<TraceEvent[]> events_;
+    /// Recording the blocks belong to.
+    std::atomic<unsigned> session_;
+    /// Blocks written.
+    std::atomic<unsigned> count_;
+    /// Blocks that did not fit.
+    std::atomic<unsigned> dropped_;
+    /// Trace thread id.
+    unsigned threadId_;
+    /// Whether owned by the main thread.
+    bool mainThread_;
+};
+
+/// Current recording, buffers stamped with an older one are empty.
+std::atomic<unsigned> traceSession(0);
+/// Buffers of all threads that have recorded, only locked when a thread records for the first time and when saving.
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+/// Buffer of the calling thread.
+thread_local TraceBuffer *threadBuffer = nullptr;
+
+/// Create and register the calling thread's buffer.
+TraceBuffer *CreateThreadBuffer() {
+    auto *buffer = new TraceBuffer;
+    buffer->events_.reset(new TraceEvent[EVENTS_PER_THREAD]);
+    buffer->session_ = M_MAX_UNSIGNED;
+    buffer->count_ = 0;
+    buffer->dropped_ = 0;
+    buffer->mainThread_ = Thread::IsMainThread();
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffer->threadId_ = (unsigned) traceBuffers.size() + 1;
+    traceBuffers.emplace_back(buffer);
+    return buffer;
+}
+
+/// Return time relative to a start in trace microseconds.
+String ToTraceTime(long long time, long long start) {
+    return String((double) (time - start)/1000.0);
+}
+
+/// Return a block name as a quoted JSON string.
+String ToJSONString(const char *name) {
+    String quoted("\"");
+    for (const char *c = name; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            quoted += '\\';
+        quoted += *c;
+    }
+    return quoted + "\"";
+}
+
+}
+
+std::atomic<bool> TraceRecorder::tracing_(false);
+
+TraceRecorder::TraceRecorder(Context *context) :
+  Object(context),
+  startTime_(0),
+  frameBegin_(-1),
+  stepBegin_(-1),
+  frameNumber_(0),
+  rangeFirst_(0),
+  rangeLast_(0),
+  framesLeft_(0) {
+    outputDir_ = GetSubsystem<FileSystem>()->GetAppPreferencesDir("AIBattleGround", "logs");
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(TraceRecorder, HandleBeginFrame));
+    SubscribeToEvent(E_PHYSICSPRESTEP, URHO3D_HANDLER(TraceRecorder, HandlePhysicsPreStep));
+    SubscribeToEvent(E_PHYSICSPOSTSTEP, URHO3D_HANDLER(TraceRecorder, HandlePhysicsPostStep));
+    SubscribeToEvent(E_CONSOLECOMMAND, URHO3D_HANDLER(TraceRecorder, HandleConsoleCommand));
+}
+
+TraceRecorder::~TraceRecorder() {
+    if (IsTracing())
+        Stop();
+}
+
+void TraceRecorder::Start(const String &fileName) {
+    if (IsTracing())
+        return;
+
+    fileName_ = fileName;
+    if (fileName_.Empty())
+        fileName_ = outputDir_ + "Trace_" + Time::GetTimeStamp().Replaced(':', '_').Replaced('.', '_').Replaced(' ', '_')
+                    + ".json";
+    engineBlocks_.clear();
+    startTime_ = GetTime();
+    frameBegin_ = -1;
+    stepBegin_ = -1;
+    traceSession.fetch_add(1, std::memory_order_acq_rel);
+    tracing_.store(true, std::memory_order_release);
+    URHO3D_LOGINFO("Trace recording started");
+}
+
+bool TraceRecorder::Stop() {
+    if (!IsTracing())
+        return false;
+
+    // Blocks ending after this are left out: their buffers may still be written, but only above the read counts
+    tracing_.store(false, std::memory_order_release);
+    framesLeft_ = 0;
+    const bool saved = Save(fileName_);
+    if (saved)
+        lastFileName_ = fileName_;
+    else
+        URHO3D_LOGERROR("Could not write trace " + fileName_);
+    return saved;
+}
+
+void TraceRecorder::RecordFrames(unsigned numFrames, const String &fileName) {
+    Start(fileName);
+    framesLeft_ = Max(numFrames, 1u);
+}
+
+void TraceRecorder::SetFrameRange(unsigned first, unsigned last) {
+    rangeFirst_ = first;
+    rangeLast_ = Max(first, last);
+}
+
+bool TraceRecorder::FrameRangeFromArguments(const Vector<String> &arguments, unsigned &first, unsigned &last) {
+    for (unsigned i = 0; i + 1 < arguments.Size(); ++i) {
+        if (arguments[i].ToLower() != "-trace")
+            continue;
+        const Vector<String> range = arguments[i + 1].Split('-');
+        if (range.Empty())
+            return false;
+        first = ToUInt(range[0]);
+        last = range.Size() > 1 ? ToUInt(range[1]) : first;
+        return true;
+    }
+    return false;
+}
+
+long long TraceRecorder::GetTime() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecorder::Record(const char *name, long long begin, long long end) {
+    if (!IsTracing())
+        return;
+    TraceBuffer *buffer = threadBuffer;
+    if (!buffer)
+        buffer = threadBuffer = CreateThreadBuffer();
+
+    const unsigned session = traceSession.load(std::memory_order_acquire);
+    if (buffer->session_.load(std::memory_order_relaxed) != session) {
+        buffer->count_.store(0, std::memory_order_relaxed);
+        buffer->dropped_.store(0, std::memory_order_relaxed);
+        buffer->session_.store(session, std::memory_order_release);
+    }
+
+    const unsigned count = buffer->count_.load(std::memory_order_relaxed);
+    if (count >= EVENTS_PER_THREAD) {
+        buffer->dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events_[count] = TraceEvent{name, begin, end};
+    buffer->count_.store(count + 1, std::memory_order_release);
+}
+
+void TraceRecorder::HandleBeginFrame(StringHash eventType, VariantMap &eventData) {
+    ++frameNumber_;
+    const long long now = GetTime();
+
+    if (IsTracing() && frameBegin_ >= 0) {
+        Record("Frame", frameBegin_, now);
+        // The profiler has just closed the last frame, its totals are for the frame recorded above
+        if (auto *profiler = GetSubsystem<Profiler>())
+            AddEngineBlocks(profiler->GetRootBlock(), frameBegin_);
+
+        if (framesLeft_ && !--framesLeft_)
+            Stop();
+    }
+    if (rangeLast_) {
+        if (frameNumber_ == rangeFirst_)
+            Start();
+        else if (frameNumber_ == rangeLast_ + 1)
+            Stop();
+    }
+    frameBegin_ = now;
+}
+
+void TraceRecorder::HandlePhysicsPreStep(StringHash eventType, VariantMap &eventData) {
+    stepBegin_ = GetTime();
+}
+
+void TraceRecorder::HandlePhysicsPostStep(StringHash eventType, VariantMap &eventData) {
+    if (stepBegin_ >= 0)
+        Record("PhysicsStep", stepBegin_, GetTime());
+    stepBegin_ = -1;
+}
+
+void TraceRecorder::HandleConsoleCommand(StringHash eventType, VariantMap &eventData) {
+    using namespace ConsoleCommand;
+
+    if (eventData[P_ID].GetString() != GetTypeName())
+        return;
+    const Vector<String> words = eventData[P_COMMAND].GetString().Split(' ');
+    if (words.Empty())
+        return;
+
+    const String command = words[0].ToLower();
+    const String fileName = words.Size() > 1 ? words.Back() : String::EMPTY;
+    if (command == "start")
+        Start(fileName);
+    else if (command == "stop")
+        Stop();
+    else if (command == "frames" && words.Size() > 1)
+        RecordFrames(ToUInt(words[1]), words.Size() > 2 ? fileName : String::EMPTY);
+    else
+        URHO3D_LOGINFO("Trace commands: start [file], stop, frames <count> [file]");
+}
+
+void TraceRecorder::AddEngineBlocks(const ProfilerBlock *block, long long begin) {
+    if (!block)
+        return;
+    // The profiler keeps its blocks until it is destroyed, so the names stay valid while recording
+    long long childBegin = begin;
+    for (ProfilerBlock *child : block->children_) {
+        if (!child->frameCount_)
+            continue;
+        const long long end = childBegin + child->frameTime_*1000;
+        engineBlocks_.push_back(EngineBlock{child->name_, childBegin, end, child->frameCount_});
+        AddEngineBlocks(child, childBegin);
+        childBegin = end;
+    }
+}
+
+bool TraceRecorder::Save(const String &fileName) const {
+    File file(context_);
+    if (!file.Open(fileName, FILE_WRITE))
+        return false;
+
+    file.WriteLine("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    file.WriteLine(ToString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                            "\"args\":{\"name\":\"Engine profiler (frame totals)\"}}", ENGINE_TRACK));
+    for (const EngineBlock &block : engineBlocks_) {
+        file.WriteLine(",{\"name\":" + ToJSONString(block.name_) + ",\"cat\":\"engine\",\"ph\":\"X\",\"pid\":1,"
+                       "\"tid\":" + String(ENGINE_TRACK) + ",\"ts\":" + ToTraceTime(block.begin_, startTime_)
+                       + ",\"dur\":" + ToTraceTime(block.end_, block.begin_) + ",\"args\":{\"calls\":"
+                       + String(block.calls_) + "}}");
+    }
+
+    const unsigned session = traceSession.load(std::memory_order_acquire);
+    unsigned numEvents = 0;
+    unsigned numDropped = 0;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const std::unique_ptr<TraceBuffer> &buffer : traceBuffers) {
+        if (buffer->session_.load(std::memory_order_acquire) != session)
+            continue;
+        const String threadName = buffer->mainThread_ ? String("Main") : "Worker " + String(buffer->threadId_);
+        file.WriteLine(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + String(buffer->threadId_)
+                       + ",\"args\":{\"name\":\"" + threadName + "\"}}");
+
+        const unsigned count = buffer->count_.load(std::memory_order_acquire);
+        for (unsigned i = 0; i < count; ++i) {
+            const TraceEvent &event = buffer->events_[i];
+            // Blocks begun before the recording started are incomplete
+            if (event.begin_ < startTime_)
+                continue;
+            file.WriteLine(",{\"name\":" + ToJSONString(event.name_) + ",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                           + String(buffer->threadId_) + ",\"ts\":" + ToTraceTime(event.begin_, startTime_)
+                           + ",\"dur\":" + ToTraceTime(event.end_, event.begin_) + "}");
+            ++numEvents;
+        }
+        numDropped += buffer->dropped_.load(std::memory_order_relaxed);
+    }
+    file.WriteLine("],\"otherData\":{\"droppedEvents\":" + String(numDropped) + "}}");
+
+    URHO3D_LOGINFOF("Wrote %u trace blocks and %u engine profiler blocks to %s, %u dropped", numEvents,
+                    (unsigned) engineBlocks_.size(), fileName.CString(), numDropped);
+    return true;
+}
@@ -0,0 +1,128 @@
+#ifndef AIBATTLEGROUND_TRACERECORDER_HPP
+#define AIBATTLEGROUND_TRACERECORDER_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Profiler.h>
+#include <atomic>
+#include <vector>
+
+/// Scope traced on any thread while a TraceRecorder is recording. The name must be a string literal.
+#define AIBG_TRACE(name) TraceScope traceScope_ ## name(#name)
+/// Scope shown in the engine profiler and the debug HUD, and traced while a TraceRecorder is recording. Main thread
+/// only, in an Object, like URHO3D_PROFILE.
+#define AIBG_PROFILE(name) URHO3D_PROFILE(name); AIBG_TRACE(name)
+
+/// Records timed blocks into a Chrome trace event file, which chrome://tracing and Perfetto open. Blocks come from
+/// AIBG_TRACE and AIBG_PROFILE scopes on any thread, from the frames and physics steps, and from the engine Profiler.
+/// Every thread writes its own fixed-size buffer with no locks or allocation, so recording leaves the frame time alone;
+/// blocks past the buffer size are counted as dropped. The engine Profiler only keeps per-frame totals per block, so its
+/// blocks are laid out one after the other from the start of each frame on a track of their own, with their call
+/// counts. Recording is started and stopped with Start() and Stop(), with the "start", "stop" and "frames <n>" console
+/// commands of the TraceRecorder interpreter, or for a frame range given with -trace <first>-<last>. Register as a
+/// subsystem.
+class TraceRecorder : public Urho3D::Object {
+    URHO3D_OBJECT(TraceRecorder, Urho3D::Object);
+
+ public:
+    /// Construct.
+    explicit TraceRecorder(Urho3D::Context *context);
+    /// Destruct.
+    ~TraceRecorder() override;
+
+    /// Start recording into a file, by default a time stamped file in the log directory.
+    void Start(const Urho3D::String &fileName = Urho3D::String::EMPTY);
+    /// Stop recording and write the file. Return true on success.
+    bool Stop();
+    /// Start recording and stop after a number of frames.
+    void RecordFrames(unsigned numFrames, const Urho3D::String &fileName = Urho3D::String::EMPTY);
+    /// Set frames to record, counted from the first frame after construction. Inclusive.
+    void SetFrameRange(unsigned first, unsigned last);
+    /// Set directory of the default trace files.
+    void SetOutputDir(const Urho3D::String &dir) { outputDir_ = dir; }
+
+    /// Return whether recording.
+    bool IsRecording() const { return IsTracing(); }
+    /// Return file of the last written trace.
+    const Urho3D::String &GetLastFileName() const { return lastFileName_; }
+
+    /// Read -trace <first>-<last> from the program arguments. Return false when not given.
+    static bool FrameRangeFromArguments(const Urho3D::Vector<Urho3D::String> &arguments, unsigned &first,
+                                        unsigned &last);
+    /// Return whether any recorder is recording.
+    static bool IsTracing() { return tracing_.load(std::memory_order_relaxed); }
+    /// Return time for trace blocks in nanoseconds.
+    static long long GetTime();
+    /// Record a finished block of the calling thread.
+    static void Record(const char *name, long long begin, long long end);
+
+ private:
+    /// Block of the engine profiler in a recorded frame.
+    struct EngineBlock {
+        const char *name_;
+        long long begin_;
+        long long end_;
+        unsigned calls_;
+    };
+
+    /// Handle the frame begin event.
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the physics pre-step event.
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle the physics post-step event.
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle a console command.
+    void HandleConsoleCommand(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Copy the engine profiler blocks of the last frame, children laid out from a start time.
+    void AddEngineBlocks(const Urho3D::ProfilerBlock *block, long long begin);
+    /// Write the recorded blocks. Return true on success.
+    bool Save(const Urho3D::String &fileName) const;
+
+    /// Whether a recorder is recording.
+    static std::atomic<bool> tracing_;
+
+    /// Engine profiler blocks of the recorded frames.
+    std::vector<EngineBlock> engineBlocks_;
+    /// Directory of the default trace files.
+    Urho3D::String outputDir_;
+    /// File being recorded into.
+    Urho3D::String fileName_;
+    /// File of the last written trace.
+    Urho3D::String lastFileName_;
+    /// Recording start time.
+    long long startTime_;
+    /// Start time of the current frame.
+    long long frameBegin_;
+    /// Start time of the current physics step.
+    long long stepBegin_;
+    /// Frames begun since construction.
+    unsigned frameNumber_;
+    /// First frame of the recorded range.
+    unsigned rangeFirst_;
+    /// Last frame of the recorded range, 0 for no range.
+    unsigned rangeLast_;
+    /// Frames left to record, 0 for no limit.
+    unsigned framesLeft_;
+};
+
+/// Block recorded into the calling thread's trace buffer from construction to destruction, while tracing.
+class TraceScope {
+ public:
+    /// Construct and start the block.
+    explicit TraceScope(const char *name) :
+      name_(name),
+      begin_(TraceRecorder::IsTracing() ? TraceRecorder::GetTime() : -1) {
+    }
+    /// Destruct and record the block.
+    ~TraceScope() {
+        if (begin_ >= 0)
+            TraceRecorder::Record(name_, begin_, TraceRecorder::GetTime());
+    }
+
+ private:
+    /// Block name.
+    const char *name_;
+    /// Start time, negative when not tracing.
+    long long begin_;
+};
+
+#endif //AIBATTLEGROUND_TRACERECORDER_HPP
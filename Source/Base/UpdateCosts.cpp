@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <chrono>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Engine/EngineEvents.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/UI/UI.h>
+
+#include "UpdateCosts.hpp"
+
+using namespace Urho3D;
+
+namespace {
+
+/// Panel interval in milliseconds.
+const unsigned PANEL_INTERVAL_MSEC = 1000;
+/// Rows per table in the panel.
+const unsigned PANEL_ROWS = 12;
+/// Panel titles of the orders.
+const char *SORT_NAMES[] = {"time per frame", "calls per frame", "time per call", "name"};
+/// Console names of the orders.
+const char *SORT_COMMANDS[] = {"time", "calls", "percall", "name"};
+
+}
+
+bool UpdateCosts::active_ = false;
+
+UpdateCosts::UpdateCosts(Context *context) :
+  Object(context),
+  totalFrames_(0),
+  intervalFrames_(0),
+  sort_(UCS_TIME),
+  enabled_(false) {
+    SubscribeToEvent(E_CONSOLECOMMAND, URHO3D_HANDLER(UpdateCosts, HandleConsoleCommand));
+}
+
+UpdateCosts::~UpdateCosts() {
+    if (enabled_)
+        active_ = false;
+    if (panel_)
+        panel_->Remove();
+}
+
+void UpdateCosts::SetEnabled(bool enable) {
+    if (enable == enabled_)
+        return;
+    enabled_ = enable;
+    active_ = enable;
+
+    if (enable) {
+        types_.Clear();
+        nodes_.Clear();
+        totalFrames_ = 0;
+        intervalFrames_ = 0;
+        intervalTimer_.Reset();
+        SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(UpdateCosts, HandleBeginFrame));
+
+        auto *ui = GetSubsystem<UI>();
+        auto *debugHud = GetSubsystem<DebugHud>();
+        if (!panel_ && ui && debugHud) {
+            panel_ = ui->GetRoot()->CreateChild<Text>();
+            panel_->SetDefaultStyle(debugHud->GetDefaultStyle());
+            panel_->SetStyle("DebugHudText");
+            panel_->SetAlignment(HA_RIGHT, VA_TOP);
+            panel_->SetPriority(100);
+        }
+        if (panel_) {
+            panel_->SetText("Update costs: collecting");
+            panel_->SetVisible(true);
+        }
+        URHO3D_LOGINFO("Update cost attribution enabled");
+    } else {
+        UnsubscribeFromEvent(E_BEGINFRAME);
+        if (panel_)
+            panel_->SetVisible(false);
+        ExportCSV();
+    }
+}
+
+void UpdateCosts::SetSort(UpdateCostSort sort) {
+    sort_ = sort < MAX_UPDATE_COST_SORTS ? sort : UCS_TIME;
+    if (enabled_ && intervalFrames_)
+        UpdatePanel();
+}
+
+void UpdateCosts::Add(const Component *component, long long nsec, const char *phase) {
+    if (!enabled_)
+        return;
+
+    const StringHash phaseHash = phase ? StringHash(phase) : StringHash::ZERO;
+    Entry &type = types_[component->GetType() + phaseHash];
+    if (type.name_.Empty())
+        type.name_ = phase ? component->GetTypeName() + "." + phase : component->GetTypeName();
+    type.totalNSec_ += nsec;
+    ++type.totalCalls_;
+    type.intervalNSec_ += nsec;
+    ++type.intervalCalls_;
+
+    // Pooled and spawned nodes often share a name, which groups them like a prefab
+    const Node *node = component->GetNode();
+    const String &nodeName = node && !node->GetName().Empty() ? node->GetName() : String("(unnamed)");
+    Entry &named = nodes_[StringHash(nodeName) + phaseHash];
+    if (named.name_.Empty())
+        named.name_ = phase ? nodeName + "." + phase : nodeName;
+    named.totalNSec_ += nsec;
+    ++named.totalCalls_;
+    named.intervalNSec_ += nsec;
+    ++named.intervalCalls_;
+}
+
+bool UpdateCosts::ExportCSV(const String &fileName) {
+    String path = fileName;
+    if (path.Empty())
+        path = GetSubsystem<FileSystem>()->GetAppPreferencesDir("AIBattleGround", "logs") + "UpdateCosts_"
+               + Time::GetTimeStamp().Replaced(':', '_').Replaced('.', '_').Replaced(' ', '_') + ".csv";
+
+    File file(context_);
+    if (!file.Open(path, FILE_WRITE)) {
+        URHO3D_LOGERROR("Could not write update costs " + path);
+        return false;
+    }
+
+    const auto frames = (float) Max(totalFrames_, 1u);
+    file.WriteLine("kind,name,calls,total_ms,ms_per_frame,calls_per_frame,us_per_call,frames");
+    auto writeRows = [&](const char *kind, const HashMap<StringHash, Entry> &entries) {
+        for (auto i = entries.Begin(); i != entries.End(); ++i) {
+            const Entry &entry = i->second_;
+            const float totalMSec = (float) entry.totalNSec_/1000000.0f;
+            file.WriteLine(ToString("%s,\"%s\",%u,%.3f,%.4f,%.2f,%.3f,%u", kind,
+                                    entry.name_.Replaced("\"", "\"\"").CString(), entry.totalCalls_, totalMSec,
+                                    totalMSec/frames, (float) entry.totalCalls_/frames,
+                                    entry.totalCalls_ ? totalMSec*1000.0f/(float) entry.totalCalls_ : 0.0f,
+                                    totalFrames_));
+        }
+    };
+    writeRows("type", types_);
+    writeRows("node", nodes_);
+
+    URHO3D_LOGINFOF("Update costs of %u frames written to %s", totalFrames_, path.CString());
+    return true;
+}
+
+bool UpdateCosts::EnabledFromArguments(const Vector<String> &arguments) {
+    for (const String &argument : arguments) {
+        if (argument.ToLower() == "-updatecosts")
+            return true;
+    }
+    return false;
+}
+
+long long UpdateCosts::GetTime() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void UpdateCosts::HandleBeginFrame(StringHash eventType, VariantMap &eventData) {
+    ++totalFrames_;
+    ++intervalFrames_;
+    if (intervalTimer_.GetMSec(false) >= PANEL_INTERVAL_MSEC)
+        UpdatePanel();
+}
+
+void UpdateCosts::HandleConsoleCommand(StringHash eventType, VariantMap &eventData) {
+    using namespace ConsoleCommand;
+
+    if (eventData[P_ID].GetString() != GetTypeName())
+        return;
+    const Vector<String> words = eventData[P_COMMAND].GetString().Split(' ');
+    if (words.Empty())
+        return;
+
+    const String command = words[0].ToLower();
+    if (command == "on")
+        SetEnabled(true);
+    else if (command == "off")
+        SetEnabled(false);
+    else if (command == "csv")
+        ExportCSV(words.Size() > 1 ? words[1] : String::EMPTY);
+    else if (command == "sort" && words.Size() > 1) {
+        for (unsigned i = 0; i < MAX_UPDATE_COST_SORTS; ++i) {
+            if (words[1].ToLower() == SORT_COMMANDS[i])
+                SetSort((UpdateCostSort) i);
+        }
+    } else
+        URHO3D_LOGINFO("Update cost commands: on, off, sort <time|calls|percall|name>, csv [file]");
+}
+
+void UpdateCosts::UpdatePanel() {
+    // Close the interval, the panel keeps showing it while the next one is collected
+    if (intervalFrames_) {
+        const auto frames = (float) intervalFrames_;
+        for (HashMap<StringHash, Entry> *entries : {&types_, &nodes_}) {
+            for (auto i = entries->Begin(); i != entries->End(); ++i) {
+                Entry &entry = i->second_;
+                entry.frameMSec_ = (float) entry.intervalNSec_/1000000.0f/frames;
+                entry.frameCalls_ = (float) entry.intervalCalls_/frames;
+                entry.intervalNSec_ = 0;
+                entry.intervalCalls_ = 0;
+            }
+        }
+    }
+    intervalFrames_ = 0;
+    intervalTimer_.Reset();
+    if (!panel_)
+        return;
+
+    String text = "Update costs by " + String(SORT_NAMES[sort_]) + "\n";
+    auto addTable = [&](const char *title, const HashMap<StringHash, Entry> &entries) {
+        text += ToString("\n%-24s %9s %11s %9s\n", title, "ms/frame", "calls/frame", "us/call");
+        const std::vector<const Entry *> sorted = GetSorted(entries);
+        for (unsigned i = 0; i < sorted.size() && i < PANEL_ROWS; ++i) {
+            const Entry *entry = sorted[i];
+            text += ToString("%-24s %9.3f %11.1f %9.2f\n", entry->name_.Substring(0, 24).CString(), entry->frameMSec_,
+                             entry->frameCalls_, entry->frameCalls_ > 0.0f ? entry->frameMSec_*1000.0f/entry->frameCalls_
+                                                                          : 0.0f);
+        }
+    };
+    addTable("Component type", types_);
+    addTable("Node name", nodes_);
+    panel_->SetText(text);
+}
+
+std::vector<const UpdateCosts::Entry *> UpdateCosts::GetSorted(const HashMap<StringHash, Entry> &entries) const {
+    std::vector<const Entry *> sorted;
+    for (auto i = entries.Begin(); i != entries.End(); ++i)
+        sorted.push_back(&i->second_);
+
+    const UpdateCostSort sort = sort_;
+    std::sort(sorted.begin(), sorted.end(), [sort](const Entry *lhs, const Entry *rhs) {
+        switch (sort) {
+        case UCS_CALLS:
+            return lhs->frameCalls_ > rhs->frameCalls_;
+        case UCS_TIME_PER_CALL:
+            return lhs->frameMSec_*rhs->frameCalls_ > rhs->frameMSec_*lhs->frameCalls_;
+        case UCS_NAME:
+            return lhs->name_ < rhs->name_;
+        default:
+            return lhs->frameMSec_ > rhs->frameMSec_;
+        }
+    });
+    return sorted;
+}
@@ -0,0 +1,137 @@
+#ifndef AIBATTLEGROUND_UPDATECOSTS_HPP
+#define AIBATTLEGROUND_UPDATECOSTS_HPP
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/UI/Text.h>
+#include <vector>
+
+/// Time a component's update into the UpdateCosts of its context while they are enabled.
+#define AIBG_UPDATE_COST() UpdateCostScope updateCostScope_(this)
+/// Time another update function of a component as a separate entry, so that the calls of each are counted once.
+#define AIBG_UPDATE_COST_PHASE(phase) UpdateCostScope updateCostScope_(this, phase)
+
+/// Order of the update cost panel rows.
+enum UpdateCostSort {
+    /// Most time per frame first.
+    UCS_TIME = 0,
+    /// Most calls per frame first.
+    UCS_CALLS,
+    /// Most time per call first.
+    UCS_TIME_PER_CALL,
+    /// By name.
+    UCS_NAME,
+    /// Number of orders.
+    MAX_UPDATE_COST_SORTS
+};
+
+/// Opt-in attribution of the scene update time to component types and node names, to find which behaviours are worth
+/// moving into batched systems. Components time their update with AIBG_UPDATE_COST(), which costs one flag test while
+/// disabled, and their other update functions with AIBG_UPDATE_COST_PHASE("PostUpdate") and so on. While enabled, a
+/// panel in the debug HUD style lists the types and node names with their time and calls per frame over the last
+/// second, in a selectable order, and the totals since enabling are exported as CSV to the log directory when
+/// disabled. The "on", "off", "sort <time|calls|percall|name>" and "csv [file]" console commands of the UpdateCosts
+/// interpreter control it as well. Register as a subsystem.
+class UpdateCosts : public Urho3D::Object {
+    URHO3D_OBJECT(UpdateCosts, Urho3D::Object);
+
+ public:
+    /// Construct.
+    explicit UpdateCosts(Urho3D::Context *context);
+    /// Destruct.
+    ~UpdateCosts() override;
+
+    /// Enable or disable attribution. Enabling clears the totals, disabling exports them.
+    void SetEnabled(bool enable);
+    /// Set panel order.
+    void SetSort(UpdateCostSort sort);
+    /// Add update time of a component in nanoseconds. A phase keeps the entries of another update function apart.
+    void Add(const Urho3D::Component *component, long long nsec, const char *phase = nullptr);
+    /// Write the totals since enabling as CSV, by default to a time stamped file in the log directory. Return true on
+    /// success.
+    bool ExportCSV(const Urho3D::String &fileName = Urho3D::String::EMPTY);
+
+    /// Return whether enabled.
+    bool IsEnabled() const { return enabled_; }
+    /// Return panel order.
+    UpdateCostSort GetSort() const { return sort_; }
+    /// Return whether any UpdateCosts is enabled.
+    static bool IsActive() { return active_; }
+    /// Read -updatecosts from the program arguments.
+    static bool EnabledFromArguments(const Urho3D::Vector<Urho3D::String> &arguments);
+    /// Return time for update costs in nanoseconds. Single updates are often well under a microsecond.
+    static long long GetTime();
+
+ private:
+    /// Accumulated cost of a component type or node name.
+    struct Entry {
+        Urho3D::String name_;
+        /// Time and calls since enabling.
+        long long totalNSec_ = 0;
+        unsigned totalCalls_ = 0;
+        /// Time and calls in the current panel interval.
+        long long intervalNSec_ = 0;
+        unsigned intervalCalls_ = 0;
+        /// Time and calls per frame over the last panel interval.
+        float frameMSec_ = 0.0f;
+        float frameCalls_ = 0.0f;
+    };
+
+    /// Handle the frame begin event.
+    void HandleBeginFrame(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Handle a console command.
+    void HandleConsoleCommand(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Close the panel interval and redraw the panel.
+    void UpdatePanel();
+    /// Return the entries of a map in the panel order.
+    std::vector<const Entry *> GetSorted(const Urho3D::HashMap<Urho3D::StringHash, Entry> &entries) const;
+
+    /// Whether any UpdateCosts is enabled.
+    static bool active_;
+
+    /// Costs by component type.
+    Urho3D::HashMap<Urho3D::StringHash, Entry> types_;
+    /// Costs by node name.
+    Urho3D::HashMap<Urho3D::StringHash, Entry> nodes_;
+    /// Panel text, created on first enable when there is a UI.
+    Urho3D::SharedPtr<Urho3D::Text> panel_;
+    /// Time since the panel interval began.
+    Urho3D::Timer intervalTimer_;
+    /// Frames since enabling.
+    unsigned totalFrames_;
+    /// Frames in the current panel interval.
+    unsigned intervalFrames_;
+    /// Panel order.
+    UpdateCostSort sort_;
+    /// Whether enabled.
+    bool enabled_;
+};
+
+/// Times a component's update from construction to destruction, while UpdateCosts are enabled.
+class UpdateCostScope {
+ public:
+    /// Construct and start timing.
+    explicit UpdateCostScope(const Urho3D::Component *component, const char *phase = nullptr) :
+      component_(UpdateCosts::IsActive() ? component : nullptr),
+      phase_(phase),
+      begin_(component_ ? UpdateCosts::GetTime() : 0) {
+    }
+    /// Destruct and add the time.
+    ~UpdateCostScope() {
+        if (component_) {
+            if (auto *costs = component_->GetSubsystem<UpdateCosts>())
+                costs->Add(component_, UpdateCosts::GetTime() - begin_, phase_);
+        }
+    }
+
+ private:
+    /// Component timed, null while disabled.
+    const Urho3D::Component *component_;
+    /// Update function timed, null for the main update.
+    const char *phase_;
+    /// Start time.
+    long long begin_;
+};
+
+#endif //AIBATTLEGROUND_UPDATECOSTS_HPP
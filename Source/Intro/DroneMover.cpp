@@ -24,28 +24,170 @@
 #include <Urho3D/Graphics/AnimationState.h>
 #include <Urho3D/Scene/Scene.h>
 
+#include "../Base/Lockstep.hpp"
+#include "../Base/TraceRecorder.hpp"
+#include "../Base/UpdateCosts.hpp"
 #include "DroneMover.h"
+
+namespace {
+
+/// Flight height of the drones.
+const float DRONE_HEIGHT = 300.0f;
+/// Drone camera offset from the drone.
+const Vector3 DRONE_CAMERA_OFFSET(0.0f, -15.0f, 0.0f);
+/// Distance on the XZ plane at which a waypoint counts as reached.
+const float WAYPOINT_RADIUS = 30.0f;
+
+}
+
 DroneMover::DroneMover(Context *context) :
     LogicComponent(context),
     moveSpeed_(0.0f),
-    rotationSpeed_(0.0f) {
+    rotationSpeed_(0.0f),
+    camera_(nullptr),
+    agent_(M_MAX_UNSIGNED),
+    pathRequest_(0),
+    waypoint_(0) {
   // Only the scene update event is needed: unsubscribe from the rest for optimization
   SetUpdateEventMask(USE_UPDATE);
 }
 
+DroneMover::~DroneMover() {
+  LeaveCrowd();
+}
+
 void DroneMover::SetParameters(float moveSpeed, float rotationSpeed, const BoundingBox &bounds, Node *camera) {
   moveSpeed_ = moveSpeed;
   rotationSpeed_ = rotationSpeed;
   bounds_ = bounds;
   camera_ = camera;
+
+  if (IsCrowdAgent()) {
+    crowd_->SetAgentParameters(agent_, moveSpeed_, rotationSpeed_, bounds_);
+    return;
+  }
+
+  // Hand the movement over to the scene's crowd system when there is one, only the camera is left to follow
+  Scene *scene = GetScene();
+  crowd_ = scene ? scene->GetComponent<CrowdSystem>() : nullptr;
+  if (crowd_) {
+    agent_ = crowd_->AddAgent(node_, moveSpeed_, rotationSpeed_, bounds_);
+    crowd_->SetAgentHeight(agent_, DRONE_HEIGHT);
+    SetUpdateEventMask(USE_POSTUPDATE);
+
+    pathService_ = scene->GetComponent<PathService>();
+    if (pathService_) {
+      SubscribeToEvent(pathService_, E_PATHREADY, URHO3D_HANDLER(DroneMover, HandlePathReady));
+      SetDestination(PickDestination());
+    }
+  }
+}
+
+Vector3 DroneMover::PickDestination() {
+  // Draw from the scene's drone stream when there is one, so that reproducible runs pick the same destinations
+  auto *lockstep = GetScene() ? GetScene()->GetComponent<Lockstep>() : nullptr;
+  if (lockstep) {
+    RandomStream &random = lockstep->GetStream("Drones");
+    const float x = random.Random(bounds_.min_.x_, bounds_.max_.x_);
+    return Vector3(x, 0.0f, random.Random(bounds_.min_.z_, bounds_.max_.z_));
+  }
+  const float x = Random(bounds_.min_.x_, bounds_.max_.x_);
+  return Vector3(x, 0.0f, Random(bounds_.min_.z_, bounds_.max_.z_));
+}
+
+void DroneMover::SetDestination(const Vector3 &destination) {
+  if (!IsCrowdAgent() || !pathService_)
+    return;
+
+  if (pathRequest_)
+    pathService_->CancelRequest(pathRequest_);
+  pathRequest_ = pathService_->RequestPath(node_->GetPosition(), destination);
+}
+
+void DroneMover::HandlePathReady(StringHash eventType, VariantMap &eventData) {
+  using namespace PathReady;
+
+  if (eventData[P_REQUEST].GetUInt() != pathRequest_)
+    return;
+  pathRequest_ = 0;
+
+  waypoints_.Clear();
+  waypoint_ = 0;
+  if (eventData[P_SUCCESS].GetBool()) {
+    for (const Variant &waypoint : eventData[P_PATH].GetVariantVector())
+      waypoints_.Push(waypoint.GetVector3());
+  }
+
+  if (waypoints_.Empty())
+    crowd_->ClearAgentTarget(agent_);
+  else
+    crowd_->SetAgentTarget(agent_, waypoints_[0]);
+}
+
+void DroneMover::OnSceneSet(Scene *scene) {
+  LogicComponent::OnSceneSet(scene);
+  if (!scene) {
+    LeaveCrowd();
+    SetUpdateEventMask(USE_UPDATE);
+  }
+}
+
+void DroneMover::OnSetEnabled() {
+  LogicComponent::OnSetEnabled();
+  if (!IsEnabledEffective())
+    LeaveCrowd();
+  else if (!IsCrowdAgent() && GetScene())
+    SetParameters(moveSpeed_, rotationSpeed_, bounds_, camera_);
+}
+
+void DroneMover::LeaveCrowd() {
+  if (IsCrowdAgent())
+    crowd_->RemoveAgent(agent_);
+  crowd_.Reset();
+  agent_ = M_MAX_UNSIGNED;
+
+  if (pathService_) {
+    if (pathRequest_)
+      pathService_->CancelRequest(pathRequest_);
+    UnsubscribeFromEvent(pathService_, E_PATHREADY);
+  }
+  pathService_.Reset();
+  pathRequest_ = 0;
+  waypoints_.Clear();
+  waypoint_ = 0;
+}
+
+void DroneMover::PostUpdate(float timeStep) {
+  AIBG_UPDATE_COST_PHASE("PostUpdate");
+  // Advance along the path, and pick the next destination once the last waypoint is reached
+  if (!waypoints_.Empty() && IsCrowdAgent()) {
+    const Vector3 position = node_->GetPosition();
+    const Vector3 &waypoint = waypoints_[waypoint_];
+    const float dx = waypoint.x_ - position.x_;
+    const float dz = waypoint.z_ - position.z_;
+    if (dx*dx + dz*dz < WAYPOINT_RADIUS*WAYPOINT_RADIUS) {
+      if (++waypoint_ < waypoints_.Size())
+        crowd_->SetAgentTarget(agent_, waypoints_[waypoint_]);
+      else {
+        waypoints_.Clear();
+        waypoint_ = 0;
+        crowd_->ClearAgentTarget(agent_);
+        SetDestination(PickDestination());
+      }
+    }
+  }
+
+  if (camera_)
+    camera_->SetPosition(node_->GetPosition() + DRONE_CAMERA_OFFSET);
 }
 
 void DroneMover::Update(float timeStep) {
-  const Vector3 camPos(0.0f, -15.0f, 0.0f);
+  AIBG_PROFILE(DroneMoverUpdate);
+  AIBG_UPDATE_COST();
   node_->Translate(Vector3::FORWARD * moveSpeed_ * timeStep);
 
   Vector3 pos = node_->GetPosition();
-  node_->SetPosition(Vector3(pos.x_, 300.0f, pos.z_));
+  node_->SetPosition(Vector3(pos.x_, DRONE_HEIGHT, pos.z_));
   // If in risk of going outside the plane, rotate the model right
   if (pos.x_ < bounds_.min_.x_
       || pos.x_ > bounds_.max_.x_
@@ -54,7 +196,8 @@ void DroneMover::Update(float timeStep) {
     node_->Yaw(rotationSpeed_ * timeStep);
   }
 
-  camera_->SetPosition(node_->GetPosition() + camPos);
+  if (camera_)
+    camera_->SetPosition(node_->GetPosition() + DRONE_CAMERA_OFFSET);
   // Get the model's first (only) animation state and advance its time. Note the convenience accessor to other components
   // in the same scene node
   auto *model = node_->GetComponent<AnimatedModel>(true);
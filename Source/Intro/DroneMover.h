@@ -24,9 +24,14 @@
 
 #include <Urho3D/Scene/LogicComponent.h>
 
+#include "../Base/CrowdSystem.hpp"
+#include "../Base/PathService.hpp"
+
 using namespace Urho3D;
 
-/// Custom logic component for moving the animated model and rotating at area edges.
+/// Custom logic component for moving the drone and rotating at area edges. When the scene has a CrowdSystem the
+/// drone flies as a crowd agent at fixed height and the component only keeps the drone camera following it. With a
+/// PathService as well, the drone follows requested paths to random destinations within its bounds.
 class DroneMover : public LogicComponent
 {
     URHO3D_OBJECT(DroneMover, LogicComponent);
@@ -34,11 +39,17 @@ class DroneMover : public LogicComponent
 public:
     /// Construct.
     explicit DroneMover(Context* context);
+    /// Destruct.
+    ~DroneMover() override;
 
     /// Set motion parameters: forward movement speed, rotation speed, and movement boundaries.
     void SetParameters(float moveSpeed, float rotateSpeed, const BoundingBox& bounds, Node*  camera);
-    /// Handle scene update. Called by LogicComponent base class.
+    /// Request a path to a destination and follow it once it arrives. Only used when driven by a CrowdSystem.
+    void SetDestination(const Vector3& destination);
+    /// Handle scene update. Called by LogicComponent base class only when not driven by a CrowdSystem.
     void Update(float timeStep) override;
+    /// Handle scene post-update. Moves the drone camera after the crowd has committed the drone position.
+    void PostUpdate(float timeStep) override;
 
     /// Return forward movement speed.
     float GetMoveSpeed() const { return moveSpeed_; }
@@ -46,8 +57,23 @@ public:
     float GetRotationSpeed() const { return rotationSpeed_; }
     /// Return movement boundaries.
     const BoundingBox& GetBounds() const { return bounds_; }
+    /// Return whether the movement is done by a CrowdSystem.
+    bool IsCrowdAgent() const { return crowd_ && crowd_->HasAgent(agent_); }
+
+protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Scene* scene) override;
+    /// Handle enabled/disabled state change. A disabled drone leaves the crowd and rejoins when enabled again.
+    void OnSetEnabled() override;
 
 private:
+    /// Remove the agent from the crowd, if registered.
+    void LeaveCrowd();
+    /// Return a random destination within the movement boundaries.
+    Vector3 PickDestination();
+    /// Handle a finished path request.
+    void HandlePathReady(StringHash eventType, VariantMap& eventData);
+
     /// Forward movement speed.
     float moveSpeed_;
     /// Rotation speed.
@@ -56,4 +82,16 @@ private:
     BoundingBox bounds_;
     ///Camera
     Node* camera_;
+    /// Crowd system moving the node.
+    WeakPtr<CrowdSystem> crowd_;
+    /// Agent handle in the crowd system.
+    unsigned agent_;
+    /// Path service answering the path requests.
+    WeakPtr<PathService> pathService_;
+    /// Pending path request, 0 when none.
+    unsigned pathRequest_;
+    /// Waypoints of the followed path.
+    PODVector<Vector3> waypoints_;
+    /// Index of the next waypoint.
+    unsigned waypoint_;
 };
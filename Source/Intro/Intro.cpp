@@ -1,6 +1,7 @@
 //
 // Created by bemcho on 15.01.18.
 //
+#include <tuple>
 #include <vector>
 #include <Urho3D/Graphics/AnimatedModel.h>
 #include <Urho3D/Graphics/Animation.h>
@@ -11,25 +12,147 @@
 #include <Urho3D/Physics/RigidBody.h>
 #include <Urho3D/Graphics/Technique.h>
 #include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Scene/SceneEvents.h>
 #include <Urho3D/UI/Font.h>
 #include <Urho3D/UI/Text.h>
 #include <Urho3D/UI/UI.h>
 
 #include "Intro.hpp"
+#include "../Base/AnimationLod.hpp"
+#include "../Base/ContactBuffer.hpp"
+#include "../Base/CrowdSystem.hpp"
+#include "../Base/DeltaAutosave.hpp"
+#include "../Base/EntityPool.hpp"
+#include "../Base/FlightRecorder.hpp"
+#include "../Base/FlowField.hpp"
+#include "../Base/Lockstep.hpp"
+#include "../Base/PathService.hpp"
+#include "../Base/PhysicsLod.hpp"
+#include "../Base/PhysicsThreading.hpp"
+#include "../Base/PoseCache.hpp"
+#include "../Base/PropInstancer.hpp"
+#include "../Base/SpawnScheduler.hpp"
+#include "../Base/TraceRecorder.hpp"
 #include "Mover.h"
 #include "DroneMover.h"
 
 using namespace Urho3D;
-Intro::Intro(Urho3D::Context *context) : AIBattleGround(context) {
+
+/// Autosave file relative to the executable directory.
+static const char *AUTOSAVE_PATH = "Data/Scenes/AIBattleGround.autosave";
+/// Time between autosave checkpoints in seconds.
+static const float AUTOSAVE_INTERVAL = 5.0f;
+/// Entities built per frame by reproducible runs.
+static const unsigned SPAWNS_PER_FRAME = 50;
+/// Maximum number of thrown spheres.
+static const unsigned SPHERE_POOL_SIZE = 64;
+/// Time before a thrown sphere despawns in seconds.
+static const float SPHERE_LIFETIME = 60.0f;
+/// Maximum number of drones.
+static const unsigned DRONE_POOL_SIZE = 16;
+/// Radius around the camera in which props and agents are simulated as full dynamic bodies.
+static const float CAMERA_PHYSICS_RADIUS = 150.0f;
+/// Prop count the per-kind counts are given for.
+static const unsigned DEFAULT_PROP_COUNT = 1000;
+/// Model, run animation and material of the agent kinds.
+static const std::tuple<String, String, String> AGENT_RESOURCES[] = {
+  std::make_tuple("Models/Mutant/Mutant.mdl",
+                  "Models/Mutant/Mutant_Run.ani",
+                  "Models/Mutant/Materials/mutant_M.xml"),
+  std::make_tuple("Models/X_Bot/X_Bot.mdl",
+                  "Models/X_Bot/X_Bot_Run.ani",
+                  "Models/X_Bot/Materials/X_BotSurface.xml"),
+  std::make_tuple("Models/X_Bot/X_Bot.mdl",
+                  "Models/X_Bot/X_Bot_Run2.ani",
+                  "Models/X_Bot/Materials/X_BotSurface.xml"),
+  std::make_tuple("Models/Swat/Swat.mdl", "Models/Swat/Swat_SprintFwd.ani", "Models/Mutant/Materials/mutant_M.xml"),
+  std::make_tuple("Models/Mutant/Mutant.mdl",
+                  "Models/Mutant/Mutant_Jump.ani",
+                  "Models/Mutant/Materials/mutant_M.xml")};
+
+IntroOptions IntroOptions::FromArguments(const Vector<String> &arguments) {
+    IntroOptions options;
+    for (unsigned i = 0; i < arguments.Size(); ++i) {
+        const String argument = arguments[i].ToLower();
+        const bool hasValue = i + 1 < arguments.Size();
+        if (argument == "-agents" && hasValue)
+            options.numAgents_ = ToUInt(arguments[++i]);
+        else if (argument == "-props" && hasValue)
+            options.numProps_ = ToUInt(arguments[++i]);
+        else if (argument == "-drones" && hasValue)
+            options.numDrones_ = ToUInt(arguments[++i]);
+        else if (argument == "-nophysics")
+            options.physics_ = false;
+    }
+    return options;
+}
+
+unsigned IntroOptions::GetPropCount(unsigned defaultCount) const {
+    return (unsigned) RoundToInt((float) defaultCount*numProps_/DEFAULT_PROP_COUNT);
+}
+
+Intro::Intro(Urho3D::Context *context) :
+  AIBattleGround(context),
+  spherePool_(M_MAX_UNSIGNED),
+  dronePool_(M_MAX_UNSIGNED),
+  sharedPoses_(false),
+  physicsLod_(true),
+  options_(IntroOptions::FromArguments(GetArguments())) {
 
     // Register an object factory for our custom Mover component so that we can create them to scene nodes
     context->RegisterFactory<Mover>();
     context->RegisterFactory<DroneMover>();
+    context->RegisterFactory<CrowdSystem>();
+    context->RegisterFactory<AnimationLod>();
+    context->RegisterFactory<PoseCache>();
+    context->RegisterFactory<FlowField>();
+    context->RegisterFactory<PathService>();
+    context->RegisterFactory<Lockstep>();
+    context->RegisterFactory<DeltaAutosave>();
+    context->RegisterFactory<SpawnScheduler>();
+    context->RegisterFactory<PropInstancer>();
+    context->RegisterFactory<EntityPool>();
+    context->RegisterFactory<PhysicsLod>();
+    context->RegisterFactory<PhysicsThreading>();
+    context->RegisterFactory<ContactBuffer>();
+    context->RegisterFactory<FlightRecorder>();
+    snapshot_ = new SceneSnapshot(context);
 }
 Intro::~Intro() {}
 
+void Intro::GetResourceManifest(ResourceManifest &manifest) {
+    // Sky, terrain, water and the drone control display
+    manifest.Add<Model>("Models/Box.mdl");
+    manifest.Add<Model>("Models/Plane.mdl");
+    manifest.Add<Material>("Materials/Skybox.xml");
+    manifest.Add<Image>("Textures/HeightMap.png");
+    manifest.Add<Material>("Materials/Terrain.xml");
+    manifest.Add<Material>("Materials/Water.xml");
+    manifest.Add<Technique>("Techniques/DiffUnlit.xml");
+    // Props
+    manifest.Add<Model>("Models/Cylinder.mdl");
+    manifest.Add<Model>("Models/Cone.mdl");
+    manifest.Add<Model>("Models/Torus.mdl");
+    manifest.Add<Model>("Models/Mushroom.mdl");
+    manifest.Add<Model>("Models/Sphere.mdl");
+    manifest.Add<Material>("Materials/RibbonTrail.xml");
+    manifest.Add<Material>("Materials/Mushroom.xml");
+    manifest.Add<Material>("Materials/Particle.xml");
+    manifest.Add<Material>("Materials/Stone.xml");
+    // Agents
+    for (const auto &[modelPath, animationPath, materialPath] : AGENT_RESOURCES) {
+        manifest.Add<Model>(modelPath);
+        manifest.Add<Animation>(animationPath);
+        manifest.Add<Material>(materialPath);
+    }
+    // Drones are spawned during play, loading them up front avoids a hitch on the first one
+    manifest.Add<Model>("Models/MQ_9/MQ_9.mdl");
+    manifest.Add<Font>("Fonts/Anonymous Pro.ttf");
+}
+
 Scene *Intro::InitScene() {
     auto *cache = GetSubsystem<ResourceCache>();
 
@@ -37,7 +160,7 @@ Scene *Intro::InitScene() {
 
     // Create octree, use default volume (-1000, -1000, -1000) to (1000, 1000, 1000)
     scene_->CreateComponent<Octree>();
-    scene_->CreateComponent<PhysicsWorld>();
+    InitSystems();
 
     // Create a Zone component for ambient lighting & fog control
     Node *zoneNode = scene_->CreateChild("Zone");
@@ -89,25 +212,32 @@ Scene *Intro::InitScene() {
       terrainNode->CreateComponent<CollisionShape>();
     terrainS->SetTerrain();
 
+    InitNavigation(terrain);
+
     const float boundsXY = 700.0f;
 
     // Create cylinders of varying sizes
-    CreateObjects("Cylinder", "Models/Cylinder.mdl", "Materials/RibbonTrail.xml", 100, scene_, 100, boundsXY);
+    CreateObjects("Cylinder", "Models/Cylinder.mdl", "Materials/RibbonTrail.xml",
+                  options_.GetPropCount(100), scene_, 100, boundsXY);
 
     // Create cones of varying sizes
-    CreateObjects("Cone", "Models/Cone.mdl", "Materials/Mushroom.xml", 100, scene_, 300, boundsXY);
+    CreateObjects("Cone", "Models/Cone.mdl", "Materials/Mushroom.xml",
+                  options_.GetPropCount(100), scene_, 300, boundsXY);
 
     // Create cones of varying sizes
-    CreateObjects("Torus", "Models/Torus.mdl", "Materials/Water.xml", 100, scene_, 150, boundsXY);
+    CreateObjects("Torus", "Models/Torus.mdl", "Materials/Water.xml",
+                  options_.GetPropCount(100), scene_, 150, boundsXY);
 
     // Create mushrooms of varying sizes
-    CreateObjects("Mushroom", "Models/Mushroom.mdl", "Materials/Mushroom.xml", 100, scene_, 1000, boundsXY);
+    CreateObjects("Mushroom", "Models/Mushroom.mdl", "Materials/Mushroom.xml",
+                  options_.GetPropCount(100), scene_, 1000, boundsXY);
 
     //Create boxes of varying sizes
-    CreateObjects("Box", "Models/Box.mdl", "Materials/Particle.xml", 300, scene_, 30, boundsXY);
+    CreateObjects("Box", "Models/Box.mdl", "Materials/Particle.xml", options_.GetPropCount(300), scene_, 30, boundsXY);
 
     //Create balls of varying sizes
-    CreateObjects("Sphere", "Models/Sphere.mdl", "Materials/Stone.xml", 300, scene_, 10, boundsXY);
+    CreateObjects("Sphere", "Models/Sphere.mdl", "Materials/Stone.xml",
+                  options_.GetPropCount(300), scene_, 10, boundsXY);
 
     // Create a water plane object that is as large as the terrain
     waterNode_ = scene_->CreateChild("AIBattleGroundApp");
@@ -126,6 +256,8 @@ Scene *Intro::InitScene() {
     rttCameraNode_->SetPosition(Vector3(0.0f, 300.0f, -20.0f));
     rttCameraNode_->SetRotation(cameraNode_->GetRotation());
 
+    CreatePools();
+
     {
         screenBox_ = scene_->CreateChild("ScreenBox");
         screenBox_->SetPosition(Vector3(0.0f, 50.0f, 0.0f));
@@ -141,6 +273,11 @@ Scene *Intro::InitScene() {
         screenNode_->SetScale(Vector3(20.0f, 0.0f, 15.0f));
         auto *screenObject = screenNode_->CreateComponent<StaticModel>();
         screenObject->SetModel(cache->GetResource<Model>("Models/Plane.mdl"));
+    }
+
+    // The drone screen shows the render-to-texture camera, which needs graphics
+    if (!IsHeadless()) {
+        auto *screenObject = screenNode_->GetComponent<StaticModel>();
 
         // Create a renderable texture (1024x768, RGB format), enable bilinear filtering on it
         SharedPtr<Texture2D> renderTexture(new Texture2D(context_));
@@ -166,6 +303,9 @@ Scene *Intro::InitScene() {
         surface->SetViewport(0, rttViewport);
     }
 
+    // Snapshots load incrementally, what a load does not restore is rebuilt once the last node is in
+    SubscribeToEvent(scene_, E_ASYNCLOADFINISHED, URHO3D_HANDLER(Intro, HandleAsyncLoadFinished));
+
     return scene_;
 }
 
@@ -177,104 +317,230 @@ void Intro::CreateObjects(const String modelName,
                           const float massScalar,
                           const float boundsXY) {
     auto *cache = GetSubsystem<ResourceCache>();
+    auto *spawnScheduler = scene_->GetComponent<SpawnScheduler>();
+    auto *model = cache->GetResource<Model>(modelPath);
+    auto *material = cache->GetResource<Material>(materialPath);
+    auto *terrain = scene_->GetComponent<Terrain>(true);
+    RandomStream &random = scene_->GetComponent<Lockstep>()->GetStream("Props");
 
     for (unsigned j = 0; j < objectsCount; ++j) {
-        const float scale = Random(1, 10) + 0.5f;
-        Node *boxNode = scene_->CreateChild(modelName);
-        boxNode->SetPosition(Vector3(Random(boundsXY), 100.0f, Random(boundsXY)));
-        boxNode->SetRotation(Quaternion(Random(360.0f), Random(360.0f), Random(360.0f)));
-        boxNode->SetScale(scale);
-        auto *boxObject = boxNode->CreateComponent<StaticModel>();
-        boxObject->SetModel(cache->GetResource<Model>(modelPath));
-        boxObject->SetMaterial(cache->GetResource<Material>(materialPath));
-        boxObject->SetCastShadows(true);
-
-        auto *body = boxNode->CreateComponent<RigidBody>();
-        body->SetMass(scale*massScalar);
-
-        auto *shape = boxNode->CreateComponent<CollisionShape>();
-        if (modelName.Find("Sphere")!=String::NPOS) {
-            body->SetRollingFriction(1.0f);
-            shape->SetSphere(1.0f);
-        } else {
-            shape->SetBox(Vector3::ONE);
-        }
-
+        // The random draws happen here so that they do not depend on the build order
+        const float scale = random.Random(1, 10) + 0.5f;
+        Vector3 position(random.Random(boundsXY), 100.0f, random.Random(boundsXY));
+        // Nothing would let the props fall without physics, they start on the ground
+        if (!options_.physics_ && terrain)
+            position.y_ = terrain->GetHeight(position);
+        const Quaternion rotation(random.Random(360.0f), random.Random(360.0f), random.Random(360.0f));
+        spawnScheduler->Enqueue(position, [=]() {
+            CreateProp(scene_, modelName, position, rotation, scale, model, material, massScalar);
+        });
     }
 }
 void Intro::InitObjects() {
 
     auto *cache = GetSubsystem<ResourceCache>();
+    auto *flowField = scene_->GetComponent<FlowField>();
+    auto *spawnScheduler = scene_->GetComponent<SpawnScheduler>();
+    auto *physicsLod = scene_->GetComponent<PhysicsLod>();
+    auto *terrain = scene_->GetComponent<Terrain>(true);
+    RandomStream &random = scene_->GetComponent<Lockstep>()->GetStream("Agents");
     // Create animated models
-    const unsigned NUM_MODELS = 700;
+    const unsigned NUM_MODELS = options_.numAgents_;
     const float MODEL_MOVE_SPEED = 15.0f;
     const float MODEL_ROTATE_SPEED = 100.0f;
     const float x_bound = 1000.0f;
     const float y_bound = 1000.0f;
     const BoundingBox bounds(Vector3(-x_bound, 0.0f, -y_bound), Vector3(x_bound, 0.0f, y_bound));
 
-    std::vector<std::tuple<String, String, String>> animations{
-      std::make_tuple("Models/Mutant/Mutant.mdl",
-                      "Models/Mutant/Mutant_Run.ani",
-                      "Models/Mutant/Materials/mutant_M.xml"),
-      std::make_tuple("Models/X_Bot/X_Bot.mdl",
-                      "Models/X_Bot/X_Bot_Run.ani",
-                      "Models/X_Bot/Materials/X_BotSurface.xml"),
-      std::make_tuple("Models/X_Bot/X_Bot.mdl",
-                      "Models/X_Bot/X_Bot_Run2.ani",
-                      "Models/X_Bot/Materials/X_BotSurface.xml"),
-      std::make_tuple("Models/Swat/Swat.mdl", "Models/Swat/Swat_SprintFwd.ani", "Models/Mutant/Materials/mutant_M.xml"),
-      std::make_tuple("Models/Mutant/Mutant.mdl",
-                      "Models/Mutant/Mutant_Jump.ani",
-                      "Models/Mutant/Materials/mutant_M.xml")};
     for (unsigned i = 0; i < NUM_MODELS; ++i) {
-        const float scaleWeight = Random(1, 10);
-        Node *modelNode = scene_->CreateChild("Jack");
-        modelNode->SetPosition(Vector3(Random(x_bound/2.0f), 100.f, Random(y_bound/2.0f)));
-        modelNode->SetRotation(Quaternion(0.0f, Random(360.0f), 0.0f));
-        modelNode->SetScale(scaleWeight);
-        // spin node
-        Node *adjustNode = modelNode->CreateChild("AdjNode");
-        adjustNode->SetRotation(Quaternion(180, Vector3(0, 1, 0)));
-
-        auto *modelObject = adjustNode->CreateComponent<AnimatedModel>();
-
-        auto & [modelPath, walkAnimationPath, materialPath] = animations[Random(4)];
-        auto *walkAnimation = cache->GetResource<Animation>(walkAnimationPath);
-        modelObject->SetModel(cache->GetResource<Model>(modelPath));
-        modelObject->SetMaterial(cache->GetResource<Material>(materialPath));
-        modelObject->SetCastShadows(true);
-        AnimationState *state = modelObject->AddAnimationState(walkAnimation);
-        // The state would fail to create (return null) if the animation was not found
-        if (state) {
-            // Enable full blending weight and looping
-            state->SetWeight(1.0f);
-            state->SetLooped(true);
-            state->SetTime(Random(walkAnimation->GetLength()));
-        }
+        // The random draws happen here so that they do not depend on the build order
+        const float scaleWeight = random.Random(1, 10);
+        Vector3 position(random.Random(x_bound/2.0f), 100.f, random.Random(y_bound/2.0f));
+        if (!options_.physics_ && terrain)
+            position.y_ = terrain->GetHeight(position);
+        const Quaternion rotation(0.0f, random.Random(360.0f), 0.0f);
+        const auto &agentResources = AGENT_RESOURCES[random.Random(4)];
+        auto *walkAnimation = cache->GetResource<Animation>(std::get<1>(agentResources));
+        const float animationTime = walkAnimation ? random.Random(walkAnimation->GetLength()) : 0.0f;
+        const unsigned goal = flowField && flowField->GetNumGoals() ? i%flowField->GetNumGoals() : M_MAX_UNSIGNED;
+
+        spawnScheduler->Enqueue(position, [=, &agentResources]() {
+            Node *modelNode = scene_->CreateChild("Jack");
+            modelNode->SetPosition(position);
+            modelNode->SetRotation(rotation);
+            modelNode->SetScale(scaleWeight);
+            // spin node
+            Node *adjustNode = modelNode->CreateChild("AdjNode");
+            adjustNode->SetRotation(Quaternion(180, Vector3(0, 1, 0)));
+
+            auto *modelObject = adjustNode->CreateComponent<AnimatedModel>();
+            modelObject->SetModel(cache->GetResource<Model>(std::get<0>(agentResources)));
+            modelObject->SetMaterial(cache->GetResource<Material>(std::get<2>(agentResources)));
+            modelObject->SetCastShadows(true);
+            AnimationState *state = modelObject->AddAnimationState(walkAnimation);
+            // The state would fail to create (return null) if the animation was not found
+            if (state) {
+                // Enable full blending weight and looping
+                state->SetWeight(1.0f);
+                state->SetLooped(true);
+                state->SetTime(animationTime);
+            }
+
+            // Create our custom Mover component that will move & animate the model during each frame's update
+            auto *mover = modelNode->CreateComponent<Mover>();
+            mover->SetParameters(MODEL_MOVE_SPEED - (scaleWeight/4.0f), MODEL_ROTATE_SPEED, bounds);
+            // The order goes through the command stream like player input, so that recordings carry it
+            if (goal != M_MAX_UNSIGNED)
+                scene_->GetComponent<Lockstep>()->Submit(
+                  LockstepCommand{0, LC_AGENT_GOAL, Vector3::ZERO, Quaternion::IDENTITY, modelNode->GetID(), goal});
+            // Create rigidbody, and set non-zero mass so that the body becomes dynamic
+            auto *body = modelNode->CreateComponent<RigidBody>();
+            body->SetCollisionLayer(1);
+            body->SetMass(scaleWeight*100);
+
+            // Set zero angular factor so that physics doesn't turn the character on its own.
+            // Instead we will control the character yaw manually
+            body->SetAngularFactor(Vector3::ZERO);
+
+            // Ground and agent contacts are read from the contact buffer, no collision events
+            body->SetCollisionEventMode(COLLISION_NEVER);
+
+            // Set a capsule shape for collision
+            auto *shape = modelNode->CreateComponent<CollisionShape>();
+            shape->SetCapsule(0.7f, 1.8f, Vector3(0.0f, 0.9f, 0.0f));
+            physicsLod->AddBody(body, PLOD_KINEMATIC);
+        });
+    }
+
+    // Drones asked for on the command line join the population, above the agents' area
+    RandomStream &droneRandom = scene_->GetComponent<Lockstep>()->GetStream("Drones");
+    for (unsigned i = 0; i < options_.numDrones_; ++i) {
+        const Vector3 position(droneRandom.Random(x_bound/2.0f), 150.0f, droneRandom.Random(y_bound/2.0f));
+        const Quaternion rotation(0.0f, droneRandom.Random(360.0f), 0.0f);
+        spawnScheduler->Enqueue(position, [=]() { SpawnDrone(position, rotation); });
+    }
 
-        // Create our custom Mover component that will move & animate the model during each frame's update
-        auto *mover = modelNode->CreateComponent<Mover>();
-        mover->SetParameters(MODEL_MOVE_SPEED - (scaleWeight/4.0f), MODEL_ROTATE_SPEED, bounds);
-        // Create rigidbody, and set non-zero mass so that the body becomes dynamic
-        auto *body = modelNode->CreateComponent<RigidBody>();
-        body->SetCollisionLayer(1);
-        body->SetMass(scaleWeight*100);
+    // The autosave baseline is written once the population is complete
+    SubscribeToEvent(spawnScheduler, E_SPAWNSFINISHED, URHO3D_HANDLER(Intro, HandleSpawnsFinished));
+}
+
+void Intro::HandleSpawnsFinished(StringHash eventType, VariantMap &eventData) {
+    UnsubscribeFromEvent(E_SPAWNSFINISHED);
+    StartAutosave();
+}
+
+void Intro::StartAutosave() {
+    // Only interactive runs autosave, headless runs are reproduced from their seed
+    if (IsHeadless())
+        return;
 
-        // Set zero angular factor so that physics doesn't turn the character on its own.
-        // Instead we will control the character yaw manually
-        body->SetAngularFactor(Vector3::ZERO);
+    auto *autosave = scene_->GetOrCreateComponent<DeltaAutosave>(LOCAL);
+    autosave->SetInterval(AUTOSAVE_INTERVAL);
+    autosave->Start(GetSubsystem<FileSystem>()->GetProgramDir() + AUTOSAVE_PATH);
+}
+
+void Intro::CreatePools() {
+    // Thrown spheres and drones come from fixed pools, spheres vanish after a while, once at rest or off the terrain
+    auto *entityPool = scene_->GetOrCreateComponent<EntityPool>();
+    entityPool->SetBounds(BoundingBox(Vector3(-1600.0f, -100.0f, -1600.0f), Vector3(1600.0f, 2000.0f, 1600.0f)));
+    spherePool_ = entityPool->CreatePool("Sphere", SPHERE_POOL_SIZE, [](Node *node) { BuildSphere(node); });
+    entityPool->SetLifetime(spherePool_, SPHERE_LIFETIME);
+    entityPool->SetDespawnWhenSleeping(spherePool_, true);
+    dronePool_ = entityPool->CreatePool("MQ9", Max(DRONE_POOL_SIZE, options_.numDrones_),
+                                        [this](Node *node) { BuildDrone(node, rttCameraNode_); });
+}
+
+void Intro::HandleAsyncLoadFinished(StringHash eventType, VariantMap &eventData) {
+    RestoreAfterLoad();
+}
 
-        // Set the rigidbody to signal collision also when in rest, so that we get ground collisions properly
-        body->SetCollisionEventMode(COLLISION_ALWAYS);
+void Intro::RestoreAfterLoad() {
+    // The loaded system components only have their defaults
+    InitSystems();
+    if (auto *terrain = scene_->GetComponent<Terrain>(true))
+        InitNavigation(terrain);
+    // The loaded movers have neither parameters nor a crowd, their parameters are saved in node variables
+    PODVector<Mover *> movers;
+    scene_->GetComponents(movers, true);
+    for (Mover *mover : movers)
+        mover->RestoreParameters();
+    // The prop groups are temporary, the instances are found again on the loaded prop nodes
+    if (auto *propInstancer = scene_->GetComponent<PropInstancer>())
+        propInstancer->RestoreInstances();
+    // Bodies saved while reduced are made dynamic again
+    if (auto *physicsLod = scene_->GetComponent<PhysicsLod>())
+        physicsLod->RestoreBodies();
+    // The pooled nodes are temporary as well, the loaded pool component starts without pools
+    CreatePools();
+}
 
-        // Set a capsule shape for collision
-        auto *shape = modelNode->CreateComponent<CollisionShape>();
-        shape->SetCapsule(0.7f, 1.8f, Vector3(0.0f, 0.9f, 0.0f));
+void Intro::InitSystems() {
+    const LockstepOptions lockstepOptions = LockstepOptions::FromArguments(GetArguments());
+    // Without physics the bodies still exist, the world is only not stepped
+    scene_->GetOrCreateComponent<PhysicsWorld>()->SetUpdateEnabled(options_.physics_);
+    // Bodies do not send collision events, contacts of the last step are read from the contact buffer instead
+    scene_->GetOrCreateComponent<ContactBuffer>();
+    // Seeded random streams and the command stream, recorded with -record and replayed with -replay. A load brings
+    // back a component without streams or files, the episode's own one takes its place so that the run goes on
+    if (!lockstep_) {
+        lockstep_ = scene_->CreateComponent<Lockstep>();
+        lockstep_->Start(lockstepOptions);
+    } else if (lockstep_->GetScene() != scene_) {
+        scene_->RemoveComponent<Lockstep>();
+        scene_->AddComponent(lockstep_, 0, REPLICATED);
+        if (lockstep_->IsRecording() || lockstep_->IsReplaying())
+            URHO3D_LOGWARNINGF("Scene loaded at lockstep tick %u, the run only reproduces with the same load",
+                               lockstep_->GetTick());
+    }
+    // Constraint solving on the WorkQueue threads with -physicsthreads <n>, reproducible runs stay single-threaded
+    auto *physicsThreading = scene_->GetOrCreateComponent<PhysicsThreading>();
+    if (!lockstepOptions.IsDeterministic())
+        physicsThreading->SetNumThreads(PhysicsThreading::ThreadsFromArguments(GetArguments()));
+    // Batched mover for the agent population, Mover components register their nodes with it
+    scene_->GetOrCreateComponent<CrowdSystem>();
+    // Throttle the animation of distant agents, distances are measured from the main camera
+    auto *animationLod = scene_->GetOrCreateComponent<AnimationLod>();
+    animationLod->SetCamera(cameraNode_);
+    // Shared run cycle phases, off until toggled with P
+    auto *poseCache = scene_->GetOrCreateComponent<PoseCache>();
+    poseCache->SetEnabled(sharedPoses_);
+    // Props and agents are built over the first frames, nearest to the camera first. Reproducible runs build a fixed
+    // number per frame so that the node ids do not depend on the machine speed
+    auto *spawnScheduler = scene_->GetOrCreateComponent<SpawnScheduler>();
+    spawnScheduler->SetCamera(cameraNode_);
+    if (lockstepOptions.IsDeterministic())
+        spawnScheduler->SetFixedCount(SPAWNS_PER_FRAME);
+    // Props are drawn as instances grouped by model, material and tile
+    scene_->GetOrCreateComponent<PropInstancer>();
+    // Props and agents far from the camera and from thrown objects drop out of the dynamics simulation
+    auto *physicsLod = scene_->GetOrCreateComponent<PhysicsLod>();
+    physicsLod->SetEnabled(physicsLod_);
+    physicsLod->AddObserver(cameraNode_, CAMERA_PHYSICS_RADIUS);
+    // The last frames are written to the log directory when one takes longer than -spikems <ms>
+    auto *flightRecorder = scene_->GetOrCreateComponent<FlightRecorder>();
+    flightRecorder->SetThreshold(FlightRecorder::ThresholdFromArguments(GetArguments(),
+                                                                        flightRecorder->GetThreshold()));
+}
 
+void Intro::InitNavigation(Terrain *terrain) {
+    // Build flow-field navigation over the terrain, water below the water plane and steep slopes are impassable.
+    // The agents patrol between the shared goals
+    auto *flowField = scene_->GetOrCreateComponent<FlowField>();
+    flowField->SetWaterHeight(5.0f);
+    flowField->Build(terrain);
+    if (!flowField->GetNumGoals()) {
+        flowField->AddGoal(Vector3(-400.0f, 0.0f, -400.0f));
+        flowField->AddGoal(Vector3(400.0f, 0.0f, -400.0f));
+        flowField->AddGoal(Vector3(400.0f, 0.0f, 400.0f));
+        flowField->AddGoal(Vector3(-400.0f, 0.0f, 400.0f));
     }
 
+    // Point-to-point paths for individual agents such as the drones, searched over the same cost grid
+    auto *pathService = scene_->GetOrCreateComponent<PathService>();
+    pathService->Build(flowField);
+    pathService->SetSynchronous(LockstepOptions::FromArguments(GetArguments()).IsDeterministic());
 }
+
 Urho3D::SharedPtr<Urho3D::Node> Intro::InitCamera() {
     // Create the camera. Set far clip to match the fog. Note: now we actually create the camera node outside
     // the scene, because we want it to be unaffected by scene load / save
@@ -287,6 +553,10 @@ Urho3D::SharedPtr<Urho3D::Node> Intro::InitCamera() {
     return cameraNode_;
 }
 void Intro::InitViewPort() {
+    // Nothing is rendered when headless, the scene only simulates
+    if (IsHeadless())
+        return;
+
     auto *graphics = GetSubsystem<Graphics>();
     auto *renderer = GetSubsystem<Renderer>();
     auto *cache = GetSubsystem<ResourceCache>();
@@ -332,12 +602,20 @@ void Intro::InitViewPort() {
 }
 void Intro::HandleUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData) {
     using namespace Update;
+    AIBG_PROFILE(EpisodeUpdate);
 
     // Take the frame time step, which is stored as a float
     float timeStep = eventData[P_TIMESTEP].GetFloat();
 
-    // Move the camera, scale movement with time step
-    MoveCamera(timeStep);
+    // Move the camera, scale movement with time step. There is no input when headless or replaying
+    auto *lockstep = scene_->GetComponent<Lockstep>();
+    if (!IsHeadless() && !lockstep->IsReplaying())
+        MoveCamera(timeStep);
+
+    // Input only submits commands, they act on the scene here so that a replay can execute them the same way
+    lockstep->TakeCommands(commands_);
+    for (const LockstepCommand &command : commands_)
+        ExecuteCommand(command);
 }
 void Intro::MoveCamera(float timeStep) {
     // Do not move if the UI has a focused element (the console)
@@ -359,6 +637,7 @@ void Intro::MoveCamera(float timeStep) {
 
     // Construct new orientation for the camera scene node from yaw and pitch. Roll is fixed to zero
     cameraNode_->SetRotation(Quaternion(pitch_, yaw_, 0.0f));
+    const Vector3 lastCameraPosition = cameraNode_->GetPosition();
 
     // Read WASD keys and move the camera scene node to the corresponding direction if they are pressed
     if (input->GetKeyDown(KEY_W))
@@ -370,22 +649,48 @@ void Intro::MoveCamera(float timeStep) {
     if (input->GetKeyDown(KEY_D))
         cameraNode_->Translate(Vector3::RIGHT*MOVE_SPEED*timeStep);
 
+    auto *lockstep = scene_->GetComponent<Lockstep>();
+    if (cameraNode_->GetPosition() != lastCameraPosition || mouseMove != IntVector2::ZERO)
+        lockstep->Submit(LockstepCommand{0, LC_CAMERA, cameraNode_->GetPosition(), cameraNode_->GetRotation(), 0, 0});
+
     // "Shoot" a physics object with left mousebutton
     if (input->GetMouseButtonPress(MOUSEB_LEFT)) {
-        SpawnObject();
+        lockstep->Submit(
+          LockstepCommand{0, LC_SPAWN_OBJECT, cameraNode_->GetPosition(), cameraNode_->GetRotation(), 0, 0});
     } // Set destination or spawn a new jack with left mouse button
     else if (input->GetMouseButtonPress(MOUSEB_MIDDLE) || input->GetKeyPress(KEY_O)) {
-        SpawnDrone();
+        lockstep->Submit(
+          LockstepCommand{0, LC_SPAWN_DRONE, cameraNode_->GetPosition(), cameraNode_->GetRotation(), 0, 0});
     }
-        // Check for loading/saving the scene from/to the file Data/Scenes/CrowdNavigation.xml relative to the executable directory
+        // Save or load a binary snapshot of the scene relative to the executable directory, with Shift as XML
     else if (input->GetKeyPress(KEY_F5)) {
-        File saveFile
-          (context_, GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/AIBattleGround.xml", FILE_WRITE);
-        scene_->SaveXML(saveFile);
+        const String scenePath = GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/AIBattleGround";
+        if (input->GetQualifierDown(QUAL_SHIFT))
+            snapshot_->SaveXML(scene_, scenePath + ".xml");
+        else
+            snapshot_->Save(scene_, scenePath + ".snapshot");
     } else if (input->GetKeyPress(KEY_F7)) {
-        File
-          loadFile(context_, GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/AIBattleGround.xml", FILE_READ);
-        scene_->LoadXML(loadFile);
+        const String scenePath = GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/AIBattleGround";
+        if (input->GetQualifierDown(QUAL_SHIFT)) {
+            if (snapshot_->LoadXML(scene_, scenePath + ".xml"))
+                RestoreAfterLoad();
+        } else
+            snapshot_->Load(scene_, scenePath + ".snapshot");
+    }
+        // Restore the autosave with F9
+    else if (input->GetKeyPress(KEY_F9)) {
+        if (DeltaAutosave::Restore(scene_, GetSubsystem<FileSystem>()->GetProgramDir() + AUTOSAVE_PATH)) {
+            RestoreAfterLoad();
+            StartAutosave();
+        }
+    }
+        // Toggle shared animation phases with P
+    else if (input->GetKeyPress(KEY_P)) {
+        lockstep->Submit(LockstepCommand{0, LC_TOGGLE_POSES, Vector3::ZERO, Quaternion::IDENTITY, 0, 0});
+    }
+        // Toggle the physics level of detail with L
+    else if (input->GetKeyPress(KEY_L)) {
+        lockstep->Submit(LockstepCommand{0, LC_TOGGLE_PHYSICS_LOD, Vector3::ZERO, Quaternion::IDENTITY, 0, 0});
     }
         // Toggle instruction text with F12
     else if (input->GetKeyPress(KEY_F12)) {
@@ -394,14 +699,10 @@ void Intro::MoveCamera(float timeStep) {
     }
         // face towards controll display
     else if (input->GetMouseButtonPress(MOUSEB_RIGHT)) {
-
-        const auto &camPos = cameraNode_->GetPosition();
-        const auto &&screenNodePos = Vector3(0.0f, 0.0f, -0.27f);
-
-        screenBox_->SetPosition(camPos);
+        lockstep->Submit(
+          LockstepCommand{0, LC_MOVE_SCREEN, cameraNode_->GetPosition(), cameraNode_->GetRotation(), 0, 0});
         cameraNode_->Translate(Vector3::BACK*MOVE_SPEED*timeStep*5);
-
-        screenNode_->SetPosition(screenBox_->GetPosition() + screenNodePos);
+        lockstep->Submit(LockstepCommand{0, LC_CAMERA, cameraNode_->GetPosition(), cameraNode_->GetRotation(), 0, 0});
     }
     // In case resolution has changed, adjust the reflection camera aspect ratio
     auto *graphics = GetSubsystem<Graphics>();
@@ -422,36 +723,129 @@ void Intro::HandlePostRenderUpdate(Urho3D::StringHash eventType, Urho3D::Variant
     // bones. Note that debug geometry has to be separately requested each frame. Disable depth test so that we can see the
     // bones properly
 }
-void Intro::SpawnObject() {
+void Intro::ExecuteCommand(const LockstepCommand &command) {
+    switch (command.type_) {
+    case LC_CAMERA:
+        cameraNode_->SetTransform(command.position_, command.rotation_);
+        // Live input continues from the replayed orientation
+        yaw_ = command.rotation_.YawAngle();
+        pitch_ = command.rotation_.PitchAngle();
+        break;
+    case LC_SPAWN_OBJECT:
+        SpawnObject(command.position_, command.rotation_);
+        break;
+    case LC_SPAWN_DRONE:
+        SpawnDrone(command.position_, command.rotation_);
+        break;
+    case LC_MOVE_SCREEN:
+        screenBox_->SetPosition(command.position_);
+        screenNode_->SetPosition(screenBox_->GetPosition() + Vector3(0.0f, 0.0f, -0.27f));
+        break;
+    case LC_TOGGLE_POSES:
+        sharedPoses_ = !sharedPoses_;
+        if (auto *poseCache = scene_->GetComponent<PoseCache>())
+            poseCache->SetEnabled(sharedPoses_);
+        break;
+    case LC_TOGGLE_PHYSICS_LOD:
+        physicsLod_ = !physicsLod_;
+        if (auto *physicsLod = scene_->GetComponent<PhysicsLod>())
+            physicsLod->SetEnabled(physicsLod_);
+        break;
+    case LC_AGENT_GOAL:
+        if (Node *node = scene_->GetNode(command.target_)) {
+            if (auto *mover = node->GetComponent<Mover>())
+                mover->SetGoal(command.value_);
+        }
+        break;
+    default:
+        break;
+    }
+}
+const std::tuple<String, String, String> &Intro::GetAgentKind(unsigned kind) {
+    return AGENT_RESOURCES[kind%GetNumAgentKinds()];
+}
 
-    auto *cache = GetSubsystem<ResourceCache>();
-    const float scale = Random(1, 7) + 0.5f;
-    Node *boxNode = scene_->CreateChild("Sphere");
-    boxNode->SetPosition(cameraNode_->GetPosition());
-    boxNode->SetRotation(cameraNode_->GetRotation());
+unsigned Intro::GetNumAgentKinds() {
+    return sizeof(AGENT_RESOURCES)/sizeof(AGENT_RESOURCES[0]);
+}
+
+void Intro::BuildProp(Node *node, Model *model, Material *material, float mass, bool sphere) {
+    Scene *scene = node->GetScene();
+    if (auto *propInstancer = scene->GetComponent<PropInstancer>())
+        propInstancer->AddInstance(node, model, material);
+
+    auto *body = node->CreateComponent<RigidBody>();
+    body->SetMass(mass);
+    body->SetCollisionEventMode(COLLISION_NEVER);
+
+    auto *shape = node->CreateComponent<CollisionShape>();
+    if (sphere) {
+        body->SetRollingFriction(1.0f);
+        shape->SetSphere(1.0f);
+    } else {
+        shape->SetBox(Vector3::ONE);
+    }
+    if (auto *physicsLod = scene->GetComponent<PhysicsLod>())
+        physicsLod->AddBody(body, PLOD_REMOVE);
+}
+
+Node *Intro::CreateProp(Node *parent, const String &name, const Vector3 &position, const Quaternion &rotation,
+                        float scale, Model *model, Material *material, float massScalar) {
+    Node *boxNode = parent->CreateChild(name);
+    boxNode->SetPosition(position);
+    boxNode->SetRotation(rotation);
     boxNode->SetScale(scale);
-    auto *boxObject = boxNode->CreateComponent<StaticModel>();
+    BuildProp(boxNode, model, material, scale*massScalar, name.Find("Sphere") != String::NPOS);
+    return boxNode;
+}
+
+void Intro::BuildSphere(Node *node) {
+
+    auto *cache = node->GetSubsystem<ResourceCache>();
+    auto *boxObject = node->CreateComponent<StaticModel>();
     boxObject->SetModel(cache->GetResource<Model>("Models/Sphere.mdl"));
     boxObject->SetMaterial(cache->GetResource<Material>("Materials/Stone.xml"));
     boxObject->SetCastShadows(true);
 
-    auto *body = boxNode->CreateComponent<RigidBody>();
-    body->SetMass(scale*50.0f);
+    auto *body = node->CreateComponent<RigidBody>();
     body->SetRollingFriction(1.0f);
-    auto *shape = boxNode->CreateComponent<CollisionShape>();
+    body->SetCollisionEventMode(COLLISION_NEVER);
+    auto *shape = node->CreateComponent<CollisionShape>();
     shape->SetSphere(1.0f);
 
+    // Props wake up around a thrown sphere while it is active
+    if (auto *physicsLod = node->GetScene()->GetComponent<PhysicsLod>())
+        physicsLod->AddObserver(node, 20.0f);
+}
+void Intro::SpawnObject(const Vector3 &position, const Quaternion &rotation) {
+    AIBG_PROFILE(SpawnObject);
+
+    const float scale = scene_->GetComponent<Lockstep>()->GetStream("Spawns").Random(1, 7) + 0.5f;
+    ThrowSphere(scene_->GetComponent<EntityPool>(), spherePool_, position, rotation, scale);
+}
+
+Node *Intro::ThrowSphere(EntityPool *entityPool, unsigned pool, const Vector3 &position, const Quaternion &rotation,
+                         float scale) {
+    Node *boxNode = entityPool->Spawn(pool, position, rotation);
+    if (!boxNode)
+        return nullptr;
+    boxNode->SetScale(scale);
+
+    auto *body = boxNode->GetComponent<RigidBody>();
+    body->SetMass(scale*50.0f);
+
     const float OBJECT_VELOCITY = 70.0f;
 
     // Set initial velocity for the RigidBody based on camera forward vector. Add also a slight up component
     // to overcome gravity better
-    body->SetLinearVelocity(cameraNode_->GetRotation()*Vector3(0.0f, 0.25f, 1.0f)*(OBJECT_VELOCITY));
-
+    body->SetLinearVelocity(rotation*Vector3(0.0f, 0.25f, 1.0f)*(OBJECT_VELOCITY));
+    return boxNode;
 }
 
-void Intro::SpawnDrone() {
 
-    auto *cache = GetSubsystem<ResourceCache>();
+void Intro::BuildDrone(Node *node, Node *camera) {
+
+    auto *cache = node->GetSubsystem<ResourceCache>();
     const float MODEL_MOVE_SPEED = 30.0f;
     const float MODEL_ROTATE_SPEED =200.0f;
     const float x_bound = 900.0f;
@@ -459,37 +853,54 @@ void Intro::SpawnDrone() {
 
     const BoundingBox bounds(Vector3(-x_bound, 0.0f, -y_bound), Vector3(x_bound, 0.0f, y_bound));
 
-    Node *boxNode = scene_->CreateChild("MQ9");
-    boxNode->SetPosition(cameraNode_->GetPosition());
-    boxNode->SetRotation(cameraNode_->GetRotation());
-    boxNode->SetScale(3);
+    node->SetScale(3);
 
-    rttCameraNode_->SetRotation(boxNode->GetRotation());
-    rttCameraNode_->LookAt(Vector3(0.0f, 0.0f, 0.0f), Vector3::DOWN, TransformSpace::TS_WORLD);
-
-    auto *boxObject = boxNode->CreateComponent<StaticModel>();
+    auto *boxObject = node->CreateComponent<StaticModel>();
     boxObject->SetModel(cache->GetResource<Model>("Models/MQ_9/MQ_9.mdl"));
-    boxObject->SetMaterial(cache->GetResource<Material>("Materials/Mutant/Materials/mutant_M.xml"));
+    boxObject->SetMaterial(cache->GetResource<Material>("Models/Mutant/Materials/mutant_M.xml"));
     boxObject->SetCastShadows(true);
 
     // Create our custom Mover component that will move & animate the model during each frame's update
-    auto *mover = boxNode->CreateComponent<DroneMover>();
-    mover->SetParameters(MODEL_MOVE_SPEED, MODEL_ROTATE_SPEED, bounds, rttCameraNode_);
+    auto *mover = node->CreateComponent<DroneMover>();
+    mover->SetParameters(MODEL_MOVE_SPEED, MODEL_ROTATE_SPEED, bounds, camera);
 
-    auto *body = boxNode->CreateComponent<RigidBody>();
+    auto *body = node->CreateComponent<RigidBody>();
     body->SetMass(10.0f);
 
     // Set zero angular factor so that physics doesn't turn the character on its own.
     // Instead we will control the character yaw manually
     body->SetAngularFactor(Vector3::ZERO);
 
-    // Set the rigidbody to signal collision also when in rest, so that we get ground collisions properly
-    body->SetCollisionEventMode(COLLISION_ALWAYS);
-    auto *shape = boxNode->CreateComponent<CollisionShape>();
+    // Contacts are read from the contact buffer, no collision events
+    body->SetCollisionEventMode(COLLISION_NEVER);
+    auto *shape = node->CreateComponent<CollisionShape>();
     shape->SetCapsule(3.7f, 3.8f, Vector3(0.0f, 0.9f, 0.0f));
+    if (auto *physicsLod = node->GetScene()->GetComponent<PhysicsLod>())
+        physicsLod->AddObserver(node, 30.0f);
+
+}
+void Intro::SpawnDrone(const Vector3 &position, const Quaternion &rotation) {
+    AIBG_PROFILE(SpawnDrone);
 
+    LaunchDrone(scene_->GetComponent<EntityPool>(), dronePool_, position, rotation, rttCameraNode_);
 }
+
+Node *Intro::LaunchDrone(EntityPool *entityPool, unsigned pool, const Vector3 &position, const Quaternion &rotation,
+                         Node *camera) {
+    Node *boxNode = entityPool->Spawn(pool, position, rotation);
+    if (!boxNode)
+        return nullptr;
+
+    camera->SetRotation(boxNode->GetRotation());
+    camera->LookAt(Vector3(0.0f, 0.0f, 0.0f), Vector3::DOWN, TransformSpace::TS_WORLD);
+    return boxNode;
+}
+
 void Intro::CreateInstructions() {
+    instructionText_ = nullptr;
+    if (IsHeadless())
+        return;
+
     auto *cache = GetSubsystem<ResourceCache>();
     auto *ui = GetSubsystem<UI>();
 
@@ -499,7 +910,10 @@ void Intro::CreateInstructions() {
       "Use WASD keys to move, RMB to rotate view\n"
         "LMB to spawn ball object, MMB to spawn a MQ9 Reaper drone\n"
         "RMB to go back and face the drone control display\n"
-        "F5 to save scene, F7 to load\n"
+        "F5 to save scene, F7 to load, with Shift as XML\n"
+        "F9 to restore the autosave\n"
+        "P to toggle shared animation poses\n"
+        "L to toggle the physics level of detail\n"
         "F12 to toggle this instruction text"
     );
     instructionText_->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 15);
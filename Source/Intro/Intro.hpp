@@ -5,7 +5,32 @@
 #ifndef AIBATTLEGROUND_INTRO_HPP
 #define AIBATTLEGROUND_INTRO_HPP
 
+#include <tuple>
+#include <vector>
+
 #include "../Base/Episode.hpp"
+#include "../Base/Lockstep.hpp"
+#include "../Base/SceneSnapshot.hpp"
+
+class EntityPool;
+
+/// Scenario options read from the command line: -agents <n>, -props <n>, -drones <n> and -nophysics.
+struct IntroOptions {
+    /// Read the options from the program arguments.
+    static IntroOptions FromArguments(const Urho3D::Vector<Urho3D::String> &arguments);
+    /// Return the number of props of a kind, scaled from its share of the default prop count.
+    unsigned GetPropCount(unsigned defaultCount) const;
+
+    /// Number of crowd agents.
+    unsigned numAgents_ = 700;
+    /// Number of scattered props over all kinds.
+    unsigned numProps_ = 1000;
+    /// Number of drones spawned with the population.
+    unsigned numDrones_ = 0;
+    /// Whether the physics world is stepped.
+    bool physics_ = true;
+};
+
 class Intro : public Episode , public AIBattleGround{
     // Enable type information.
  URHO3D_OBJECT(Intro, AIBattleGround)
@@ -13,6 +38,7 @@ class Intro : public Episode , public AIBattleGround{
     Intro(Urho3D::Context* context);
     virtual ~Intro();
 
+    void GetResourceManifest(ResourceManifest &manifest) override;
     Urho3D::Scene *InitScene() override;
     void InitObjects() override;
     Urho3D::SharedPtr<Urho3D::Node> InitCamera() override;
@@ -24,8 +50,32 @@ class Intro : public Episode , public AIBattleGround{
     void HandlePostRenderUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData) override;
     void CreateInstructions() override;
 
-    /// Spawn a physics object from the camera position.
-    void SpawnObject();
+    /// Spawn a physics object at a transform, thrown forward.
+    void SpawnObject(const Urho3D::Vector3 &position, const Urho3D::Quaternion &rotation);
+    /// Return scenario options.
+    const IntroOptions &GetOptions() const { return options_; }
+
+    /// Return model, run animation and material of an agent kind.
+    static const std::tuple<Urho3D::String, Urho3D::String, Urho3D::String> &GetAgentKind(unsigned kind);
+    /// Return number of agent kinds.
+    static unsigned GetNumAgentKinds();
+    /// Create the instance, body and shape of a scattered prop on a node that is already placed in the scene.
+    static void BuildProp(Urho3D::Node *node, Urho3D::Model *model, Urho3D::Material *material, float mass,
+                          bool sphere);
+    /// Create the components of a pooled sphere.
+    static void BuildSphere(Urho3D::Node *node);
+    /// Create the components of a pooled drone, its camera follows it.
+    static void BuildDrone(Urho3D::Node *node, Urho3D::Node *camera);
+    /// Create and build a scattered prop as a child of a node. Return the prop node.
+    static Urho3D::Node *CreateProp(Urho3D::Node *parent, const Urho3D::String &name, const Urho3D::Vector3 &position,
+                                    const Urho3D::Quaternion &rotation, float scale, Urho3D::Model *model,
+                                    Urho3D::Material *material, float massScalar);
+    /// Take a sphere from its pool, scale and weigh it and throw it forward. Return null when the pool is empty.
+    static Urho3D::Node *ThrowSphere(EntityPool *entityPool, unsigned pool, const Urho3D::Vector3 &position,
+                                     const Urho3D::Quaternion &rotation, float scale);
+    /// Take a drone from its pool and aim the drone camera at it. Return null when the pool is empty.
+    static Urho3D::Node *LaunchDrone(EntityPool *entityPool, unsigned pool, const Urho3D::Vector3 &position,
+                                     const Urho3D::Quaternion &rotation, Urho3D::Node *camera);
 
  private:
 
@@ -43,7 +93,41 @@ class Intro : public Episode , public AIBattleGround{
                        Urho3D::Scene *scene,
                        const float massScalar,
                        const float boundsXY);
-    void SpawnDrone();
+    /// Spawn a drone at a transform.
+    void SpawnDrone(const Urho3D::Vector3 &position, const Urho3D::Quaternion &rotation);
+    /// Handle the initial population being built.
+    void HandleSpawnsFinished(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Write the autosave baseline and start the periodic checkpoints.
+    void StartAutosave();
+    /// Create the entity pools of the thrown spheres and the drones.
+    void CreatePools();
+    /// Create and set up the scene's system components, or set up the ones brought back by a load.
+    void InitSystems();
+    /// Build the flow field and the path service over the terrain.
+    void InitNavigation(Urho3D::Terrain *terrain);
+    /// Handle the scene finishing an incremental load.
+    void HandleAsyncLoadFinished(Urho3D::StringHash eventType, Urho3D::VariantMap &eventData);
+    /// Rebuild the state that a scene load does not restore.
+    void RestoreAfterLoad();
+    /// Execute a command of the lockstep command stream.
+    void ExecuteCommand(const LockstepCommand &command);
+
+    /// Commands of the current tick.
+    std::vector<LockstepCommand> commands_;
+    /// Entity pool of the thrown spheres.
+    unsigned spherePool_;
+    /// Entity pool of the drones.
+    unsigned dronePool_;
+    /// Scene save and load.
+    Urho3D::SharedPtr<SceneSnapshot> snapshot_;
+    /// Lockstep component of the episode, put back into the scene after a load.
+    Urho3D::SharedPtr<Lockstep> lockstep_;
+    /// Whether the shared animation poses are toggled on.
+    bool sharedPoses_;
+    /// Whether the physics level of detail is on.
+    bool physicsLod_;
+    /// Scenario options.
+    IntroOptions options_;
 };
 
 #endif //AIBATTLEGROUND_INTRO_HPP
@@ -24,25 +24,111 @@
 #include <Urho3D/Graphics/AnimationState.h>
 #include <Urho3D/Scene/Scene.h>
 
+#include "../Base/TraceRecorder.hpp"
+#include "../Base/UpdateCosts.hpp"
 #include "Mover.h"
 
 #include <Urho3D/DebugNew.h>
 
+namespace {
+
+/// Node variables with the motion parameters and the goal, the component's own members are not saved.
+const StringHash VAR_MOVER_SPEED("MoverSpeed");
+const StringHash VAR_MOVER_ROTATION_SPEED("MoverRotationSpeed");
+const StringHash VAR_MOVER_BOUNDS_MIN("MoverBoundsMin");
+const StringHash VAR_MOVER_BOUNDS_MAX("MoverBoundsMax");
+const StringHash VAR_MOVER_GOAL("MoverGoal");
+
+}
+
 Mover::Mover(Context *context) :
   LogicComponent(context),
   moveSpeed_(0.0f),
-  rotationSpeed_(0.0f) {
+  rotationSpeed_(0.0f),
+  agent_(M_MAX_UNSIGNED),
+  goal_(M_MAX_UNSIGNED) {
     // Only the scene update event is needed: unsubscribe from the rest for optimization
     SetUpdateEventMask(USE_UPDATE);
 }
 
+Mover::~Mover() {
+    LeaveCrowd();
+}
+
 void Mover::SetParameters(float moveSpeed, float rotationSpeed, const BoundingBox &bounds) {
     moveSpeed_ = moveSpeed;
     rotationSpeed_ = rotationSpeed;
     bounds_ = bounds;
+    if (node_) {
+        node_->SetVar(VAR_MOVER_SPEED, moveSpeed_);
+        node_->SetVar(VAR_MOVER_ROTATION_SPEED, rotationSpeed_);
+        node_->SetVar(VAR_MOVER_BOUNDS_MIN, bounds_.min_);
+        node_->SetVar(VAR_MOVER_BOUNDS_MAX, bounds_.max_);
+    }
+
+    if (IsCrowdAgent()) {
+        crowd_->SetAgentParameters(agent_, moveSpeed_, rotationSpeed_, bounds_);
+        return;
+    }
+
+    // Hand the movement over to the scene's crowd system when there is one
+    Scene *scene = GetScene();
+    crowd_ = scene ? scene->GetComponent<CrowdSystem>() : nullptr;
+    if (crowd_) {
+        agent_ = crowd_->AddAgent(node_, moveSpeed_, rotationSpeed_, bounds_);
+        if (goal_ != M_MAX_UNSIGNED)
+            crowd_->SetAgentGoal(agent_, goal_);
+        SetUpdateEventMask(0);
+    }
+}
+
+void Mover::SetGoal(unsigned goal) {
+    goal_ = goal;
+    if (node_)
+        node_->SetVar(VAR_MOVER_GOAL, goal_);
+    if (IsCrowdAgent())
+        crowd_->SetAgentGoal(agent_, goal);
+}
+
+void Mover::RestoreParameters() {
+    if (!node_ || node_->GetVar(VAR_MOVER_SPEED).IsEmpty())
+        return;
+
+    const Variant &goal = node_->GetVar(VAR_MOVER_GOAL);
+    goal_ = goal.IsEmpty() ? M_MAX_UNSIGNED : goal.GetUInt();
+    LeaveCrowd();
+    SetParameters(node_->GetVar(VAR_MOVER_SPEED).GetFloat(), node_->GetVar(VAR_MOVER_ROTATION_SPEED).GetFloat(),
+                  BoundingBox(node_->GetVar(VAR_MOVER_BOUNDS_MIN).GetVector3(),
+                              node_->GetVar(VAR_MOVER_BOUNDS_MAX).GetVector3()));
+}
+
+void Mover::OnSceneSet(Scene *scene) {
+    LogicComponent::OnSceneSet(scene);
+    if (!scene) {
+        LeaveCrowd();
+        SetUpdateEventMask(USE_UPDATE);
+    }
+}
+
+void Mover::OnSetEnabled() {
+    LogicComponent::OnSetEnabled();
+    if (!IsEnabledEffective()) {
+        LeaveCrowd();
+        SetUpdateEventMask(USE_UPDATE);
+    } else if (!IsCrowdAgent() && GetScene())
+        SetParameters(moveSpeed_, rotationSpeed_, bounds_);
+}
+
+void Mover::LeaveCrowd() {
+    if (IsCrowdAgent())
+        crowd_->RemoveAgent(agent_);
+    crowd_.Reset();
+    agent_ = M_MAX_UNSIGNED;
 }
 
 void Mover::Update(float timeStep) {
+    AIBG_PROFILE(MoverUpdate);
+    AIBG_UPDATE_COST();
     node_->Translate(Vector3::FORWARD*moveSpeed_*timeStep);
 
     // If in risk of going outside the plane, rotate the model right
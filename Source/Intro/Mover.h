@@ -24,9 +24,12 @@
 
 #include <Urho3D/Scene/LogicComponent.h>
 
+#include "../Base/CrowdSystem.hpp"
+
 using namespace Urho3D;
 
-/// Custom logic component for moving the animated model and rotating at area edges.
+/// Custom logic component for moving the animated model and rotating at area edges. When the scene has a CrowdSystem
+/// the component only registers the node as a crowd agent and the movement is done in the crowd's batched update.
 class Mover : public LogicComponent
 {
     URHO3D_OBJECT(Mover, LogicComponent);
@@ -34,10 +37,16 @@ class Mover : public LogicComponent
 public:
     /// Construct.
     explicit Mover(Context* context);
+    /// Destruct.
+    ~Mover() override;
 
     /// Set motion parameters: forward movement speed, rotation speed, and movement boundaries.
     void SetParameters(float moveSpeed, float rotateSpeed, const BoundingBox& bounds);
-    /// Handle scene update. Called by LogicComponent base class.
+    /// Set the shared flow field goal to walk to, or M_MAX_UNSIGNED to wander. Only used by a CrowdSystem.
+    void SetGoal(unsigned goal);
+    /// Set the parameters and the goal again from the node variables they are saved in, after a scene load.
+    void RestoreParameters();
+    /// Handle scene update. Called by LogicComponent base class only when not driven by a CrowdSystem.
     void Update(float timeStep) override;
 
     /// Return forward movement speed.
@@ -46,12 +55,29 @@ public:
     float GetRotationSpeed() const { return rotationSpeed_; }
     /// Return movement boundaries.
     const BoundingBox& GetBounds() const { return bounds_; }
+    /// Return whether the movement is done by a CrowdSystem.
+    bool IsCrowdAgent() const { return crowd_ && crowd_->HasAgent(agent_); }
+
+protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Scene* scene) override;
+    /// Handle enabled/disabled state change. A disabled mover leaves the crowd and joins it again when enabled.
+    void OnSetEnabled() override;
 
 private:
+    /// Remove the agent from the crowd, if registered.
+    void LeaveCrowd();
+
     /// Forward movement speed.
     float moveSpeed_;
     /// Rotation speed.
     float rotationSpeed_;
     /// Movement boundaries.
     BoundingBox bounds_;
+    /// Crowd system moving the node.
+    WeakPtr<CrowdSystem> crowd_;
+    /// Agent handle in the crowd system.
+    unsigned agent_;
+    /// Flow field goal, kept for joining the crowd again.
+    unsigned goal_;
 };